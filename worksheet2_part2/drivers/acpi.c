@@ -0,0 +1,109 @@
+#include "acpi.h"
+#include "pmm.h"
+
+/*
+    ACPI table lookup
+	From: http://wiki.osdev.org/RSDP and http://wiki.osdev.org/RSDT
+	The RSDP is a 16-byte aligned structure in the first KiB of the EBDA
+	or in the BIOS area 0xE0000-0xFFFFF. It points at the RSDT, an array of
+	32-bit pointers to the other tables. Only the 32-bit RSDT is used: the
+	kernel cannot address anything above 4 GiB anyway. All of them are
+	physical addresses, read through the direct map.
+*/
+
+struct acpi_rsdp {
+	char signature[8];	/* "RSD PTR " */
+	u8int checksum;
+	char oem_id[6];
+	u8int revision;
+	u32int rsdt_address;
+} __attribute__((packed));
+
+static struct acpi_header* acpi_rsdt = 0;
+static u32int acpi_searched = 0;
+
+static u8int acpi_checksum(const void* data, u32int length)
+{
+	const u8int* byte = (const u8int*) data;
+	u8int sum = 0;
+
+	while (length--) {
+		sum += *byte++;
+	}
+	return sum;
+}
+
+/* Tables outside the direct map are out of reach */
+static void* acpi_map(u32int address)
+{
+	return address < PMM_DIRECT_MAP_SIZE ? PMM_PHYS_TO_VIRT(address) : 0;
+}
+
+static struct acpi_rsdp* acpi_scan(u32int start, u32int end)
+{
+	struct acpi_rsdp* rsdp;
+	const char* signature = "RSD PTR ";
+	u32int address;
+	u32int i;
+
+	for (address = start; address < end; address += 16) {
+		rsdp = acpi_map(address);
+		for (i = 0; i < 8 && rsdp->signature[i] == signature[i]; i++) {
+		}
+		if (i == 8 && acpi_checksum(rsdp, sizeof(struct acpi_rsdp)) == 0) {
+			return rsdp;
+		}
+	}
+	return 0;
+}
+
+static void acpi_init(void)
+{
+	u32int ebda = (u32int) *(volatile u16int*) acpi_map(ACPI_EBDA_POINTER) << 4;
+	struct acpi_rsdp* rsdp = 0;
+	struct acpi_header* rsdt;
+
+	acpi_searched = 1;
+
+	if (ebda) {
+		rsdp = acpi_scan(ebda, ebda + 1024);
+	}
+	if (!rsdp) {
+		rsdp = acpi_scan(ACPI_BIOS_START, ACPI_BIOS_END);
+	}
+	if (!rsdp) {
+		return;
+	}
+
+	rsdt = acpi_map(rsdp->rsdt_address);
+	if (rsdt && acpi_checksum(rsdt, rsdt->length) == 0) {
+		acpi_rsdt = rsdt;
+	}
+}
+
+struct acpi_header* acpi_find_table(const char* signature)
+{
+	struct acpi_header* table;
+	u32int* entries;
+	u32int count;
+	u32int i;
+
+	if (!acpi_searched) {
+		acpi_init();
+	}
+	if (!acpi_rsdt) {
+		return 0;
+	}
+
+	entries = (u32int*) (acpi_rsdt + 1);
+	count = (acpi_rsdt->length - sizeof(struct acpi_header)) / 4;
+	for (i = 0; i < count; i++) {
+		table = acpi_map(entries[i]);
+		if (table && table->signature[0] == signature[0] && table->signature[1] == signature[1] &&
+		    table->signature[2] == signature[2] && table->signature[3] == signature[3] &&
+		    acpi_checksum(table, table->length) == 0) {
+			return table;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef INCLUDE_ACPI_H
+#define INCLUDE_ACPI_H
+
+#include "type.h"
+
+/*
+    Just enough ACPI to find static tables (HPET, MADT, ...). Tables are
+    read in place, by the drivers that use them; nothing is copied.
+*/
+#define ACPI_EBDA_POINTER	0x40E	/* BIOS data area: EBDA segment */
+#define ACPI_BIOS_START		0xE0000
+#define ACPI_BIOS_END		0x100000
+
+/* Every system description table starts with this header */
+struct acpi_header {
+	char signature[4];
+	u32int length;
+	u8int revision;
+	u8int checksum;
+	char oem_id[6];
+	char oem_table_id[8];
+	u32int oem_revision;
+	u32int creator_id;
+	u32int creator_revision;
+} __attribute__((packed));
+
+/* Generic address structure, as used by the HPET and FADT tables */
+struct acpi_address {
+	u8int space_id;		/* 0 = memory, 1 = I/O ports */
+	u8int bit_width;
+	u8int bit_offset;
+	u8int access_size;
+	u64int address;
+} __attribute__((packed));
+
+/*
+    Multiple APIC Description Table ("APIC"): a header, then variable length
+    entries that each start with a type and a length byte
+*/
+#define ACPI_MADT_LOCAL_APIC	0
+#define ACPI_MADT_IOAPIC	1
+#define ACPI_MADT_OVERRIDE	2
+
+#define ACPI_MADT_ENABLED	0x1	/* local APIC flags */
+
+/* Interrupt source override flags: 0 in either field means "as the bus" */
+#define ACPI_MADT_POLARITY_MASK	0x3
+#define ACPI_MADT_ACTIVE_LOW	0x3
+#define ACPI_MADT_TRIGGER_MASK	0xC
+#define ACPI_MADT_LEVEL		0xC
+
+struct acpi_madt {
+	struct acpi_header header;
+	u32int local_apic_address;
+	u32int flags;
+} __attribute__((packed));
+
+struct acpi_madt_local_apic {
+	u8int type;
+	u8int length;
+	u8int processor_id;
+	u8int apic_id;
+	u32int flags;
+} __attribute__((packed));
+
+struct acpi_madt_ioapic {
+	u8int type;
+	u8int length;
+	u8int ioapic_id;
+	u8int reserved;
+	u32int address;
+	u32int gsi_base;
+} __attribute__((packed));
+
+struct acpi_madt_override {
+	u8int type;
+	u8int length;
+	u8int bus;		/* 0 = ISA */
+	u8int irq;		/* ISA IRQ */
+	u32int gsi;		/* I/O APIC input it is wired to */
+	u16int flags;
+} __attribute__((packed));
+
+/** acpi_find_table:
+ *  Looks a table up by signature (e.g. "HPET") through the RSDP and RSDT.
+ *  The RSDP is located and checked on the first call.
+ *
+ *  @return the table, or 0 if there is no ACPI or no such table
+ */
+struct acpi_header* acpi_find_table(const char* signature);
+
+#endif /* INCLUDE_ACPI_H */
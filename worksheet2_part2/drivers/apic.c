@@ -0,0 +1,268 @@
+#include "apic.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "pic.h"
+#include "paging.h"
+#include "spinlock.h"
+#include "hardware_interrupt_enabler.h"
+#include "init.h"
+
+/*
+    Local APIC and I/O APIC
+	From: http://wiki.osdev.org/APIC and http://wiki.osdev.org/IOAPIC
+	ISA IRQs are routed through the I/O APIC to the same vectors the
+	remapped PIC would use, so the IDT does not care which one is active.
+	End of interrupt is a single store to the local APIC.
+	Where the I/O APIC lives and how the ISA IRQs are wired to it come
+	from the MADT; the PC defaults below are only used without one.
+*/
+
+static volatile u32int* apic_registers = 0;
+static volatile u32int* ioapic_registers = 0;
+static u32int apic_in_use = 0;
+static u32int apic_vector_offset = 0;
+static u32int ioapic_max_entry = 0;
+
+/* Bit n set means ISA IRQ n is masked in the I/O APIC */
+static u16int apic_mask = 0xFFFF;
+
+/*
+    ISA IRQ to I/O APIC input. Without a MADT: identity except for the PIT,
+    which every PC chipset (and QEMU) wires to input 2.
+*/
+static u8int apic_isa_gsi[PIC_IRQ_COUNT] = {
+	2, 1, 0, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+
+/* Polarity and trigger bits of each ISA IRQ's redirection entry */
+static u32int apic_isa_flags[PIC_IRQ_COUNT];
+
+static u32int apic_read(u32int reg)
+{
+	return apic_registers[reg / 4];
+}
+
+static void apic_write(u32int reg, u32int value)
+{
+	apic_registers[reg / 4] = value;
+}
+
+static u32int ioapic_read(u32int reg)
+{
+	ioapic_registers[IOAPIC_REGSEL / 4] = reg;
+	return ioapic_registers[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(u32int reg, u32int value)
+{
+	ioapic_registers[IOAPIC_REGSEL / 4] = reg;
+	ioapic_registers[IOAPIC_WINDOW / 4] = value;
+}
+
+/**
+  *  Programs a redirection entry: fixed delivery to the boot CPU, edge
+  *  triggered and active high unless low says otherwise.
+  */
+static void ioapic_write_redirect(u32int gsi, u32int low)
+{
+	u32int entry = IOAPIC_REG_REDTBL + gsi * 2;
+
+	ioapic_write(entry + 1, apic_read(APIC_REG_ID) & 0xFF000000); // destination APIC ID
+	ioapic_write(entry, low);
+}
+
+static void ioapic_route_irq(u32int irq, u32int masked)
+{
+	u32int low = (apic_vector_offset + irq) | apic_isa_flags[irq];
+
+	if (masked) {
+		low |= IOAPIC_REDIRECT_MASKED;
+	}
+	ioapic_write_redirect(apic_isa_gsi[irq], low);
+}
+
+static u32int __init apic_override_flags(u16int flags)
+{
+	u32int low = 0;
+
+	if ((flags & ACPI_MADT_POLARITY_MASK) == ACPI_MADT_ACTIVE_LOW) {
+		low |= IOAPIC_REDIRECT_ACTIVE_LOW;
+	}
+	if ((flags & ACPI_MADT_TRIGGER_MASK) == ACPI_MADT_LEVEL) {
+		low |= IOAPIC_REDIRECT_LEVEL;
+	}
+	return low;
+}
+
+/**
+  *  Takes the I/O APIC address and the ISA wiring from the MADT: the I/O
+  *  APIC whose inputs start at 0 and the interrupt source overrides of bus
+  *  0. An ISA IRQ without an override is wired to the same-numbered input.
+  *
+  *  @return the physical address of the I/O APIC
+  */
+static u32int __init apic_read_madt(void)
+{
+	struct acpi_madt* madt = (struct acpi_madt*) acpi_find_table("APIC");
+	struct acpi_madt_ioapic* ioapic;
+	struct acpi_madt_override* override;
+	u32int address = IOAPIC_DEFAULT_BASE;
+	u8int* next;
+	u8int* end;
+	u32int irq;
+
+	if (!madt) {
+		return address;
+	}
+	for (irq = 0; irq < PIC_IRQ_COUNT; irq++) {
+		apic_isa_gsi[irq] = irq;
+	}
+
+	next = (u8int*) (madt + 1);
+	end = (u8int*) madt + madt->header.length;
+	for (; next + 2 <= end && next[1] >= 2 && next + next[1] <= end; next += next[1]) {
+		if (next[0] == ACPI_MADT_IOAPIC && next[1] >= sizeof(*ioapic)) {
+			ioapic = (struct acpi_madt_ioapic*) next;
+			if (ioapic->gsi_base == 0) {
+				address = ioapic->address;
+			}
+		} else if (next[0] == ACPI_MADT_OVERRIDE && next[1] >= sizeof(*override)) {
+			override = (struct acpi_madt_override*) next;
+			if (override->bus == 0 && override->irq < PIC_IRQ_COUNT && override->gsi <= 0xFF) {
+				apic_isa_gsi[override->irq] = override->gsi;
+				apic_isa_flags[override->irq] = apic_override_flags(override->flags);
+			}
+		}
+	}
+	return address;
+}
+
+u32int __init apic_init(u32int offset)
+{
+	u64int base;
+	u32int max_entry;
+	u32int irq;
+
+	if (!cpu_has_feature(CPU_FEATURE_APIC) || !cpu_has_feature(CPU_FEATURE_MSR)) {
+		return 0;
+	}
+
+	ioapic_registers = paging_map_mmio(apic_read_madt(), PAGING_PAGE_SIZE);
+	if (!ioapic_registers) {
+		return 0;
+	}
+	max_entry = (ioapic_read(IOAPIC_REG_VERSION) >> 16) & 0xFF;
+	if (max_entry == 0xFF || max_entry < PIC_IRQ_COUNT - 1) {
+		return 0; // Nothing answering at the I/O APIC address
+	}
+	for (irq = 0; irq < PIC_IRQ_COUNT; irq++) {
+		if (apic_isa_gsi[irq] > max_entry) {
+			return 0; // Wired to an I/O APIC we do not drive
+		}
+	}
+	ioapic_max_entry = max_entry;
+
+	base = cpu_read_msr(APIC_BASE_MSR);
+	cpu_write_msr(APIC_BASE_MSR, base | APIC_BASE_ENABLE);
+	apic_registers = paging_map_mmio((u32int) base & APIC_BASE_ADDRESS_MASK, PAGING_PAGE_SIZE);
+	if (!apic_registers) {
+		return 0;
+	}
+
+	apic_write(APIC_REG_TPR, 0);
+	apic_write(APIC_REG_SPURIOUS, APIC_SPURIOUS_ENABLE | APIC_SPURIOUS_VECTOR);
+
+	apic_vector_offset = offset;
+	apic_mask = 0xFFFF;
+	for (irq = 0; irq < PIC_IRQ_COUNT; irq++) {
+		ioapic_route_irq(irq, 1);
+	}
+
+	apic_in_use = 1;
+	return 1;
+}
+
+void apic_init_cpu(void)
+{
+	cpu_write_msr(APIC_BASE_MSR, cpu_read_msr(APIC_BASE_MSR) | APIC_BASE_ENABLE);
+	apic_write(APIC_REG_TPR, 0);
+	apic_write(APIC_REG_SPURIOUS, APIC_SPURIOUS_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+/**
+  *  The destination goes in first; an interrupt on this CPU sending an IPI
+  *  of its own in between would change it, hence interrupts stay off.
+  */
+void apic_send_ipi(u32int apic_id, u32int command)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	while (apic_read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING) {
+		cpu_relax();
+	}
+	apic_write(APIC_REG_ICR_HIGH, apic_id << 24);
+	apic_write(APIC_REG_ICR_LOW, command);
+	restore_hardware_interrupts(flags);
+}
+
+u32int apic_current_id(void)
+{
+	return apic_read(APIC_REG_ID) >> 24;
+}
+
+volatile u32int* apic_id_register(void)
+{
+	return &apic_registers[APIC_REG_ID / 4];
+}
+
+/**
+  *  Routes an I/O APIC input above the ISA range (PCI or HPET interrupts)
+  *  straight to a vector, unmasked, edge triggered and active high.
+  *
+  *  @return 1 if the input exists
+  */
+u32int apic_route_gsi(u32int gsi, u32int vector)
+{
+	if (!apic_in_use || gsi < PIC_IRQ_COUNT || gsi > ioapic_max_entry) {
+		return 0;
+	}
+	ioapic_write_redirect(gsi, vector);
+	return 1;
+}
+
+u32int apic_enabled(void)
+{
+	return apic_in_use;
+}
+
+/**
+  *  Signals end of interrupt to the local APIC.
+  */
+void apic_acknowledge(void)
+{
+	apic_write(APIC_REG_EOI, 0);
+}
+
+u16int apic_get_mask(void)
+{
+	return apic_mask;
+}
+
+/**
+  *  Masks/unmasks ISA IRQs at the I/O APIC. Only entries whose bit changed
+  *  are rewritten.
+  *
+  *  @param mask Bit n set masks IRQ n
+  */
+void apic_set_mask(u16int mask)
+{
+	u16int changed = apic_mask ^ mask;
+	u32int irq;
+
+	for (irq = 0; changed; irq++, changed >>= 1) {
+		if (changed & 1) {
+			ioapic_route_irq(irq, (mask >> irq) & 1);
+		}
+	}
+	apic_mask = mask;
+}
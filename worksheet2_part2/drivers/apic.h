@@ -0,0 +1,76 @@
+#ifndef INCLUDE_APIC_H
+#define INCLUDE_APIC_H
+
+#include "type.h"
+
+/* IA32_APIC_BASE model specific register */
+#define APIC_BASE_MSR		0x1B
+#define APIC_BASE_ENABLE	0x800
+#define APIC_BASE_ADDRESS_MASK	0xFFFFF000
+
+/* Local APIC register offsets */
+#define APIC_REG_ID		0x020
+#define APIC_REG_VERSION	0x030
+#define APIC_REG_TPR		0x080
+#define APIC_REG_EOI		0x0B0
+#define APIC_REG_SPURIOUS	0x0F0
+#define APIC_REG_ICR_LOW	0x300	/* writing it sends the IPI */
+#define APIC_REG_ICR_HIGH	0x310	/* destination APIC ID in bits 24..31 */
+
+#define APIC_SPURIOUS_ENABLE	0x100
+#define APIC_SPURIOUS_VECTOR	0xFF
+
+/* Interrupt command register: delivery mode, status and level */
+#define APIC_ICR_FIXED		0x000	/* | vector */
+#define APIC_ICR_INIT		0x500
+#define APIC_ICR_STARTUP	0x600	/* | physical page of the start-up code */
+#define APIC_ICR_PENDING	0x1000
+#define APIC_ICR_ASSERT		0x4000
+#define APIC_ICR_LEVEL		0x8000
+
+/* I/O APIC, at its conventional address until ACPI tells us otherwise */
+#define IOAPIC_DEFAULT_BASE	0xFEC00000
+#define IOAPIC_REGSEL		0x00
+#define IOAPIC_WINDOW		0x10
+#define IOAPIC_REG_VERSION	0x01
+#define IOAPIC_REG_REDTBL	0x10
+
+#define IOAPIC_REDIRECT_ACTIVE_LOW	0x2000
+#define IOAPIC_REDIRECT_LEVEL	0x8000
+#define IOAPIC_REDIRECT_MASKED	0x10000
+
+/** apic_init:
+ *  Detects the local APIC and I/O APIC, enables them and routes the 16 ISA
+ *  IRQs (all masked) to vectors offset..offset+15.
+ *
+ *  @param offset The vector of ISA IRQ 0
+ *  @return 1 if the APIC is now handling interrupts, 0 if the caller must
+ *          keep using the 8259 PIC
+ */
+u32int apic_init(u32int offset);
+
+/** apic_init_cpu:
+ *  Enables the local APIC of an application processor. The I/O APIC and
+ *  the register mapping were set up by apic_init() on the boot CPU.
+ */
+void apic_init_cpu(void);
+
+/** apic_send_ipi:
+ *  Sends an inter-processor interrupt, e.g. APIC_ICR_FIXED | vector, to
+ *  the CPU with the given APIC ID.
+ */
+void apic_send_ipi(u32int apic_id, u32int command);
+
+/** apic_current_id / apic_id_register:
+ *  The APIC ID of the calling CPU, and where each CPU reads its own.
+ */
+u32int apic_current_id(void);
+volatile u32int* apic_id_register(void);
+
+u32int apic_route_gsi(u32int gsi, u32int vector);
+u32int apic_enabled(void);
+void apic_acknowledge(void);
+u16int apic_get_mask(void);
+void apic_set_mask(u16int mask);
+
+#endif /* INCLUDE_APIC_H */
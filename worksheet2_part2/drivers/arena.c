@@ -0,0 +1,183 @@
+#include "arena.h"
+
+#define ARENA_ROUND(size)	(((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static u32int arena_string_length(const char* string)
+{
+	u32int length = 0;
+
+	while (string[length]) {
+		length++;
+	}
+	return length;
+}
+
+void arena_init(struct arena* arena, void* buffer, u32int size)
+{
+	arena->base = buffer;
+	arena->size = size;
+	arena->used = 0;
+	arena->last = 0;
+	arena->high_water = 0;
+	arena->failures = 0;
+}
+
+/* Moves the top of the arena to offset end, if it fits */
+static u32int arena_set_top(struct arena* arena, u32int end)
+{
+	u32int used = ARENA_ROUND(end);
+
+	if (end > arena->size || used > arena->size) {
+		arena->failures++;
+		return 0;
+	}
+
+	arena->used = used;
+	if (used > arena->high_water) {
+		arena->high_water = used;
+	}
+	return 1;
+}
+
+void* arena_alloc(struct arena* arena, u32int size)
+{
+	u8int* pointer = arena->base + arena->used;
+
+	if (size > arena->size - arena->used) {
+		arena->failures++;
+		return 0;
+	}
+	if (!arena_set_top(arena, arena->used + size)) {
+		return 0;
+	}
+
+	arena->last = pointer;
+	return pointer;
+}
+
+void arena_reset(struct arena* arena)
+{
+	arena->used = 0;
+	arena->last = 0;
+}
+
+char* arena_strndup(struct arena* arena, const char* string, u32int length)
+{
+	char* copy = arena_alloc(arena, length + 1);
+	u32int i;
+
+	if (copy) {
+		for (i = 0; i < length; i++) {
+			copy[i] = string[i];
+		}
+		copy[length] = '\0';
+	}
+	return copy;
+}
+
+char* arena_strdup(struct arena* arena, const char* string)
+{
+	return arena_strndup(arena, string, arena_string_length(string));
+}
+
+char* arena_append(struct arena* arena, char* string, const char* tail)
+{
+	u32int length;
+	u32int tail_length = arena_string_length(tail);
+	u32int i;
+	char* result;
+
+	if (!string) {
+		return 0; // An earlier append failed: the whole string fails
+	}
+
+	length = arena_string_length(string);
+	if ((u8int*) string == arena->last) {
+		// Newest allocation: just move the top
+		if (!arena_set_top(arena, (u32int) (arena->last - arena->base) + length + tail_length + 1)) {
+			return 0;
+		}
+		result = string;
+	} else {
+		result = arena_alloc(arena, length + tail_length + 1);
+		if (!result) {
+			return 0;
+		}
+		for (i = 0; i < length; i++) {
+			result[i] = string[i];
+		}
+	}
+
+	for (i = 0; i <= tail_length; i++) {
+		result[length + i] = tail[i];
+	}
+	return result;
+}
+
+char* arena_append_u32(struct arena* arena, char* string, u32int value, u32int digits)
+{
+	char buffer[11];
+	u32int position = sizeof(buffer) - 1;
+
+	if (digits > sizeof(buffer) - 1) {
+		digits = sizeof(buffer) - 1;
+	}
+
+	buffer[position] = '\0';
+	do {
+		buffer[--position] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (sizeof(buffer) - 1 - position < digits) {
+		buffer[--position] = '0';
+	}
+
+	return arena_append(arena, string, &buffer[position]);
+}
+
+u32int arena_split(struct arena* arena, const char* line, char*** words)
+{
+	const char* word;
+	u32int count = 0;
+	u32int length;
+	char** array;
+
+	for (word = line; *word; ) {
+		while (*word == ' ') {
+			word++;
+		}
+		if (*word) {
+			count++;
+		}
+		while (*word && *word != ' ') {
+			word++;
+		}
+	}
+
+	array = arena_alloc(arena, (count + 1) * sizeof(char*));
+	if (!array) {
+		*words = 0;
+		return 0;
+	}
+
+	count = 0;
+	for (word = line; *word; word += length) {
+		while (*word == ' ') {
+			word++;
+		}
+		for (length = 0; word[length] && word[length] != ' '; length++) {
+		}
+		if (length) {
+			array[count] = arena_strndup(arena, word, length);
+			if (!array[count]) {
+				*words = 0;
+				return 0;
+			}
+			count++;
+		}
+	}
+	array[count] = 0;
+
+	*words = array;
+	return count;
+}
@@ -0,0 +1,64 @@
+#ifndef INCLUDE_ARENA_H
+#define INCLUDE_ARENA_H
+
+#include "type.h"
+
+/*
+    Arena (bump pointer) allocator over a caller supplied buffer. Objects
+    are never freed one by one: the whole arena is reset at once, so it
+    suits data that lives exactly as long as some piece of work, such as
+    one shell command.
+
+    A string being built with arena_append() grows in place while it is
+    the newest allocation, so appending to a line costs a copy of the tail
+    only.
+*/
+#define ARENA_ALIGN		8
+
+struct arena {
+	u8int* base;
+	u32int size;
+	u32int used;
+	u8int* last;		/* newest allocation, for in place growth */
+	u32int high_water;
+	u32int failures;
+};
+
+void arena_init(struct arena* arena, void* buffer, u32int size);
+
+/** arena_alloc:
+ *  @return size bytes aligned to ARENA_ALIGN, or 0 when the arena is full
+ */
+void* arena_alloc(struct arena* arena, u32int size);
+
+/** arena_reset:
+ *  Releases everything allocated from the arena, in constant time.
+ */
+void arena_reset(struct arena* arena);
+
+char* arena_strdup(struct arena* arena, const char* string);
+char* arena_strndup(struct arena* arena, const char* string, u32int length);
+
+/** arena_append:
+ *  Appends tail to string and returns the result, or 0 when the arena is
+ *  full. string must have come from the same arena; start one with
+ *  arena_strdup(). A string of 0 gives 0, so a chain of appends fails as
+ *  a whole once any of them does and only the end result needs checking.
+ */
+char* arena_append(struct arena* arena, char* string, const char* tail);
+
+/** arena_append_u32:
+ *  Appends value in decimal, zero padded to at least digits characters.
+ */
+char* arena_append_u32(struct arena* arena, char* string, u32int value, u32int digits);
+
+/** arena_split:
+ *  Splits line into words separated by spaces, copied into the arena.
+ *  *words points at an array of the words, ended by 0, or is 0 when they
+ *  do not all fit.
+ *
+ *  @return the number of words
+ */
+u32int arena_split(struct arena* arena, const char* line, char*** words);
+
+#endif /* INCLUDE_ARENA_H */
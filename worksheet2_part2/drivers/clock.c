@@ -0,0 +1,170 @@
+#include "clock.h"
+#include "cpu.h"
+#include "io.h"
+#include "pit.h"
+#include "hpet.h"
+#include "framebuffer.h"
+#include "init.h"
+
+/*
+    TSC clock
+	From: http://wiki.osdev.org/TSC
+	Calibration gates PIT channel 2 for CLOCK_CALIBRATE_MS in one-shot mode
+	and counts TSC cycles until its output goes high, or watches the HPET
+	main counter instead when there is one. The shortest of a few runs is
+	kept, since anything that disturbs a run only makes it longer.
+
+	clock_ns() reads the TSC when it is invariant. A TSC that may change
+	rate or stop in idle is only trusted when there is no HPET to read
+	instead; the HPET costs an uncached MMIO read but never drifts.
+*/
+
+#define CPUID_EXTENDED_MAX	0x80000000
+#define CPUID_POWER_MANAGEMENT	0x80000007
+#define CPUID_INVARIANT_TSC	(1 << 8)
+
+static u32int clock_source = CLOCK_SOURCE_PIT;
+static u32int clock_have_tsc = 0;
+static u32int clock_invariant = 0;
+static u32int clock_khz = 0;
+static u32int clock_mult = 0;
+static u64int clock_base = 0;
+
+static u64int clock_calibrate_hpet(void)
+{
+	// 1 ms is 10^12 fs
+	u64int window = cpu_div_u64((u64int) CLOCK_CALIBRATE_MS * 1000000000000ULL, hpet_period_fs(), 0);
+	u64int begin = hpet_counter();
+	u64int start, end;
+
+	start = cpu_read_tsc();
+	while (hpet_counter() - begin < window) {
+		// Wait for the window to pass
+	}
+	end = cpu_read_tsc();
+
+	return end - start;
+}
+
+static u64int clock_calibrate_run(void)
+{
+	u32int latch = PIT_FREQUENCY / (1000 / CLOCK_CALIBRATE_MS);
+	u64int start, end;
+
+	// Gate high, speaker off
+	outb(PIT_CHANNEL_2_GATE, (inb(PIT_CHANNEL_2_GATE) & ~0x02) | 0x01);
+
+	outb(PIT_COMMAND, PIT_CMD_CHANNEL_2_ONESHOT);
+	outb(PIT_CHANNEL_2_DATA, latch & 0xFF);
+	outb(PIT_CHANNEL_2_DATA, (latch >> 8) & 0xFF);
+
+	start = cpu_read_tsc();
+	while (!(inb(PIT_CHANNEL_2_GATE) & 0x20)) {
+		// Wait for OUT2 to go high
+	}
+	end = cpu_read_tsc();
+
+	return end - start;
+}
+
+void __init clock_init(void)
+{
+	u32int eax, ebx, ecx, edx;
+	u64int best = 0;
+	u64int run;
+	u32int i;
+
+	clock_have_tsc = cpu_has_feature(CPU_FEATURE_TSC);
+	if (!clock_have_tsc) {
+		if (hpet_present()) {
+			clock_source = CLOCK_SOURCE_HPET;
+			clock_base = hpet_ns();
+		}
+		return;
+	}
+
+	cpu_cpuid(CPUID_EXTENDED_MAX, &eax, &ebx, &ecx, &edx);
+	if (eax >= CPUID_POWER_MANAGEMENT) {
+		cpu_cpuid(CPUID_POWER_MANAGEMENT, &eax, &ebx, &ecx, &edx);
+		clock_invariant = (edx & CPUID_INVARIANT_TSC) != 0;
+	}
+
+	for (i = 0; i < CLOCK_CALIBRATE_RUNS; i++) {
+		run = hpet_present() ? clock_calibrate_hpet() : clock_calibrate_run();
+		if (best == 0 || run < best) {
+			best = run;
+		}
+	}
+
+	clock_khz = (u32int) cpu_div_u64(best, CLOCK_CALIBRATE_MS, 0);
+	// ns = cycles * 10^6 / kHz, as a fixed point multiplier
+	clock_mult = (u32int) cpu_div_u64((u64int) 1000000 << CLOCK_SHIFT, clock_khz, 0);
+
+	if (!clock_invariant && hpet_present()) {
+		clock_source = CLOCK_SOURCE_HPET;
+		clock_base = hpet_ns();
+	} else {
+		clock_source = CLOCK_SOURCE_TSC;
+		clock_base = cpu_read_tsc();
+	}
+}
+
+u64int cycles(void)
+{
+	return clock_have_tsc ? cpu_read_tsc() : 0;
+}
+
+u64int cycles_to_ns(u64int count)
+{
+	return cpu_mul_shift_u64(count, clock_mult, CLOCK_SHIFT);
+}
+
+u64int clock_ns(void)
+{
+	switch (clock_source) {
+	case CLOCK_SOURCE_TSC:
+		return cycles_to_ns(cpu_read_tsc() - clock_base);
+	case CLOCK_SOURCE_HPET:
+		return hpet_ns() - clock_base;
+	default:
+		return pit_ticks() * (1000000000 / pit_hz());
+	}
+}
+
+u32int clock_tsc_khz(void)
+{
+	return clock_khz;
+}
+
+u32int clock_tsc_invariant(void)
+{
+	return clock_invariant;
+}
+
+u32int clock_current_source(void)
+{
+	return clock_source;
+}
+
+void clock_print_info(void)
+{
+	static char* names[] = {"PIT ticks", "TSC", "HPET"};
+
+	fb_write_string("clock: ", FB_WHITE, FB_BLACK);
+	fb_write_string(names[clock_source], FB_WHITE, FB_BLACK);
+	fb_newline();
+	if (clock_mult) {
+		fb_write_string("TSC: ", FB_WHITE, FB_BLACK);
+		fb_write_number(clock_khz / 1000, FB_WHITE, FB_BLACK);
+		fb_write_string(" MHz", FB_WHITE, FB_BLACK);
+		fb_write_string(clock_invariant ? " (invariant)\n" : " (not invariant)\n", FB_WHITE, FB_BLACK);
+	}
+	if (hpet_present()) {
+		fb_write_string("HPET: ", FB_WHITE, FB_BLACK);
+		fb_write_number((u32int) cpu_div_u64(1000000000000000ULL, hpet_period_fs(), 0), FB_WHITE, FB_BLACK);
+		fb_write_string(" Hz\n", FB_WHITE, FB_BLACK);
+	}
+	fb_write_string("now: ", FB_WHITE, FB_BLACK);
+	fb_write_number64(clock_ns(), FB_WHITE, FB_BLACK);
+	fb_write_string(" ns\n", FB_WHITE, FB_BLACK);
+}
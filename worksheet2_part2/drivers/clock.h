@@ -0,0 +1,52 @@
+#ifndef INCLUDE_CLOCK_H
+#define INCLUDE_CLOCK_H
+
+#include "type.h"
+
+/*
+    Fine-grained time. The TSC is calibrated against the HPET (or PIT
+    channel 2) at boot and converted with a multiply and a shift, so
+    clock_ns() costs an rdtsc and a couple of multiplications. If the TSC
+    is not invariant the HPET counter is used instead, and without either
+    everything falls back to the (much coarser) PIT tick.
+*/
+#define CLOCK_CALIBRATE_MS	10
+#define CLOCK_CALIBRATE_RUNS	3
+#define CLOCK_SHIFT		24
+
+/* What clock_ns() reads */
+#define CLOCK_SOURCE_PIT	0
+#define CLOCK_SOURCE_TSC	1
+#define CLOCK_SOURCE_HPET	2
+
+/** clock_init:
+ *  Calibrates the TSC and picks the clock source. Must run with interrupts
+ *  disabled, after hpet_init() and before anything uses clock_ns().
+ */
+void clock_init(void);
+
+/** cycles:
+ *  Returns the raw cycle counter (0 if the CPU has no TSC).
+ */
+u64int cycles(void);
+
+/** cycles_to_ns:
+ *  Converts a cycle count (e.g. a difference of two cycles() values) to ns.
+ */
+u64int cycles_to_ns(u64int count);
+
+/** clock_ns:
+ *  Returns nanoseconds since clock_init().
+ */
+u64int clock_ns(void);
+
+u32int clock_current_source(void);
+u32int clock_tsc_khz(void);
+u32int clock_tsc_invariant(void);
+
+/** clock_print_info:
+ *  Prints the clock source, its frequency and the current time.
+ */
+void clock_print_info(void);
+
+#endif /* INCLUDE_CLOCK_H */
@@ -0,0 +1,195 @@
+#include "cpu.h"
+
+/*
+    Processor helpers shared by the drivers.
+*/
+
+/* 0 until smp_init(): only the boot CPU runs */
+volatile u32int* cpu_apic_id_register = 0;
+u8int cpu_index_by_apic_id[CPU_APIC_IDS];
+
+u32int cpu_current_id(void)
+{
+	if (!cpu_apic_id_register) {
+		return 0;
+	}
+	return cpu_index_by_apic_id[*cpu_apic_id_register >> 24];
+}
+
+void cpu_set_index(u32int apic_id, u32int index)
+{
+	cpu_index_by_apic_id[apic_id & (CPU_APIC_IDS - 1)] = index;
+}
+
+void cpu_use_apic_ids(volatile u32int* id_register)
+{
+	cpu_apic_id_register = id_register;
+}
+
+void cpu_cpuid(u32int leaf, u32int* eax, u32int* ebx, u32int* ecx, u32int* edx)
+{
+	asm volatile("cpuid"
+		: "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+		: "a" (leaf), "c" (0));
+}
+
+u32int cpu_has_feature(u32int feature)
+{
+	u32int eax, ebx, ecx, edx;
+
+	cpu_cpuid(1, &eax, &ebx, &ecx, &edx);
+	return (edx & feature) != 0;
+}
+
+u64int cpu_read_tsc(void)
+{
+	u32int low, high;
+
+	asm volatile("rdtsc" : "=a" (low), "=d" (high));
+	return ((u64int) high << 32) | low;
+}
+
+u64int cpu_div_u64(u64int dividend, u32int divisor, u32int* remainder)
+{
+	u32int high = (u32int) (dividend >> 32);
+	u32int low = (u32int) dividend;
+	u32int quotient_high = high / divisor;
+	u32int quotient_low;
+	u32int rest;
+
+	// With the high word reduced below the divisor, divl cannot overflow
+	high %= divisor;
+	asm("divl %4" : "=a" (quotient_low), "=d" (rest) : "a" (low), "d" (high), "rm" (divisor));
+
+	if (remainder) {
+		*remainder = rest;
+	}
+	return ((u64int) quotient_high << 32) | quotient_low;
+}
+
+u64int cpu_mul_shift_u64(u64int value, u32int mult, u32int shift)
+{
+	u32int low = (u32int) value;
+	u32int high = (u32int) (value >> 32);
+
+	// 96-bit product shifted right, split so every step fits in 64 bits
+	return (((u64int) high * mult) << (32 - shift)) +
+		(((u64int) low * mult) >> shift);
+}
+
+u32int cpu_read_cr0(void)
+{
+	u32int value;
+
+	asm volatile("mov %%cr0, %0" : "=r" (value));
+	return value;
+}
+
+void cpu_write_cr0(u32int value)
+{
+	asm volatile("mov %0, %%cr0" : : "r" (value) : "memory");
+}
+
+u32int cpu_read_cr2(void)
+{
+	u32int value;
+
+	asm volatile("mov %%cr2, %0" : "=r" (value));
+	return value;
+}
+
+u32int cpu_read_cr3(void)
+{
+	u32int value;
+
+	asm volatile("mov %%cr3, %0" : "=r" (value));
+	return value;
+}
+
+void cpu_write_cr3(u32int value)
+{
+	asm volatile("mov %0, %%cr3" : : "r" (value) : "memory");
+}
+
+u32int cpu_read_cr4(void)
+{
+	u32int value;
+
+	asm volatile("mov %%cr4, %0" : "=r" (value));
+	return value;
+}
+
+void cpu_write_cr4(u32int value)
+{
+	asm volatile("mov %0, %%cr4" : : "r" (value) : "memory");
+}
+
+void cpu_invlpg(u32int address)
+{
+	asm volatile("invlpg (%0)" : : "r" (address) : "memory");
+}
+
+u32int cpu_enable_sse(void)
+{
+	if (!cpu_has_feature(CPU_FEATURE_SSE2) || !cpu_has_feature(CPU_FEATURE_FXSR)) {
+		return 0;
+	}
+	if (!(cpu_read_cr4() & CPU_CR4_OSFXSR)) {
+		cpu_write_cr0((cpu_read_cr0() & ~CPU_CR0_EM) | CPU_CR0_MP);
+		cpu_write_cr4(cpu_read_cr4() | CPU_CR4_OSFXSR | CPU_CR4_OSXMMEXCPT);
+	}
+	return 1;
+}
+
+void cpu_zero_page(void* page)
+{
+	u32int count = 4096 / 4;
+
+	asm volatile("cld; rep stosl" : "+D" (page), "+c" (count) : "a" (0) : "memory");
+}
+
+void cpu_zero_page_nocache(void* page)
+{
+	u32int count = 4096 / 16;
+
+	asm volatile("1: movnti %%eax, (%0)\n\t"
+		     "movnti %%eax, 4(%0)\n\t"
+		     "movnti %%eax, 8(%0)\n\t"
+		     "movnti %%eax, 12(%0)\n\t"
+		     "add $16, %0\n\t"
+		     "dec %1\n\t"
+		     "jnz 1b\n\t"
+		     "sfence"
+		     : "+r" (page), "+r" (count) : "a" (0) : "memory");
+}
+
+void cpu_copy_page(void* destination, const void* source)
+{
+	u32int count = 4096 / 4;
+
+	asm volatile("cld; rep movsl" : "+D" (destination), "+S" (source), "+c" (count) : : "memory");
+}
+
+/**
+  *  Reads a model specific register.
+  *
+  *  @param msr The MSR index
+  */
+u64int cpu_read_msr(u32int msr)
+{
+	u32int low, high;
+
+	asm volatile("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+	return ((u64int) high << 32) | low;
+}
+
+/**
+  *  Writes a model specific register.
+  *
+  *  @param msr   The MSR index
+  *  @param value The 64-bit value, written as EDX:EAX
+  */
+void cpu_write_msr(u32int msr, u64int value)
+{
+	asm volatile("wrmsr" : : "c" (msr), "a" ((u32int) value), "d" ((u32int) (value >> 32)));
+}
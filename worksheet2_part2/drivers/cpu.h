@@ -0,0 +1,120 @@
+#ifndef INCLUDE_CPU_H
+#define INCLUDE_CPU_H
+
+#include "type.h"
+
+/* Upper bound on the CPUs the kernel keeps per-CPU state for */
+#define CPU_MAX 8
+
+/* CPUID leaf 1 EDX feature bits */
+#define CPU_FEATURE_PSE		(1 << 3)
+#define CPU_FEATURE_TSC		(1 << 4)
+#define CPU_FEATURE_MSR		(1 << 5)
+#define CPU_FEATURE_APIC	(1 << 9)
+#define CPU_FEATURE_SEP		(1 << 11)
+#define CPU_FEATURE_PGE		(1 << 13)
+#define CPU_FEATURE_FXSR	(1 << 24)
+#define CPU_FEATURE_SSE		(1 << 25)
+#define CPU_FEATURE_SSE2	(1 << 26)
+
+/* Control register bits */
+#define CPU_CR0_MP		(1 << 1)
+#define CPU_CR0_EM		(1 << 2)	/* x87/SSE instructions trap */
+#define CPU_CR0_WP		(1 << 16)	/* honour read-only pages in ring 0 */
+#define CPU_CR0_PG		(1 << 31)
+#define CPU_CR4_PSE		(1 << 4)
+#define CPU_CR4_PGE		(1 << 7)
+#define CPU_CR4_OSFXSR		(1 << 9)	/* SSE instructions allowed */
+#define CPU_CR4_OSXMMEXCPT	(1 << 10)
+
+/* xAPIC IDs are 8 bits wide */
+#define CPU_APIC_IDS 256
+
+/** cpu_current_id:
+ *  Returns the index of the CPU executing the caller, in 0..CPU_MAX-1:
+ *  0 for the boot CPU, whose index is all there is until smp_init().
+ */
+u32int cpu_current_id(void);
+
+/** cpu_set_index:
+ *  Gives the CPU with an APIC ID its index; smp_init() does this for
+ *  every CPU before it starts running.
+ */
+void cpu_set_index(u32int apic_id, u32int index);
+
+/** cpu_use_apic_ids:
+ *  From now on, tell CPUs apart by the APIC ID register each one reads at
+ *  the same address.
+ */
+void cpu_use_apic_ids(volatile u32int* id_register);
+
+/* Used by common_interrupt_handler to find the CPU's interrupt stack */
+extern volatile u32int* cpu_apic_id_register;
+extern u8int cpu_index_by_apic_id[CPU_APIC_IDS];
+
+/** cpu_cpuid:
+ *  Executes CPUID for the given leaf (sub-leaf 0).
+ */
+void cpu_cpuid(u32int leaf, u32int* eax, u32int* ebx, u32int* ecx, u32int* edx);
+
+/** cpu_has_feature:
+ *  Checks CPUID leaf 1 EDX for one of the CPU_FEATURE_* bits.
+ */
+u32int cpu_has_feature(u32int feature);
+
+/** cpu_read_tsc:
+ *  Returns the time stamp counter. Check CPU_FEATURE_TSC first.
+ */
+u64int cpu_read_tsc(void);
+
+/** cpu_div_u64:
+ *  Divides a 64-bit value by a 32-bit one without needing libgcc.
+ *
+ *  @param remainder Receives the remainder if not null
+ */
+u64int cpu_div_u64(u64int dividend, u32int divisor, u32int* remainder);
+
+/** cpu_mul_shift_u64:
+ *  Returns (value * mult) >> shift with the full 96-bit intermediate, the
+ *  usual way of scaling a counter by a fixed point factor. shift <= 32.
+ */
+u64int cpu_mul_shift_u64(u64int value, u32int mult, u32int shift);
+
+u32int cpu_read_cr0(void);
+void cpu_write_cr0(u32int value);
+u32int cpu_read_cr2(void);
+u32int cpu_read_cr3(void);
+void cpu_write_cr3(u32int value);
+u32int cpu_read_cr4(void);
+void cpu_write_cr4(u32int value);
+
+/** cpu_invlpg:
+ *  Drops the TLB entry for one virtual address on this CPU.
+ */
+void cpu_invlpg(u32int address);
+
+/** cpu_enable_sse:
+ *  Turns on SSE instructions if the CPU has SSE2. Nothing saves the XMM
+ *  registers yet, so only code that cannot be interrupted by other XMM
+ *  users (interrupt handlers never touch them) may use them.
+ *
+ *  @return 1 if SSE2 instructions can be used
+ */
+u32int cpu_enable_sse(void);
+
+/** cpu_zero_page / cpu_copy_page:
+ *  Fill or copy one 4 KiB page, both addresses page aligned.
+ */
+void cpu_zero_page(void* page);
+void cpu_copy_page(void* destination, const void* source);
+
+/** cpu_zero_page_nocache:
+ *  Zeroes a page with non-temporal stores, leaving the caches alone.
+ *  Needs SSE2 (CPU_FEATURE_SSE2).
+ */
+void cpu_zero_page_nocache(void* page);
+
+u64int cpu_read_msr(u32int msr);
+void cpu_write_msr(u32int msr, u64int value);
+
+#endif /* INCLUDE_CPU_H */
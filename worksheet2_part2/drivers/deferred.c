@@ -0,0 +1,55 @@
+#include "deferred.h"
+#include "cpu.h"
+#include "hardware_interrupt_enabler.h"
+
+struct deferred_cpu_state {
+	volatile u32int pending;
+	u32int running;
+};
+
+static void (*deferred_handlers[DEFERRED_COUNT])(void);
+static struct deferred_cpu_state deferred_cpu[CPU_MAX];
+
+void deferred_register(u32int work, void (*handler)(void))
+{
+	deferred_handlers[work] = handler;
+}
+
+void deferred_raise(u32int work)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	deferred_cpu[cpu_current_id()].pending |= 1 << work;
+	restore_hardware_interrupts(flags);
+}
+
+void deferred_run(void)
+{
+	struct deferred_cpu_state* cpu_state = &deferred_cpu[cpu_current_id()];
+	u32int flags;
+	u32int pending;
+	u32int work;
+
+	if (cpu_state->running) {
+		return;
+	}
+
+	flags = save_and_disable_hardware_interrupts();
+	cpu_state->running = 1;
+
+	while ((pending = cpu_state->pending) != 0) {
+		cpu_state->pending = 0;
+		enable_hardware_interrupts();
+
+		for (work = 0; work < DEFERRED_COUNT; work++) {
+			if ((pending & (1 << work)) && deferred_handlers[work]) {
+				deferred_handlers[work]();
+			}
+		}
+
+		disable_hardware_interrupts();
+	}
+
+	cpu_state->running = 0;
+	restore_hardware_interrupts(flags);
+}
@@ -0,0 +1,28 @@
+#ifndef INCLUDE_DEFERRED_H
+#define INCLUDE_DEFERRED_H
+
+#include "type.h"
+
+/*
+    Deferred work: interrupt handlers raise a work bit and the matching
+    handler runs once the outermost interrupt is about to return, with
+    interrupts enabled. Handlers never run nested inside each other on the
+    same CPU.
+*/
+#define DEFERRED_TIMERS		0
+#define DEFERRED_COUNT		8
+
+void deferred_register(u32int work, void (*handler)(void));
+
+/** deferred_raise:
+ *  Marks work as pending on the calling CPU. Safe from interrupt context.
+ */
+void deferred_raise(u32int work);
+
+/** deferred_run:
+ *  Runs all pending work on the calling CPU. Called on the way out of the
+ *  outermost interrupt handler; returns at once if already running.
+ */
+void deferred_run(void);
+
+#endif /* INCLUDE_DEFERRED_H */
@@ -0,0 +1,163 @@
+#include "event.h"
+#include "input.h"
+#include "thread.h"
+#include "framebuffer.h"
+#include "hardware_interrupt_enabler.h"
+#include "spinlock.h"
+
+#define EVENT_QUEUE_MASK	(EVENT_QUEUE_SIZE - 1)
+
+struct event_source_stats {
+	u32int posted;
+	u32int dropped;
+	u32int handled;
+	u32int last_handled;	/* at the previous rate sample */
+	u32int rate;		/* events handled per second */
+};
+
+/* Interrupt handlers and other CPUs post; the loop on the boot CPU takes */
+static struct spinlock event_lock = SPINLOCK_INIT("event queue");
+static struct event event_queue[EVENT_QUEUE_SIZE];
+static u32int event_head = 0;	/* next to take */
+static u32int event_count = 0;
+static u32int event_max_depth = 0;
+static u32int event_idle_waits = 0;
+static struct event_source_stats event_stats[EVENT_SOURCES];
+static struct event_timer event_stats_timer;
+
+static const char* event_source_names[EVENT_SOURCES] = { "input", "timer", "work" };
+
+u32int event_post(u32int source, void (*handler)(void* data), void* data)
+{
+	u32int flags = spin_lock_irqsave(&event_lock);
+	struct event* event;
+
+	event_stats[source].posted++;
+	if (event_count == EVENT_QUEUE_SIZE) {
+		event_stats[source].dropped++;
+		spin_unlock_irqrestore(&event_lock, flags);
+		return 0;
+	}
+
+	event = &event_queue[(event_head + event_count) & EVENT_QUEUE_MASK];
+	event->handler = handler;
+	event->data = data;
+	event->source = source;
+	event_count++;
+	if (event_count > event_max_depth) {
+		event_max_depth = event_count;
+	}
+	spin_unlock_irqrestore(&event_lock, flags);
+	return 1;
+}
+
+/* Takes the oldest event off the queue; 0 if it is empty */
+static u32int event_take(struct event* event)
+{
+	u32int flags = spin_lock_irqsave(&event_lock);
+
+	if (event_count == 0) {
+		spin_unlock_irqrestore(&event_lock, flags);
+		return 0;
+	}
+	*event = event_queue[event_head];
+	event_head = (event_head + 1) & EVENT_QUEUE_MASK;
+	event_count--;
+	spin_unlock_irqrestore(&event_lock, flags);
+	return 1;
+}
+
+/* Timers ********************************************************************/
+
+/* Deferred context: hand the expiry over to the loop */
+static void event_timer_expired(void* data)
+{
+	struct event_timer* timer = data;
+
+	if (timer->period_ms) {
+		timer_add_ms(&timer->timer, timer->period_ms);
+	}
+	event_post(EVENT_SOURCE_TIMER, timer->handler, timer->data);
+}
+
+void event_timer_start(struct event_timer* timer, void (*handler)(void* data), void* data,
+		       u32int ms, u32int periodic)
+{
+	timer_setup(&timer->timer, event_timer_expired, timer);
+	timer->handler = handler;
+	timer->data = data;
+	timer->period_ms = periodic ? ms : 0;
+	timer_add_ms(&timer->timer, ms);
+}
+
+void event_timer_stop(struct event_timer* timer)
+{
+	timer->period_ms = 0;
+	timer_cancel(&timer->timer);
+}
+
+/* Loop **********************************************************************/
+
+static void event_sample_rates(void* data)
+{
+	u32int source;
+
+	(void) data;
+	for (source = 0; source < EVENT_SOURCES; source++) {
+		event_stats[source].rate = event_stats[source].handled - event_stats[source].last_handled;
+		event_stats[source].last_handled = event_stats[source].handled;
+	}
+}
+
+void event_loop(void)
+{
+	struct event event;
+
+	event_timer_start(&event_stats_timer, event_sample_rates, 0, EVENT_STATS_MS, 1);
+
+	for (;;) {
+		if (event_take(&event)) {
+			event_stats[event.source].handled++;
+			event.handler(event.data);
+			continue;
+		}
+
+		// Devices in polling mode need servicing instead of a wait
+		if (input_poll() != 0) {
+			continue;
+		}
+		disable_hardware_interrupts();
+		if (event_count == 0) {
+			event_idle_waits++;
+			thread_wait_interrupt();
+		}
+		enable_hardware_interrupts();
+	}
+}
+
+void event_print_stats(void)
+{
+	u32int source;
+
+	fb_write_string("Event queue: ", FB_WHITE, FB_BLACK);
+	fb_write_number(event_count, FB_WHITE, FB_BLACK);
+	fb_write_string(" queued, ", FB_WHITE, FB_BLACK);
+	fb_write_number(event_max_depth, FB_WHITE, FB_BLACK);
+	fb_write_string(" deepest of ", FB_WHITE, FB_BLACK);
+	fb_write_number(EVENT_QUEUE_SIZE, FB_WHITE, FB_BLACK);
+	fb_write_string(", ", FB_WHITE, FB_BLACK);
+	fb_write_number(event_idle_waits, FB_WHITE, FB_BLACK);
+	fb_write_string(" waits\n", FB_WHITE, FB_BLACK);
+
+	for (source = 0; source < EVENT_SOURCES; source++) {
+		fb_write_string("  ", FB_WHITE, FB_BLACK);
+		fb_write_string((char*) event_source_names[source], FB_WHITE, FB_BLACK);
+		fb_write_string(": ", FB_WHITE, FB_BLACK);
+		fb_write_number(event_stats[source].handled, FB_WHITE, FB_BLACK);
+		fb_write_string(" handled (", FB_WHITE, FB_BLACK);
+		fb_write_number(event_stats[source].rate, FB_WHITE, FB_BLACK);
+		fb_write_string("/s), ", FB_WHITE, FB_BLACK);
+		fb_write_number(event_stats[source].dropped, event_stats[source].dropped ? FB_LIGHT_RED : FB_WHITE, FB_BLACK);
+		fb_write_string(" dropped\n", FB_WHITE, FB_BLACK);
+	}
+}
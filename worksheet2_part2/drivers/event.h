@@ -0,0 +1,64 @@
+#ifndef INCLUDE_EVENT_H
+#define INCLUDE_EVENT_H
+
+#include "type.h"
+#include "timer.h"
+
+/*
+    Event loop. Interrupt handlers, timer callbacks and deferred work post
+    events (a handler and its data) to a fixed size queue; event_loop()
+    takes them off one at a time and runs the handlers in thread context,
+    sleeping until the next interrupt whenever the queue is empty. Handlers
+    are expected to return quickly, like the shell's, which handles one
+    burst of input per event instead of blocking for a whole line.
+
+    A full queue drops the event and counts it, so a source that must not
+    lose anything keeps its own data (the input ring, say) and only posts
+    a notification when none is pending.
+*/
+#define EVENT_QUEUE_SIZE	64	/* power of two */
+#define EVENT_STATS_MS		1000	/* rate sampling period */
+
+#define EVENT_SOURCE_INPUT	0
+#define EVENT_SOURCE_TIMER	1
+#define EVENT_SOURCE_WORK	2
+#define EVENT_SOURCES		3
+
+struct event {
+	void (*handler)(void* data);
+	void* data;
+	u32int source;
+};
+
+/* A timer whose expiry is handled in the event loop rather than deferred context */
+struct event_timer {
+	struct timer timer;
+	void (*handler)(void* data);
+	void* data;
+	u32int period_ms;	/* 0 for a one-shot timer */
+};
+
+/** event_post:
+ *  Queues handler(data). Safe from any context.
+ *
+ *  @return 0 if the queue was full and the event was dropped
+ */
+u32int event_post(u32int source, void (*handler)(void* data), void* data);
+
+/** event_timer_start:
+ *  Posts handler(data) after ms milliseconds, and every ms milliseconds
+ *  from then on if periodic is set.
+ */
+void event_timer_start(struct event_timer* timer, void (*handler)(void* data), void* data,
+		       u32int ms, u32int periodic);
+
+void event_timer_stop(struct event_timer* timer);
+
+/** event_loop:
+ *  Runs handlers as events arrive. Never returns.
+ */
+void event_loop(void);
+
+void event_print_stats(void);
+
+#endif /* INCLUDE_EVENT_H */
@@ -1,7 +1,10 @@
 #include "framebuffer.h"
+#include "cpu.h"
+#include "pmm.h"
+#include "spinlock.h"
 
-/* The framebuffer address */
-#define FB_ADDRESS 0x000B8000
+/* The framebuffer address (VGA text memory, through the direct map) */
+#define FB_ADDRESS (KERNEL_VIRTUAL_BASE + 0x000B8000)
 
 /* I/O port addresses for cursor control */
 #define FB_COMMAND_PORT         0x3D4
@@ -11,6 +14,10 @@
 #define FB_HIGH_BYTE_COMMAND    14
 #define FB_LOW_BYTE_COMMAND     15
 
+/* The cursor is moved by the shell, by interrupt handlers reporting
+   errors and by other CPUs; every function that moves it holds this */
+static struct spinlock fb_lock = SPINLOCK_INIT("framebuffer");
+
 /* Global variables for cursor position and color */
 static unsigned short cursor_x = 0;
 static unsigned short cursor_y = 0;
@@ -47,10 +54,14 @@ static void fb_move_cursor_internal(unsigned short pos)
  */
 void fb_move_cursor(unsigned short x, unsigned short y)
 {
+    u32int flags;
+
     if (x < FB_WIDTH && y < FB_HEIGHT) {
+        flags = spin_lock_irqsave(&fb_lock);
         cursor_x = x;
         cursor_y = y;
         fb_move_cursor_internal(y * FB_WIDTH + x);
+        spin_unlock_irqrestore(&fb_lock, flags);
     }
 }
 
@@ -60,7 +71,8 @@ void fb_move_cursor(unsigned short x, unsigned short y)
 void fb_write(char *buf, unsigned char fg, unsigned char bg)
 {
     unsigned int i = 0;
-    
+    u32int flags = spin_lock_irqsave(&fb_lock);
+
     while (buf[i] != '\0') {
         fb_write_cell((cursor_y * FB_WIDTH + cursor_x) * 2, buf[i], fg, bg);
         cursor_x++;
@@ -77,6 +89,7 @@ void fb_write(char *buf, unsigned char fg, unsigned char bg)
     
     /* Update hardware cursor */
     fb_move_cursor_internal(cursor_y * FB_WIDTH + cursor_x);
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 /**
@@ -85,7 +98,8 @@ void fb_write(char *buf, unsigned char fg, unsigned char bg)
 void fb_clear(unsigned char bg)
 {
     unsigned int i;
-    
+    u32int flags = spin_lock_irqsave(&fb_lock);
+
     for (i = 0; i < FB_WIDTH * FB_HEIGHT; i++) {
         fb_write_cell(i * 2, ' ', FB_BLACK, bg);
     }
@@ -93,6 +107,7 @@ void fb_clear(unsigned char bg)
     cursor_x = 0;
     cursor_y = 0;
     fb_move_cursor_internal(0);
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 /**
@@ -117,6 +132,8 @@ void fb_set_color(unsigned char fg, unsigned char bg)
  */
 void fb_write_char(char c, unsigned char fg, unsigned char bg)
 {
+    u32int flags = spin_lock_irqsave(&fb_lock);
+
     if (c == '\n') {
         cursor_x = 0;
         cursor_y++;
@@ -138,6 +155,7 @@ void fb_write_char(char c, unsigned char fg, unsigned char bg)
     
     /* Update hardware cursor */
     fb_move_cursor_internal(cursor_y * FB_WIDTH + cursor_x);
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 /**
@@ -173,6 +191,44 @@ void fb_write_number(unsigned int num, unsigned char fg, unsigned char bg)
     }
 }
 
+/**
+ * Write a 64-bit unsigned integer.
+ */
+void fb_write_number64(u64int num, unsigned char fg, unsigned char bg)
+{
+    char buffer[21];  /* Enough for 64-bit integer */
+    int i = 0;
+    u32int digit;
+
+    if (num == 0) {
+        fb_write_char('0', fg, bg);
+        return;
+    }
+
+    while (num > 0) {
+        num = cpu_div_u64(num, 10, &digit);
+        buffer[i++] = '0' + digit;
+    }
+
+    while (i > 0) {
+        fb_write_char(buffer[--i], fg, bg);
+    }
+}
+
+/**
+ * Write a 32-bit value as eight hex digits, prefixed with 0x.
+ */
+void fb_write_hex(u32int num, unsigned char fg, unsigned char bg)
+{
+    int shift;
+
+    fb_write_char('0', fg, bg);
+    fb_write_char('x', fg, bg);
+    for (shift = 28; shift >= 0; shift -= 4) {
+        fb_write_char("0123456789ABCDEF"[(num >> shift) & 0xF], fg, bg);
+    }
+}
+
 /**
  * Write a character with default colors (white on black)
  */
@@ -186,12 +242,15 @@ void fb_putchar(u8int c)
  */
 void fb_newline(void)
 {
+    u32int flags = spin_lock_irqsave(&fb_lock);
+
     cursor_x = 0;
     cursor_y++;
     if (cursor_y >= FB_HEIGHT) {
         cursor_y = 0;  /* Simple wrap-around */
     }
     fb_move_cursor_internal(cursor_y * FB_WIDTH + cursor_x);
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
 
 /**
@@ -199,6 +258,8 @@ void fb_newline(void)
  */
 void fb_backspace(void)
 {
+    u32int flags = spin_lock_irqsave(&fb_lock);
+
     if (cursor_x > 0) {
         cursor_x--;
         /* Clear the character at this position */
@@ -212,4 +273,5 @@ void fb_backspace(void)
         fb_write_cell((cursor_y * FB_WIDTH + cursor_x) * 2, ' ', FB_WHITE, FB_BLACK);
         fb_move_cursor_internal(cursor_y * FB_WIDTH + cursor_x);
     }
+    spin_unlock_irqrestore(&fb_lock, flags);
 }
@@ -50,6 +50,8 @@ void fb_clear(unsigned char bg);
 void fb_move(unsigned short pos_x, unsigned short pos_y);
 void fb_write_string(char *str, unsigned char fg, unsigned char bg);
 void fb_write_number(unsigned int num, unsigned char fg, unsigned char bg);
+void fb_write_number64(u64int num, unsigned char fg, unsigned char bg);
+void fb_write_hex(u32int num, unsigned char fg, unsigned char bg);
 void fb_putc(char c, unsigned char fg, unsigned char bg);
 void fb_write_cell(unsigned int i, char c, unsigned char fg, unsigned char bg);
 void fb_write_char(char c, unsigned char fg, unsigned char bg);
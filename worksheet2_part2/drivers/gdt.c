@@ -0,0 +1,59 @@
+#include "gdt.h"
+#include "init.h"
+
+/*
+    Global Descriptor Table
+	From: http://wiki.osdev.org/GDT_Tutorial
+	Flat 4 GiB code and data segments for ring 0 and ring 3, and one TSS so
+	interrupts and int 0x80 from ring 3 have a kernel stack to land on.
+*/
+
+#define GDT_ACCESS_KERNEL_CODE	0x9A	// present, ring 0, code, readable
+#define GDT_ACCESS_KERNEL_DATA	0x92	// present, ring 0, data, writable
+#define GDT_ACCESS_USER_CODE	0xFA	// present, ring 3, code, readable
+#define GDT_ACCESS_USER_DATA	0xF2	// present, ring 3, data, writable
+#define GDT_ACCESS_TSS		0x89	// present, ring 0, 32-bit available TSS
+#define GDT_FLAT_GRANULARITY	0xCF	// 4 KiB granularity, 32-bit, limit 0xF
+
+struct GDTDescriptor gdt_descriptors[GDT_ENTRY_COUNT];
+struct GDT gdt;
+struct TSS tss;
+
+static void gdt_init_descriptor(u32int index, u32int base, u32int limit, u8int access, u8int granularity)
+{
+	gdt_descriptors[index].base_low = base & 0xFFFF;
+	gdt_descriptors[index].base_middle = (base >> 16) & 0xFF;
+	gdt_descriptors[index].base_high = (base >> 24) & 0xFF;
+
+	gdt_descriptors[index].limit_low = limit & 0xFFFF;
+	gdt_descriptors[index].granularity = (granularity & 0xF0) | ((limit >> 16) & 0x0F);
+	gdt_descriptors[index].access = access;
+}
+
+void __init gdt_install(void)
+{
+	gdt_init_descriptor(0, 0, 0, 0, 0);
+	gdt_init_descriptor(GDT_KERNEL_CODE / 8, 0, 0xFFFFF, GDT_ACCESS_KERNEL_CODE, GDT_FLAT_GRANULARITY);
+	gdt_init_descriptor(GDT_KERNEL_DATA / 8, 0, 0xFFFFF, GDT_ACCESS_KERNEL_DATA, GDT_FLAT_GRANULARITY);
+	gdt_init_descriptor(GDT_USER_CODE / 8, 0, 0xFFFFF, GDT_ACCESS_USER_CODE, GDT_FLAT_GRANULARITY);
+	gdt_init_descriptor(GDT_USER_DATA / 8, 0, 0xFFFFF, GDT_ACCESS_USER_DATA, GDT_FLAT_GRANULARITY);
+
+	tss.ss0 = GDT_KERNEL_DATA;
+	tss.iomap_base = sizeof(struct TSS);	// no I/O permission bitmap
+	gdt_init_descriptor(GDT_TSS / 8, (u32int) &tss, sizeof(struct TSS) - 1, GDT_ACCESS_TSS, 0x00);
+
+	gdt.address = (u32int) &gdt_descriptors;
+	gdt.size = sizeof(struct GDTDescriptor) * GDT_ENTRY_COUNT - 1;
+	gdt_load((u32int) &gdt);
+	tss_load(GDT_TSS);
+}
+
+void gdt_install_cpu(void)
+{
+	gdt_load((u32int) &gdt);
+}
+
+void gdt_set_kernel_stack(u32int esp0)
+{
+	tss.esp0 = esp0;
+}
@@ -0,0 +1,64 @@
+#ifndef INCLUDE_GDT_H
+#define INCLUDE_GDT_H
+
+#include "type.h"
+
+/*
+    Segment selectors. The order is fixed by SYSENTER/SYSEXIT, which derive
+    the kernel SS and the user CS/SS from the kernel CS (+8, +16, +24).
+*/
+#define GDT_KERNEL_CODE		0x08
+#define GDT_KERNEL_DATA		0x10
+#define GDT_USER_CODE		0x18
+#define GDT_USER_DATA		0x20
+#define GDT_TSS			0x28
+#define GDT_RPL_USER		0x03
+
+#define GDT_ENTRY_COUNT		6
+
+struct GDT {
+	u16int size;
+	u32int address;
+} __attribute__((packed));
+
+struct GDTDescriptor {
+	u16int limit_low;	// limit bits 0..15
+	u16int base_low;	// base bits 0..15
+	u8int base_middle;	// base bits 16..23
+	u8int access;		// P, DPL, S, type
+	u8int granularity;	// G, D/B, limit bits 16..19
+	u8int base_high;	// base bits 24..31
+} __attribute__((packed));
+
+/* 32-bit Task State Segment; only the ring 0 stack fields are used */
+struct TSS {
+	u32int prev_tss;
+	u32int esp0;
+	u32int ss0;
+	u32int unused[22];
+	u16int trap;
+	u16int iomap_base;
+} __attribute__((packed));
+
+/** gdt_install:
+ *  Replaces the bootloader's GDT with flat kernel and user segments plus a
+ *  TSS, and reloads every segment register.
+ */
+void gdt_install(void);
+
+/** gdt_install_cpu:
+ *  Loads the same GDT on an application processor. The TSS is left out:
+ *  a TSS can only be loaded by one CPU, and APs never run ring 3 code.
+ */
+void gdt_install_cpu(void);
+
+/** gdt_set_kernel_stack:
+ *  Sets the stack the CPU switches to when ring 3 is interrupted.
+ */
+void gdt_set_kernel_stack(u32int esp0);
+
+// Wrappers around ASM.
+void gdt_load(u32int gdt_address);
+void tss_load(u32int selector);
+
+#endif /* INCLUDE_GDT_H */
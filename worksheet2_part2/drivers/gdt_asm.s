@@ -0,0 +1,32 @@
+global  gdt_load
+
+; gdt_load - Loads the global descriptor table (GDT) and reloads the segment
+;            registers from it (kernel code 0x08, kernel data 0x10).
+; stack: [esp + 4] the address of the GDT pointer
+;        [esp    ] the return address
+
+gdt_load:
+        mov     eax, [esp + 4]
+        lgdt    [eax]
+
+        mov     ax, 0x10                ; kernel data selector
+        mov     ds, ax
+        mov     es, ax
+        mov     fs, ax
+        mov     gs, ax
+        mov     ss, ax
+
+        jmp     0x08:.reload_cs         ; far jump to reload CS
+.reload_cs:
+        ret
+
+global  tss_load
+
+; tss_load - Loads the task register.
+; stack: [esp + 4] the TSS selector
+;        [esp    ] the return address
+
+tss_load:
+        mov     ax, [esp + 4]
+        ltr     ax
+        ret
@@ -1,9 +1,17 @@
 #ifndef INCLUDE_HARDWARE_INTERRUPT_ENABLER_H
 #define INCLUDE_HARDWARE_INTERRUPT_ENABLER_H
 
+#include "type.h"
+
 void enable_hardware_interrupts();
 
 void disable_hardware_interrupts();
 
+/* Returns the current EFLAGS and disables interrupts; pass the result to
+ * restore_hardware_interrupts() to put IF back the way it was. */
+u32int save_and_disable_hardware_interrupts();
+
+void restore_hardware_interrupts(u32int flags);
+
 
 #endif /* INCLUDE_USER_MODE_H */
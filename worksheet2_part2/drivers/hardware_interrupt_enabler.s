@@ -9,3 +9,21 @@ global disable_hardware_interrupts
 disable_hardware_interrupts:
   cli
   ret
+
+global save_and_disable_hardware_interrupts
+
+; save_and_disable_hardware_interrupts - returns EFLAGS, then clears IF
+save_and_disable_hardware_interrupts:
+  pushfd
+  pop eax
+  cli
+  ret
+
+global restore_hardware_interrupts
+
+; restore_hardware_interrupts - reloads the IF state saved above
+; stack: [esp + 4] the EFLAGS value to restore
+restore_hardware_interrupts:
+  push dword [esp + 4]
+  popfd
+  ret
@@ -0,0 +1,188 @@
+#include "heapprof.h"
+#include "arena.h"
+#include "pit.h"
+#include "cpu.h"
+#include "symbols.h"
+#include "framebuffer.h"
+#include "spinlock.h"
+
+#define HEAPPROF_MASK		(HEAPPROF_SITES - 1)
+#define HEAPPROF_OTHER		HEAPPROF_SITES	/* slot for sites that did not fit */
+#define HEAPPROF_MAGIC		0x4850524F
+
+/* In front of every block while profiling */
+struct heapprof_header {
+	u32int magic;
+	u32int slot;
+	u32int size;
+	u32int allocated;	/* low half of pit_ticks() */
+};
+
+static struct heapprof_site heapprof_sites[HEAPPROF_SITES + 1];
+static u32int heapprof_used = 0;
+static struct spinlock heapprof_lock = SPINLOCK_INIT("heapprof");
+
+/* Finds or claims the slot of a call site */
+static u32int heapprof_slot(u32int site)
+{
+	u32int slot = (site * 2654435761U) >> 24 & HEAPPROF_MASK;
+	u32int probes;
+
+	for (probes = 0; probes < HEAPPROF_SITES; probes++, slot = (slot + 1) & HEAPPROF_MASK) {
+		if (heapprof_sites[slot].site == site) {
+			return slot;
+		}
+		if (!heapprof_sites[slot].site) {
+			// Keep one slot free so misses stop quickly
+			if (heapprof_used == HEAPPROF_SITES - 1) {
+				break;
+			}
+			heapprof_sites[slot].site = site;
+			heapprof_used++;
+			return slot;
+		}
+	}
+	return HEAPPROF_OTHER;
+}
+
+void heapprof_record_alloc(void* header, u32int size, u32int site)
+{
+	struct heapprof_header* block = header;
+	u32int flags = spin_lock_irqsave(&heapprof_lock);
+	struct heapprof_site* entry;
+
+	block->magic = HEAPPROF_MAGIC;
+	block->slot = heapprof_slot(site);
+	block->size = size;
+	block->allocated = (u32int) pit_ticks();
+
+	entry = &heapprof_sites[block->slot];
+	entry->allocations++;
+	entry->live_bytes += size;
+	entry->total_bytes += size;
+	spin_unlock_irqrestore(&heapprof_lock, flags);
+}
+
+void heapprof_record_free(void* header)
+{
+	struct heapprof_header* block = header;
+	u32int flags;
+	struct heapprof_site* entry;
+
+	if (block->magic != HEAPPROF_MAGIC) {
+		return;
+	}
+
+	flags = spin_lock_irqsave(&heapprof_lock);
+	entry = &heapprof_sites[block->slot];
+	entry->frees++;
+	// A reset in between may leave less than this block
+	entry->live_bytes -= block->size < entry->live_bytes ? block->size : entry->live_bytes;
+	entry->lifetime_ticks += (u32int) pit_ticks() - block->allocated;
+	block->magic = 0;
+	spin_unlock_irqrestore(&heapprof_lock, flags);
+}
+
+void heapprof_reset(void)
+{
+	u32int flags = spin_lock_irqsave(&heapprof_lock);
+	u32int i;
+
+	for (i = 0; i <= HEAPPROF_SITES; i++) {
+		heapprof_sites[i].allocations = 0;
+		heapprof_sites[i].frees = 0;
+		heapprof_sites[i].total_bytes = 0;
+		heapprof_sites[i].lifetime_ticks = 0;
+		// Live blocks still point at their slot, so the sites stay
+	}
+	spin_unlock_irqrestore(&heapprof_lock, flags);
+}
+
+/* Ranking *******************************************************************/
+
+#ifdef HEAP_PROFILE
+
+static u32int heapprof_before(struct heapprof_site* a, struct heapprof_site* b, u32int by_bytes)
+{
+	return by_bytes ? a->total_bytes > b->total_bytes : a->allocations > b->allocations;
+}
+
+static void heapprof_print_site(struct heapprof_site* entry)
+{
+	u32int remainder;
+
+	fb_write_string("  ", FB_WHITE, FB_BLACK);
+	if (entry == &heapprof_sites[HEAPPROF_OTHER]) {
+		fb_write_string("(other)", FB_WHITE, FB_BLACK);
+	} else {
+		symbols_write(entry->site, FB_WHITE, FB_BLACK);
+	}
+	fb_write_string(": ", FB_WHITE, FB_BLACK);
+	fb_write_number64(entry->total_bytes, FB_WHITE, FB_BLACK);
+	fb_write_string(" bytes in ", FB_WHITE, FB_BLACK);
+	fb_write_number(entry->allocations, FB_WHITE, FB_BLACK);
+	fb_write_string(", ", FB_WHITE, FB_BLACK);
+	fb_write_number(entry->live_bytes, FB_WHITE, FB_BLACK);
+	fb_write_string(" live", FB_WHITE, FB_BLACK);
+	if (entry->frees) {
+		fb_write_string(", lives ", FB_WHITE, FB_BLACK);
+		fb_write_number64(cpu_div_u64(cpu_div_u64(entry->lifetime_ticks * 1000, pit_hz(), &remainder),
+					      entry->frees, &remainder), FB_WHITE, FB_BLACK);
+		fb_write_string(" ms", FB_WHITE, FB_BLACK);
+	}
+	fb_newline();
+}
+
+static void heapprof_print_ranking(struct heapprof_site** ranking, u32int count, u32int by_bytes)
+{
+	struct heapprof_site* swap;
+	u32int i;
+	u32int j;
+
+	// Selection sort of the first few: only HEAPPROF_TOP are shown
+	for (i = 0; i < count && i < HEAPPROF_TOP; i++) {
+		for (j = i + 1; j < count; j++) {
+			if (heapprof_before(ranking[j], ranking[i], by_bytes)) {
+				swap = ranking[i];
+				ranking[i] = ranking[j];
+				ranking[j] = swap;
+			}
+		}
+		heapprof_print_site(ranking[i]);
+	}
+}
+
+void heapprof_print(struct arena* scratch)
+{
+	struct heapprof_site** ranking = arena_alloc(scratch, (HEAPPROF_SITES + 1) * sizeof(struct heapprof_site*));
+	u32int count = 0;
+	u32int i;
+
+	if (!ranking) {
+		fb_write_string("Not enough scratch memory\n", FB_LIGHT_RED, FB_BLACK);
+		return;
+	}
+	for (i = 0; i <= HEAPPROF_SITES; i++) {
+		if (heapprof_sites[i].allocations) {
+			ranking[count++] = &heapprof_sites[i];
+		}
+	}
+
+	if (!symbols_present()) {
+		fb_write_string("(no kernel.sym module: sites shown as addresses)\n", FB_LIGHT_GREY, FB_BLACK);
+	}
+	fb_write_string("Top sites by bytes:\n", FB_LIGHT_CYAN, FB_BLACK);
+	heapprof_print_ranking(ranking, count, 1);
+	fb_write_string("Top sites by count:\n", FB_LIGHT_CYAN, FB_BLACK);
+	heapprof_print_ranking(ranking, count, 0);
+}
+
+#else
+
+void heapprof_print(struct arena* scratch)
+{
+	(void) scratch;
+	fb_write_string("Heap profiling is off; build with KERNEL_OPTIONS=-DHEAP_PROFILE\n", FB_LIGHT_RED, FB_BLACK);
+}
+
+#endif /* HEAP_PROFILE */
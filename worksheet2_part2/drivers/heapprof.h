@@ -0,0 +1,44 @@
+#ifndef INCLUDE_HEAPPROF_H
+#define INCLUDE_HEAPPROF_H
+
+#include "type.h"
+
+/*
+    Heap allocation profiler, built in with KERNEL_OPTIONS=-DHEAP_PROFILE.
+
+    kmalloc() then puts a small header in front of every block naming the
+    call site (its return address) and when it was allocated, and counts
+    the allocation against that site in a fixed size hash table. kfree()
+    reads the header back to account bytes and lifetime to the same site.
+    Sites that do not fit in the table are counted together as "other".
+*/
+#define HEAPPROF_SITES		256	/* power of two */
+#define HEAPPROF_HEADER_SIZE	16	/* keeps SLAB_ALIGN alignment */
+#define HEAPPROF_TOP		8	/* sites printed per ranking */
+
+struct heapprof_site {
+	u32int site;		/* return address of the kmalloc() call */
+	u32int allocations;
+	u32int frees;
+	u32int live_bytes;
+	u64int total_bytes;
+	u64int lifetime_ticks;	/* summed over freed blocks */
+};
+
+struct arena;
+
+/** heapprof_record_alloc / heapprof_record_free:
+ *  Called by kmalloc() and kfree() with the start of the header.
+ */
+void heapprof_record_alloc(void* header, u32int size, u32int site);
+void heapprof_record_free(void* header);
+
+/** heapprof_print:
+ *  Prints the top sites by bytes and by count, symbolized if the symbol
+ *  module was loaded. scratch holds the ranking while it is printed.
+ */
+void heapprof_print(struct arena* scratch);
+
+void heapprof_reset(void);
+
+#endif /* INCLUDE_HEAPPROF_H */
@@ -0,0 +1,207 @@
+#include "hpet.h"
+#include "acpi.h"
+#include "apic.h"
+#include "cpu.h"
+#include "paging.h"
+#include "hardware_interrupt_enabler.h"
+#include "init.h"
+
+/*
+    HPET
+	From: http://wiki.osdev.org/HPET
+	The registers are 64 bits wide but are accessed as 32-bit halves. The
+	64-bit main counter is read high, low, high and retried if the high half
+	changed in between.
+
+	The event comparator runs in 32-bit mode, so deadlines are at most 2^31
+	counter ticks away (over three minutes at 10 MHz); longer waits belong
+	in the timing wheel anyway.
+*/
+
+struct hpet_table {
+	struct acpi_header header;
+	u32int hardware_id;
+	struct acpi_address address;
+	u8int number;
+	u16int minimum_tick;
+	u8int protection;
+} __attribute__((packed));
+
+static volatile u32int* hpet_registers = 0;
+static u32int hpet_period = 0;
+static u32int hpet_mult = 0;
+static u32int hpet_wide = 0;
+static u32int hpet_timer_count = 0;
+
+static u32int hpet_last_low = 0;	/* 32-bit counters: software extension */
+static u32int hpet_high = 0;
+
+static u32int hpet_event_timer = 0;
+static u32int hpet_event_ready = 0;
+static void (*hpet_event_handler)(void) = 0;
+
+static u32int hpet_read(u32int reg)
+{
+	return hpet_registers[reg / 4];
+}
+
+static void hpet_write(u32int reg, u32int value)
+{
+	hpet_registers[reg / 4] = value;
+}
+
+u32int __init hpet_init(void)
+{
+	struct hpet_table* table = (struct hpet_table*) acpi_find_table("HPET");
+	u32int base = HPET_DEFAULT_BASE;
+	u32int capabilities;
+	u32int timer;
+
+	if (table && table->address.space_id == 0) {
+		base = (u32int) table->address.address;
+	}
+	hpet_registers = paging_map_mmio(base, HPET_REGISTER_SIZE);
+	if (!hpet_registers) {
+		return 0;
+	}
+
+	capabilities = hpet_read(HPET_REG_CAPABILITIES);
+	hpet_period = hpet_read(HPET_REG_CAPABILITIES + 4);
+	if (capabilities == 0xFFFFFFFF || hpet_period == 0 || hpet_period > HPET_MAX_PERIOD_FS) {
+		hpet_registers = 0;
+		return 0;
+	}
+
+	hpet_wide = (capabilities & HPET_CAP_COUNT_64) != 0;
+	hpet_timer_count = ((capabilities >> 8) & 0x1F) + 1;
+	// ns = ticks * period / 10^6, as a fixed point multiplier
+	hpet_mult = (u32int) cpu_div_u64((u64int) hpet_period << HPET_SHIFT, 1000000, 0);
+
+	// Halt, clear legacy replacement (the PIT and RTC keep their IRQs), reset
+	hpet_write(HPET_REG_CONFIG, hpet_read(HPET_REG_CONFIG) & ~(HPET_CONFIG_ENABLE | HPET_CONFIG_LEGACY));
+	for (timer = 0; timer < hpet_timer_count; timer++) {
+		hpet_write(HPET_REG_TIMER_CONFIG(timer),
+			   hpet_read(HPET_REG_TIMER_CONFIG(timer)) & ~HPET_TIMER_ENABLE);
+	}
+	hpet_write(HPET_REG_COUNTER, 0);
+	hpet_write(HPET_REG_COUNTER + 4, 0);
+	hpet_write(HPET_REG_CONFIG, hpet_read(HPET_REG_CONFIG) | HPET_CONFIG_ENABLE);
+
+	return 1;
+}
+
+u32int hpet_present(void)
+{
+	return hpet_registers != 0;
+}
+
+u64int hpet_counter(void)
+{
+	u32int high, low, flags;
+
+	if (hpet_wide) {
+		do {
+			high = hpet_read(HPET_REG_COUNTER + 4);
+			low = hpet_read(HPET_REG_COUNTER);
+		} while (high != hpet_read(HPET_REG_COUNTER + 4));
+		return ((u64int) high << 32) | low;
+	}
+
+	flags = save_and_disable_hardware_interrupts();
+	low = hpet_read(HPET_REG_COUNTER);
+	if (low < hpet_last_low) {
+		hpet_high++;
+	}
+	hpet_last_low = low;
+	high = hpet_high;
+	restore_hardware_interrupts(flags);
+
+	return ((u64int) high << 32) | low;
+}
+
+u64int hpet_ns(void)
+{
+	return cpu_mul_shift_u64(hpet_counter(), hpet_mult, HPET_SHIFT);
+}
+
+u32int hpet_period_fs(void)
+{
+	return hpet_period;
+}
+
+u32int hpet_event_init(void (*handler)(void))
+{
+	u32int timer;
+	u32int routes;
+	u32int gsi;
+
+	if (!hpet_registers || !apic_enabled()) {
+		return 0;
+	}
+
+	for (timer = 0; timer < hpet_timer_count; timer++) {
+		routes = hpet_read(HPET_REG_TIMER_CONFIG(timer) + 4);
+		for (gsi = HPET_FIRST_GSI; gsi < 32; gsi++) {
+			if (!(routes & (1U << gsi)) || !apic_route_gsi(gsi, HPET_VECTOR)) {
+				continue;
+			}
+
+			// Edge triggered, one-shot, 32-bit; enabled when armed
+			hpet_write(HPET_REG_TIMER_CONFIG(timer),
+				   (gsi << HPET_TIMER_ROUTE_SHIFT) | HPET_TIMER_32BIT);
+			hpet_event_timer = timer;
+			hpet_event_handler = handler;
+			hpet_event_ready = 1;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void hpet_event_arm(u64int ns)
+{
+	u32int config = HPET_REG_TIMER_CONFIG(hpet_event_timer);
+	u32int flags;
+	u64int ticks;
+	u32int target;
+
+	if (!hpet_event_ready) {
+		return;
+	}
+
+	if (ns > HPET_EVENT_MAX_NS) {
+		ns = HPET_EVENT_MAX_NS;
+	}
+	ticks = cpu_div_u64(ns * 1000000, hpet_period, 0);
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	if (ticks > 0x7FFFFFFF) {
+		ticks = 0x7FFFFFFF;
+	}
+
+	flags = save_and_disable_hardware_interrupts();
+	hpet_write(config, hpet_read(config) | HPET_TIMER_ENABLE);
+	for (;;) {
+		target = hpet_read(HPET_REG_COUNTER) + (u32int) ticks;
+		hpet_write(HPET_REG_TIMER_COMPARATOR(hpet_event_timer), target);
+		// The match only fires when the counter reaches the comparator
+		if ((s32int) (target - hpet_read(HPET_REG_COUNTER)) > 0) {
+			break;
+		}
+		ticks *= 2;
+	}
+	restore_hardware_interrupts(flags);
+}
+
+void hpet_handle_interrupt(void)
+{
+	u32int config = HPET_REG_TIMER_CONFIG(hpet_event_timer);
+
+	// One-shot: stop it matching again when the counter comes round
+	hpet_write(config, hpet_read(config) & ~HPET_TIMER_ENABLE);
+
+	if (hpet_event_handler) {
+		hpet_event_handler();
+	}
+}
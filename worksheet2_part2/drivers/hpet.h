@@ -0,0 +1,83 @@
+#ifndef INCLUDE_HPET_H
+#define INCLUDE_HPET_H
+
+#include "type.h"
+
+/*
+    High Precision Event Timer: a free running main counter (at least 10 MHz,
+    usually 64 bits wide) plus a few comparators that raise an interrupt
+    when the counter reaches them.
+*/
+#define HPET_DEFAULT_BASE	0xFED00000	/* used when ACPI has no HPET table */
+#define HPET_REGISTER_SIZE	0x400
+#define HPET_MAX_PERIOD_FS	100000000	/* spec: period of at most 100 ns */
+#define HPET_SHIFT		24
+#define HPET_EVENT_MAX_NS	0xFFFFFFFFFFULL	/* keeps ns * 10^6 within 64 bits */
+
+/* Vector comparator interrupts are delivered on, through the I/O APIC */
+#define HPET_VECTOR		48
+/* First I/O APIC input that is not an ISA IRQ */
+#define HPET_FIRST_GSI		16
+
+/* Register offsets */
+#define HPET_REG_CAPABILITIES	0x000
+#define HPET_REG_CONFIG		0x010
+#define HPET_REG_STATUS		0x020
+#define HPET_REG_COUNTER	0x0F0
+#define HPET_REG_TIMER_CONFIG(n)	(0x100 + 0x20 * (n))
+#define HPET_REG_TIMER_COMPARATOR(n)	(0x108 + 0x20 * (n))
+
+#define HPET_CAP_COUNT_64	(1 << 13)
+#define HPET_CONFIG_ENABLE	(1 << 0)
+#define HPET_CONFIG_LEGACY	(1 << 1)
+#define HPET_TIMER_LEVEL	(1 << 1)
+#define HPET_TIMER_ENABLE	(1 << 2)
+#define HPET_TIMER_PERIODIC	(1 << 3)
+#define HPET_TIMER_32BIT	(1 << 8)
+#define HPET_TIMER_ROUTE_SHIFT	9
+
+/** hpet_init:
+ *  Finds the HPET (ACPI table, else the conventional address), resets and
+ *  starts its main counter. Comparators are left disabled.
+ *
+ *  @return 1 if an HPET is present
+ */
+u32int hpet_init(void);
+
+u32int hpet_present(void);
+
+/** hpet_counter:
+ *  Returns the main counter. A 32-bit counter is extended in software and
+ *  must then be read at least once per wrap (about 7 minutes at 10 MHz).
+ */
+u64int hpet_counter(void);
+
+/** hpet_ns:
+ *  Returns nanoseconds since hpet_init().
+ */
+u64int hpet_ns(void);
+
+u32int hpet_period_fs(void);
+
+/** hpet_event_init:
+ *  Routes the first suitable comparator to HPET_VECTOR through the I/O
+ *  APIC. The handler runs in interrupt context each time an event set by
+ *  hpet_event_arm() fires.
+ *
+ *  @return 1 if one-shot events are available (needs the I/O APIC)
+ */
+u32int hpet_event_init(void (*handler)(void));
+
+/** hpet_event_arm:
+ *  Makes the event comparator fire once, ns nanoseconds from now. A
+ *  deadline that is already behind the counter by the time it is written
+ *  is pushed out until it is not, so the event is never lost.
+ */
+void hpet_event_arm(u64int ns);
+
+/** hpet_handle_interrupt:
+ *  HPET_VECTOR handler body.
+ */
+void hpet_handle_interrupt(void);
+
+#endif /* INCLUDE_HPET_H */
@@ -0,0 +1,12 @@
+#ifndef INCLUDE_INIT_H
+#define INCLUDE_INIT_H
+
+/*
+    Boot-only code. Functions marked __init are linked into pages of their
+    own, after the rest of the kernel text (see source/link.ld), and
+    pmm_free_init() hands those pages to the allocator once kmain has
+    brought everything up. Nothing may call them after that.
+*/
+#define __init __attribute__((section(".init.text")))
+
+#endif /* INCLUDE_INIT_H */
@@ -0,0 +1,112 @@
+#include "input.h"
+#include "interrupts.h"
+#include "framebuffer.h"
+#include "clock.h"
+#include "hardware_interrupt_enabler.h"
+
+/*
+    NAPI-style input handling: interrupts while traffic is light, batched
+    polling from the idle loop while it is heavy.
+*/
+
+static struct input_device* input_devices = 0;
+
+void input_register(struct input_device* device)
+{
+	device->polling = 0;
+	device->window_irqs = 0;
+	device->window_start = clock_ns();
+	device->next = input_devices;
+	input_devices = device;
+
+	interrupts_unmask_irq(device->irq);
+}
+
+u32int input_handle_irq(u32int irq)
+{
+	struct input_device* device = input_devices;
+	u64int now;
+
+	while (device && device->irq != irq) {
+		device = device->next;
+	}
+	if (!device) {
+		return 0;
+	}
+
+	device->interrupts++;
+	if (device->drain(INPUT_POLL_BUDGET) == 0) {
+		return 1;
+	}
+
+	now = clock_ns();
+	device->last_data = now;
+	if (now - device->window_start > INPUT_WINDOW_NS) {
+		device->window_start = now;
+		device->window_irqs = 0;
+	}
+
+	if (++device->window_irqs >= INPUT_STORM_IRQS) {
+		// Too many interrupts for this little work: poll instead
+		device->polling = 1;
+		device->storms++;
+		interrupts_mask_irq(device->irq);
+	}
+	return 1;
+}
+
+u32int input_poll(void)
+{
+	struct input_device* device;
+	u32int polling = 0;
+	u32int count;
+	u32int flags;
+	u64int now;
+
+	for (device = input_devices; device; device = device->next) {
+		if (!device->polling) {
+			continue;
+		}
+
+		count = device->drain(INPUT_POLL_BUDGET);
+		device->polls++;
+		device->polled_bytes += count;
+
+		now = clock_ns();
+		if (count) {
+			device->last_data = now;
+		} else if (now - device->last_data > INPUT_WINDOW_NS) {
+			// Quiet for a whole window: back to interrupts
+			flags = save_and_disable_hardware_interrupts();
+			device->polling = 0;
+			device->window_irqs = 0;
+			device->window_start = now;
+			interrupts_unmask_irq(device->irq);
+			// An edge raised while the line was masked may be lost; pick up its data here
+			device->drain(INPUT_POLL_BUDGET);
+			restore_hardware_interrupts(flags);
+		}
+		polling += device->polling;
+	}
+
+	return polling;
+}
+
+void input_print_stats(void)
+{
+	struct input_device* device;
+
+	for (device = input_devices; device; device = device->next) {
+		fb_write_string((char*) device->name, FB_WHITE, FB_BLACK);
+		fb_write_string(device->polling ? " [polling]" : " [interrupt]", FB_LIGHT_CYAN, FB_BLACK);
+		fb_write_string(" irqs=", FB_WHITE, FB_BLACK);
+		fb_write_number(device->interrupts, FB_WHITE, FB_BLACK);
+		fb_write_string(" polls=", FB_WHITE, FB_BLACK);
+		fb_write_number(device->polls, FB_WHITE, FB_BLACK);
+		fb_write_string(" polled=", FB_WHITE, FB_BLACK);
+		fb_write_number(device->polled_bytes, FB_WHITE, FB_BLACK);
+		fb_write_string(" storms=", FB_WHITE, FB_BLACK);
+		fb_write_number(device->storms, FB_WHITE, FB_BLACK);
+		fb_newline();
+	}
+}
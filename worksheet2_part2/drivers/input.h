@@ -0,0 +1,65 @@
+#ifndef INCLUDE_INPUT_H
+#define INCLUDE_INPUT_H
+
+#include "type.h"
+
+/*
+    Interrupt/polling hybrid for character input devices.
+
+    A device normally runs interrupt driven. When INPUT_STORM_IRQS interrupts
+    arrive within INPUT_WINDOW_NS, its IRQ is masked and input_poll()
+    (called from the idle loop) drains it in batches of INPUT_POLL_BUDGET
+    instead. Once it has been quiet for a whole window the IRQ is re-armed.
+*/
+#define INPUT_STORM_IRQS	16
+#define INPUT_WINDOW_NS		4000000		/* 4 ms: 4000 interrupts/s to trip */
+#define INPUT_POLL_BUDGET	64
+
+struct input_device {
+	const char* name;
+	u32int irq;
+	/* Reads up to budget bytes from the device, returns how many it read */
+	u32int (*drain)(u32int budget);
+
+	/* Hybrid state */
+	u32int polling;
+	u32int window_irqs;
+	u64int window_start;
+	u64int last_data;
+
+	/* Statistics */
+	u32int interrupts;
+	u32int polls;
+	u32int polled_bytes;
+	u32int storms;
+
+	struct input_device* next;
+};
+
+/** input_register:
+ *  Adds a device to the input list and unmasks its IRQ.
+ */
+void input_register(struct input_device* device);
+
+/** input_handle_irq:
+ *  Interrupt path: drains the device owning the IRQ and switches it to
+ *  polling if it is interrupting too often.
+ *
+ *  @return 1 if a registered device owns the IRQ
+ */
+u32int input_handle_irq(u32int irq);
+
+/** input_poll:
+ *  Polling path: services every device currently in polling mode.
+ *
+ *  @return the number of devices still polling afterwards; while it is
+ *          non-zero the caller must keep calling instead of idling
+ */
+u32int input_poll(void);
+
+/** input_print_stats:
+ *  Prints per-device interrupt and polling counters.
+ */
+void input_print_stats(void);
+
+#endif /* INCLUDE_INPUT_H */
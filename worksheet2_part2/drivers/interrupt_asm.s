@@ -1,6 +1,12 @@
 ;Generic Interrupt Handler
 ;
 extern interrupt_handler
+extern stack_irq_bottom
+extern stack_irq_top
+extern cpu_apic_id_register
+extern cpu_index_by_apic_id
+extern thread_need_resched
+extern thread_preempt
 
 %macro no_error_code_interrupt_handler 1
 global interrupt_handler_%1
@@ -27,9 +33,56 @@ common_interrupt_handler:               ; the common parts of the generic interr
 	push	esi
 	push	edi
 
+	; which CPU this is, as cpu_current_id() works it out: esi is the index
+	; into the per-CPU interrupt stacks, and survives the call below
+	xor	esi, esi
+	mov	eax, [cpu_apic_id_register]
+	test	eax, eax
+	jz	.find_stack                 ; not set until other CPUs run
+	mov	eax, [eax]
+	shr	eax, 24
+	movzx	esi, byte [cpu_index_by_apic_id + eax]
+
+.find_stack:
+	; run on the interrupt stack, unless this interrupted a handler already on it
+	mov	ebx, esp                    ; the frame, for the handler and the way back
+	cmp	esp, [stack_irq_bottom + esi * 4]
+	jb	.switch_stack
+	cmp	esp, [stack_irq_top + esi * 4]
+	jbe	.call_handler
+.switch_stack:
+	mov	esp, [stack_irq_top + esi * 4]
+	mov	ecx, 12                     ; 7 registers, vector, error code, eip, cs, eflags
+.copy_frame:
+	push	dword [ebx + ecx * 4 - 4]   ; the handler takes the frame as its arguments
+	loop	.copy_frame
+
+.call_handler:
         ; call the C function
         call    interrupt_handler
+	mov	esp, ebx
+
+	; back on the interrupted thread's stack: switch threads if asked to,
+	; unless this interrupted a handler still running on the interrupt stack
+	; (threads only run on the boot CPU), was an exception, or came in while
+	; the interrupted code had interrupts disabled
+	cli
+	test	esi, esi
+	jnz	.restore
+	cmp	dword [thread_need_resched], 0
+	je	.restore
+	cmp	dword [ebx + 28], 32        ; the vector: below 32 is an exception
+	jb	.restore
+	test	dword [ebx + 44], 0x200     ; the interrupted EFLAGS: IF
+	jz	.restore
+	cmp	ebx, [stack_irq_bottom]
+	jb	.preempt
+	cmp	ebx, [stack_irq_top]
+	jbe	.restore
+.preempt:
+	call	thread_preempt
 
+.restore:
         ; restore the registers
 	pop	edi
 	pop	esi
@@ -45,4 +98,13 @@ common_interrupt_handler:               ; the common parts of the generic interr
 	; return to the code that got interrupted
 	iret
 
+error_code_interrupt_handler	14	; page fault
+no_error_code_interrupt_handler	32	; create handler for interrupt 0 (PIT timer)
 no_error_code_interrupt_handler	33	; create handler for interrupt 1 (keyboard)
+no_error_code_interrupt_handler	36	; create handler for interrupt 4 (COM1)
+no_error_code_interrupt_handler	39	; IRQ 7, where the master PIC reports spurious interrupts
+no_error_code_interrupt_handler	47	; IRQ 15, same for the slave PIC
+no_error_code_interrupt_handler	48	; HPET event comparator (through the I/O APIC)
+no_error_code_interrupt_handler	252	; job waiting (IPI to a halted CPU)
+no_error_code_interrupt_handler	253	; TLB shootdown (IPI)
+no_error_code_interrupt_handler	255	; APIC spurious interrupt vector
@@ -1,13 +1,61 @@
 #include "interrupts.h"
 #include "pic.h"
+#include "apic.h"
 #include "io.h"
 #include "framebuffer.h"
 #include "keyboard.h"
+#include "input.h"
+#include "syscall.h"
+#include "pit.h"
+#include "clock.h"
+#include "hpet.h"
+#include "rtc.h"
+#include "pmm.h"
+#include "slab.h"
+#include "arena.h"
+#include "paging.h"
+#include "pagefault.h"
+#include "stack.h"
+#include "heapprof.h"
+#include "membench.h"
+#include "zeropool.h"
+#include "textprof.h"
+#include "thread.h"
+#include "event.h"
+#include "deferred.h"
+#include "cpu.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "hardware_interrupt_enabler.h"
+#include "init.h"
 
 #define INTERRUPTS_DESCRIPTOR_COUNT 256 
+#define INTERRUPTS_TIMER 32
 #define INTERRUPTS_KEYBOARD 33 
+#define INTERRUPTS_SERIAL 36
+#define INTERRUPTS_PIC_SPURIOUS_1 (PIC_1_OFFSET + PIC_SPURIOUS_IRQ_1)
+#define INTERRUPTS_PIC_SPURIOUS_2 (PIC_1_OFFSET + PIC_SPURIOUS_IRQ_2)
+#define INTERRUPTS_EXCEPTIONS 32	/* vectors below are CPU exceptions */
+#define INTERRUPTS_EFLAGS_IF 0x200
 #define INPUT_BUFFER_SIZE 256
 
+/*
+    8259 fully nested priority of each IRQ line, 0 = highest. The slave
+    (IRQ8-15) is cascaded on IRQ2, so it ranks between IRQ1 and IRQ3.
+*/
+static const u8int irq_priority[PIC_IRQ_COUNT] = {
+	0, 1, 2, 10, 11, 12, 13, 14,	/* IRQ0-7 */
+	2, 3, 4, 5, 6, 7, 8, 9		/* IRQ8-15 */
+};
+
+/* Per-CPU interrupt nesting state */
+struct interrupts_cpu_state {
+	u32int depth;		/* handlers currently running on this CPU */
+	u16int nest_mask;	/* lines held off by its nested handlers */
+};
+
+static struct interrupts_cpu_state interrupts_cpu[CPU_MAX];
+
 u8int input_buffer[INPUT_BUFFER_SIZE];
 u8int buffer_index = 0;
 u8int buffer_read_index = 0;
@@ -16,55 +64,56 @@ u16int buffer_size = 0;
 struct IDTDescriptor idt_descriptors[INTERRUPTS_DESCRIPTOR_COUNT];
 struct IDT idt;
 
+// The input IRQs fill the buffer while the shell drains it, and a device in
+// polling mode fills it from thread context too: all of it under this lock
+static struct spinlock input_buffer_lock = SPINLOCK_INIT("input buffer");
+
 u32int BUFFER_COUNT = 0;
 // Input buffer functions
 void add_to_buffer(u8int c) {
+    u32int flags = spin_lock_irqsave(&input_buffer_lock);
+
     if (buffer_size < INPUT_BUFFER_SIZE) {
         input_buffer[buffer_index] = c;
         buffer_index = (buffer_index + 1) % INPUT_BUFFER_SIZE;
         buffer_size++;
     }
+    spin_unlock_irqrestore(&input_buffer_lock, flags);
+}
+
+static void shell_input(void* data);
+static volatile u32int shell_input_posted = 0;
+
+// Called by the input drivers for every character received. Characters are
+// queued raw; the shell drains them from its input event, editing and echoing.
+void input_receive_char(u8int c) {
+    add_to_buffer(c);
+
+    // One notification at a time: the shell drains the whole buffer
+    if (atomic_swap(&shell_input_posted, 1) == 0) {
+        if (!event_post(EVENT_SOURCE_INPUT, shell_input, 0)) {
+            shell_input_posted = 0;
+        }
+    }
 }
 
 u8int getc() {
+    u32int flags = spin_lock_irqsave(&input_buffer_lock);
+    u8int c;
+
     if (buffer_size == 0) {
+        spin_unlock_irqrestore(&input_buffer_lock, flags);
         return 0; // Buffer empty
     }
-    
-    u8int c = input_buffer[buffer_read_index];
+
+    c = input_buffer[buffer_read_index];
     buffer_read_index = (buffer_read_index + 1) % INPUT_BUFFER_SIZE;
     buffer_size--;
+    spin_unlock_irqrestore(&input_buffer_lock, flags);
     return c;
 }
 
-void readline(char* buffer, u32int max_length) {
-    u32int index = 0;
-    u8int c;
-    
-    while (index < max_length - 1) {
-        // Wait for input (in a real system, this would be handled differently)
-        while ((c = getc()) == 0) {
-            // Wait for character
-        }
-        
-        if (c == '\n' || c == '\r') {
-            break;
-        } else if (c == '\b') {
-            if (index > 0) {
-                index--;
-                // Don't call fb_backspace here - it's already handled in interrupt handler
-            }
-        } else {
-            buffer[index] = c;
-            index++;
-            // Don't display here - it's already displayed in interrupt handler
-        }
-    }
-    
-    buffer[index] = '\0'; // Null terminate
-}
-
-void interrupts_init_descriptor(s32int index, u32int address)
+void interrupts_init_gate(s32int index, u32int address, u8int type, u8int dpl)
 {
 	idt_descriptors[index].offset_high = (address >> 16) & 0xFFFF; // offset bits 0..15
 	idt_descriptors[index].offset_low = (address & 0xFFFF); // offset bits 16..31
@@ -81,14 +130,28 @@ void interrupts_init_descriptor(s32int index, u32int address)
 		D	Size of gate, (1 = 32 bits, 0 = 16 bits).
 	*/
 	idt_descriptors[index].type_and_attr =	(0x01 << 7) |			// P
-						(0x00 << 6) | (0x00 << 5) |	// DPL
-						0xe;				// 0b1110=0xE 32-bit interrupt gate
+						((dpl & 0x03) << 5) |		// DPL
+						type;				// 0xE interrupt gate, 0xF trap gate
+}
+
+void interrupts_init_descriptor(s32int index, u32int address)
+{
+	interrupts_init_gate(index, address, INTERRUPTS_GATE_INTERRUPT, 0);
 }
 
-void interrupts_install_idt()
+void __init interrupts_install_idt()
 {
 	
+	interrupts_init_descriptor(PAGEFAULT_VECTOR, (u32int) interrupt_handler_14);
+	interrupts_init_descriptor(INTERRUPTS_TIMER, (u32int) interrupt_handler_32);
 	interrupts_init_descriptor(INTERRUPTS_KEYBOARD, (u32int) interrupt_handler_33);
+	interrupts_init_descriptor(INTERRUPTS_SERIAL, (u32int) interrupt_handler_36);
+	interrupts_init_descriptor(INTERRUPTS_PIC_SPURIOUS_1, (u32int) interrupt_handler_39);
+	interrupts_init_descriptor(INTERRUPTS_PIC_SPURIOUS_2, (u32int) interrupt_handler_47);
+	interrupts_init_descriptor(HPET_VECTOR, (u32int) interrupt_handler_48);
+	interrupts_init_descriptor(SMP_WAKE_VECTOR, (u32int) interrupt_handler_252);
+	interrupts_init_descriptor(SMP_TLB_VECTOR, (u32int) interrupt_handler_253);
+	interrupts_init_descriptor(APIC_SPURIOUS_VECTOR, (u32int) interrupt_handler_255);
 
 
 	idt.address = (s32int) &idt_descriptors;
@@ -98,97 +161,594 @@ void interrupts_install_idt()
 	/*pic_remap(PIC_PIC1_OFFSET, PIC_PIC2_OFFSET);*/
 	pic_remap(PIC_1_OFFSET, PIC_2_OFFSET);
 
-    // Unmask keyboard interrupt (IRQ1)
-    outb(0x21, inb(0x21) & ~(1 << 1));
+	// Prefer the APIC; the PIC stays remapped but fully masked underneath it
+	if (apic_init(PIC_1_OFFSET)) {
+		pic_set_mask(0xFFFF);
+	}
 }
 
+/**
+  *  Loads the IDT built by interrupts_install_idt() on an application
+  *  processor.
+  */
+void interrupts_install_cpu(void)
+{
+	load_idt((s32int) &idt);
+}
+
+
+/* Interrupt controller ******************************************************/
+
+/*
+    The active controller is the APIC when apic_init() found one, otherwise
+    the 8259 PIC. Masks use the ISA IRQ numbering in both cases.
+
+    What the controller sees is the union of the lines drivers have masked
+    and the lines held off by nested handlers, so a driver can mask its own
+    IRQ from inside a nested handler without interrupts_nest_exit() undoing it.
+*/
+
+static u16int interrupts_irq_mask = (u16int) ~(1 << PIC_CASCADE_IRQ);
+
+static void interrupts_acknowledge(u32int interrupt)
+{
+	if (apic_enabled()) {
+		if (interrupt >= PIC_1_OFFSET && interrupt <= PIC_2_END) {
+			apic_acknowledge();
+		}
+	} else {
+		pic_acknowledge(interrupt);
+	}
+}
+
+/* Must be called with interrupts disabled */
+static void interrupts_apply_mask(void)
+{
+	u16int mask = interrupts_irq_mask;
+	u32int cpu;
+
+	for (cpu = 0; cpu < CPU_MAX; cpu++) {
+		mask |= interrupts_cpu[cpu].nest_mask;
+	}
+
+	if (apic_enabled()) {
+		// IRQ2 is only the PIC cascade; on the I/O APIC its input is the 8259 itself
+		apic_set_mask(mask | (1 << PIC_CASCADE_IRQ));
+	} else {
+		pic_set_mask(mask);
+	}
+}
+
+void interrupts_mask_irq(u32int irq)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	interrupts_irq_mask |= (u16int) (1 << irq);
+	interrupts_apply_mask();
+	restore_hardware_interrupts(flags);
+}
+
+void interrupts_unmask_irq(u32int irq)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	interrupts_irq_mask &= (u16int) ~(1 << irq);
+	interrupts_apply_mask();
+	restore_hardware_interrupts(flags);
+}
+
+u32int interrupts_irq_masked(u32int irq)
+{
+	return (interrupts_irq_mask >> irq) & 1;
+}
+
+
+/* Nested interrupts *********************************************************/
+
+/**
+  *  Builds the mask of IRQ lines whose priority is the same as or lower than
+  *  the given line. The cascade line is never included: the slave's own
+  *  lines are masked individually so higher slave IRQs still get through.
+  */
+static u16int interrupts_lower_priority_mask(u32int irq)
+{
+	u16int mask = 0;
+	u32int line;
+
+	for (line = 0; line < PIC_IRQ_COUNT; line++) {
+		if (line != PIC_CASCADE_IRQ && irq_priority[line] >= irq_priority[irq]) {
+			mask |= (u16int) (1 << line);
+		}
+	}
+	return mask;
+}
+
+/**
+  *  Lets the rest of a handler run with interrupts enabled. Lines of the same
+  *  or lower priority are masked at the controller and the interrupt is
+  *  acknowledged early, so only higher priority IRQs (e.g. the timer) can
+  *  preempt it. Every call must be paired with interrupts_nest_exit() before
+  *  returning.
+  *
+  *  @param nest      State to hand back to interrupts_nest_exit()
+  *  @param interrupt The vector being serviced
+  */
+void interrupts_nest_enter(struct interrupt_nest* nest, u32int interrupt)
+{
+	struct interrupts_cpu_state* cpu_state = &interrupts_cpu[cpu_current_id()];
+
+	nest->interrupt = interrupt;
+	nest->saved_mask = cpu_state->nest_mask;
+
+	if (interrupt >= PIC_1_OFFSET && interrupt <= PIC_2_END) {
+		cpu_state->nest_mask |= interrupts_lower_priority_mask(interrupt - PIC_1_OFFSET);
+		interrupts_apply_mask();
+	}
+	interrupts_acknowledge(interrupt);
+
+	enable_hardware_interrupts();
+}
+
+/**
+  *  Ends the interruptible part of a handler: interrupts are disabled again
+  *  and the lines it held off are released.
+  */
+void interrupts_nest_exit(struct interrupt_nest* nest)
+{
+	disable_hardware_interrupts();
+	interrupts_cpu[cpu_current_id()].nest_mask = nest->saved_mask;
+	interrupts_apply_mask();
+}
+
+/**
+  *  Returns how many interrupt handlers are active on the calling CPU.
+  *  Zero means the caller is not running in interrupt context.
+  */
+u32int interrupts_nesting_depth(void)
+{
+	return interrupts_cpu[cpu_current_id()].depth;
+}
 
 /* Interrupt handlers ********************************************************/
 
-void interrupt_handler(__attribute__((unused)) struct cpu_state cpu, u32int interrupt, __attribute__((unused)) struct stack_state stack) {
-    u8int input;
-    u8int ascii;
+void interrupt_handler(__attribute__((unused)) struct cpu_state cpu, u32int interrupt, struct stack_state stack) {
+    struct interrupt_nest nest;
+    u32int cpu_id = cpu_current_id();
+    struct interrupts_cpu_state* cpu_state = &interrupts_cpu[cpu_id];
+
+    cpu_state->depth++;
+
+    // Whatever woke an idle boot CPU, bring the tick count up to date first
+    if (cpu_id == 0) {
+        pit_wake();
+    }
     
     switch (interrupt) {
+        case PAGEFAULT_VECTOR:
+            pagefault_handle(stack.error_code, stack.eip);
+            break;
+        case INTERRUPTS_TIMER:
+#ifdef TEXT_PROFILE
+            textprof_sample(stack.eip);
+#endif
+            pit_handle_interrupt();
+            thread_tick();
+            deferred_raise(DEFERRED_TIMERS);
+            interrupts_acknowledge(interrupt);
+            break;
         case INTERRUPTS_KEYBOARD:
-            while ((inb(0x64) & 1)) {
-                input = keyboard_read_scan_code();
-                // Only process if it's not a break code (key press, not release)
-                if (!(input & 0x80)) {
-                    if (input <= KEYBOARD_MAX_ASCII) {
-                        ascii = keyboard_scan_code_to_ascii(input);
-                        if (ascii != 0) {
-                            // Handle display and buffer management
-                            if (ascii == '\b') {
-                                // Handle backspace - remove from buffer and display
-                                if (buffer_size > 0) {
-                                    // Remove last character from buffer
-                                    if (buffer_index == 0) {
-                                        buffer_index = INPUT_BUFFER_SIZE - 1;
-                                    } else {
-                                        buffer_index--;
-                                    }
-                                    buffer_size--;
-                                    fb_backspace();
-                                }
-                            } else if (ascii == '\n') {
-                                // Handle newline
-                                add_to_buffer(ascii);
-                                fb_newline();
-                            } else {
-                                // Add character to input buffer and display
-                                add_to_buffer(ascii);
-                                fb_putchar(ascii);
-                            }
-                        }
-                    }
-                }
+        case INTERRUPTS_SERIAL:
+            // Echoing to the framebuffer is slow; let higher IRQs in meanwhile
+            interrupts_nest_enter(&nest, interrupt);
+            input_handle_irq(interrupt - PIC_1_OFFSET);
+            interrupts_nest_exit(&nest);
+            break;
+        case INTERRUPTS_PIC_SPURIOUS_1:
+        case INTERRUPTS_PIC_SPURIOUS_2:
+            // Nothing drives IRQ7/15 yet, but a real one still needs its EOI.
+            // Only the 8259 fakes them; once it is masked its ISR is always
+            // clear and the APIC reports its own at APIC_SPURIOUS_VECTOR
+            if (apic_enabled() || !pic_is_spurious(interrupt)) {
+                interrupts_acknowledge(interrupt);
             }
-            pic_acknowledge(interrupt);
+            break;
+        case HPET_VECTOR:
+            // Only ever routed through the I/O APIC
+            hpet_handle_interrupt();
+            apic_acknowledge();
+            break;
+        case SMP_WAKE_VECTOR:
+            // Only there to end a hlt; the job is picked up on return
+            apic_acknowledge();
+            break;
+        case SMP_TLB_VECTOR:
+            smp_handle_shootdown();
+            apic_acknowledge();
+            break;
+        case APIC_SPURIOUS_VECTOR:
+            // Spurious APIC interrupts must not be acknowledged
             break;
         default:
             break;
     }
+
+    // Leaving the outermost handler: run deferred work with interrupts
+    // enabled. Not after an exception, and not when the interrupted code
+    // had interrupts off: a page fault in a save_and_disable section must
+    // return to it without enabling interrupts or switching threads
+    if (--cpu_state->depth == 0 && interrupt >= INTERRUPTS_EXCEPTIONS
+        && (stack.eflags & INTERRUPTS_EFLAGS_IF)) {
+        deferred_run();
+        stack_check();
+        if (cpu_id == 0) {
+            thread_interrupted();
+        }
+    }
 }
 
 // Terminal implementation
 #define MAX_COMMAND_LENGTH 128
 #define MAX_ARGS_LENGTH 100
+#define SYSBENCH_ITERATIONS 10000
+#define SHELL_ARENA_SIZE 4096
+
+// Scratch memory for the running command, reset when it returns
+static u8int shell_arena_buffer[SHELL_ARENA_SIZE];
+static struct arena shell_arena_state = { shell_arena_buffer, SHELL_ARENA_SIZE, 0, 0, 0, 0 };
+
+struct arena* shell_arena() {
+    return &shell_arena_state;
+}
 
 struct command {
     const char* name;
-    void (*function)(char* args);
+    void (*function)(u32int argc, char** argv);	/* argv[0] is the name */
 };
 
+// Prints a line built in the shell arena; 0 means building it ran out of room
+static void shell_write_line(char* line) {
+    if (line) {
+        fb_write_string(line, FB_WHITE, FB_BLACK);
+    } else {
+        fb_write_string("Out of shell arena memory\n", FB_LIGHT_RED, FB_BLACK);
+    }
+}
+
 // Command implementations
-void cmd_echo(char* args) {
-    if (args && *args) {
-        while (*args) {
-            fb_putchar(*args);
-            args++;
+void cmd_echo(u32int argc, char** argv) {
+    u32int i;
+
+    for (i = 1; i < argc; i++) {
+        if (i > 1) {
+            fb_putchar(' ');
         }
+        fb_write_string(argv[i], FB_WHITE, FB_BLACK);
     }
     fb_newline();
 }
 
-void cmd_clear(char* args) {
-    (void)args; // Unused parameter
+void cmd_clear(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
     fb_clear(FB_BLACK);
     // Cursor position is handled internally by framebuffer
 }
 
-void cmd_help(char* args) {
-    (void)args; // Unused parameter
+void cmd_help(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
     fb_write_string("Available commands:\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  date        - Show the date and time (UTC)\n", FB_WHITE, FB_BLACK);
     fb_write_string("  echo [text] - Display the provided text\n", FB_WHITE, FB_BLACK);
     fb_write_string("  clear       - Clear the screen\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  clock       - Show the calibrated clock source\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  events      - Show event loop queue and rates\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  faults      - Show page fault counters ('faults test' exercises them)\n", FB_WHITE, FB_BLACK);
     fb_write_string("  help        - Show this help message\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  heapprof    - Show top allocation sites (heapprof reset clears)\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  hpet [us]   - Time a one-shot HPET event\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  inputstat   - Show input device interrupt/polling counters\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  locks       - Show lock contention statistics (LOCK_STATS builds)\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  mem         - Show physical memory usage\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  membench    - Measure memory bandwidth and latency\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  memtest [n] - Pattern test n MiB of free memory (default 4)\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  slabinfo    - Show slab allocator caches\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  ps          - List threads\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  sleep [ms]  - Sleep for the given milliseconds\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  smp [bench] - List CPUs and their jobs (bench times a parallel checksum)\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  spin [ms]   - Busy loop in a background thread\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  stack       - Show stack high-water marks\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  sysbench    - Time int 0x80 and sysenter round trips\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  textprof    - List hot functions for text_order.ld (reset clears)\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  ticks       - Show the timer tick count\n", FB_WHITE, FB_BLACK);
+    fb_write_string("  uptime      - Show time since boot\n", FB_WHITE, FB_BLACK);
     fb_write_string("  version     - Display OS version\n", FB_WHITE, FB_BLACK);
     // Cursor position is handled internally by framebuffer
 }
 
-void cmd_version(char* args) {
-    (void)args; // Unused parameter
+// Touches lazily backed and copy on write pages and checks what they read back
+static u32int faults_self_test(void) {
+    u32int pages = 8;
+    u32int size = pages * PAGING_PAGE_SIZE;
+    u32int* first = pagefault_reserve(size);
+    u32int* second = pagefault_reserve(size);
+    u32int words = PAGING_PAGE_SIZE / sizeof(u32int);
+    u32int ok = first && second;
+    u32int i;
+
+    if (ok) {
+        ok = first[0] == 0;                     // zero page
+        for (i = 1; i < pages; i++) {
+            first[i * words] = i;               // demand zero
+        }
+        ok = ok && pagefault_share((u32int) second, (u32int) first, pages) == pages;
+        second[words] = 100;                    // copy
+        first[2 * words] = 200;                 // copy
+        second[2 * words] = 300;                // last sharer: reuse
+        ok = ok && first[words] == 1 && second[words] == 100;
+        ok = ok && first[2 * words] == 200 && second[2 * words] == 300;
+        ok = ok && second[3 * words] == 3 && second[0] == 0;
+    }
+
+    if (second) {
+        pagefault_release((u32int) second, size);
+    }
+    if (first) {
+        pagefault_release((u32int) first, size);
+    }
+    return ok;
+}
+
+void cmd_faults(u32int argc, char** argv) {
+    if (argc > 1 && string_compare(argv[1], "test") == 0) {
+        if (faults_self_test()) {
+            fb_write_string("Page fault test passed\n", FB_LIGHT_GREEN, FB_BLACK);
+        } else {
+            fb_write_string("Page fault test FAILED\n", FB_LIGHT_RED, FB_BLACK);
+        }
+    }
+    pagefault_print_stats();
+}
+
+void cmd_heapprof(u32int argc, char** argv) {
+    if (argc > 1 && string_compare(argv[1], "reset") == 0) {
+        heapprof_reset();
+        return;
+    }
+    heapprof_print(shell_arena());
+}
+
+void cmd_textprof(u32int argc, char** argv) {
+    if (argc > 1 && string_compare(argv[1], "reset") == 0) {
+        textprof_reset();
+        return;
+    }
+    textprof_print();
+}
+
+void cmd_events(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    event_print_stats();
+}
+
+void cmd_inputstat(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    input_print_stats();
+}
+
+void cmd_locks(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    lock_print_stats();
+}
+
+void cmd_mem(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    pmm_print_info();
+    zeropool_print_info();
+    fb_write_string("Shell arena: ", FB_WHITE, FB_BLACK);
+    fb_write_number(shell_arena_state.high_water, FB_WHITE, FB_BLACK);
+    fb_write_string(" of ", FB_WHITE, FB_BLACK);
+    fb_write_number(shell_arena_state.size, FB_WHITE, FB_BLACK);
+    fb_write_string(" bytes peak, ", FB_WHITE, FB_BLACK);
+    fb_write_number(shell_arena_state.failures, FB_WHITE, FB_BLACK);
+    fb_write_string(" failed allocations\n", FB_WHITE, FB_BLACK);
+}
+
+void cmd_membench(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    membench_run();
+}
+
+void cmd_memtest(u32int argc, char** argv) {
+    u32int megabytes = argc > 1 ? string_to_u32(argv[1]) : 0;
+
+    membench_test(megabytes ? megabytes : MEMBENCH_TEST_MB);
+}
+
+void cmd_slabinfo(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    slab_print_stats();
+}
+
+void cmd_stack(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    stack_print_info();
+}
+
+void cmd_ps(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    thread_print_info();
+}
+
+// Runs in the shell's event loop once a spin thread is done
+static void spin_done(void* data) {
+    fb_write_string("[spin: ", FB_LIGHT_CYAN, FB_BLACK);
+    fb_write_number((u32int) data, FB_LIGHT_CYAN, FB_BLACK);
+    fb_write_string(" ms done]\n", FB_LIGHT_CYAN, FB_BLACK);
+}
+
+// Background load for watching the scheduler: busy until the time is up
+static void spin_thread(void* data) {
+    struct timeout timeout;
+
+    timeout_start(&timeout, (u32int) data);
+    while (!timeout_expired(&timeout)) {
+    }
+    event_post(EVENT_SOURCE_WORK, spin_done, data);
+}
+
+void cmd_spin(u32int argc, char** argv) {
+    u32int ms = argc > 1 ? string_to_u32(argv[1]) : 0;
+
+    if (ms == 0) {
+        fb_write_string("Usage: spin <milliseconds>\n", FB_LIGHT_RED, FB_BLACK);
+        return;
+    }
+    if (!thread_spawn("spin", spin_thread, (void*) ms, THREAD_PRIORITY_LOW)) {
+        fb_write_string("Could not start a thread\n", FB_LIGHT_RED, FB_BLACK);
+    }
+}
+
+void cmd_smp(u32int argc, char** argv) {
+    if (argc > 1 && string_compare(argv[1], "bench") == 0) {
+        smp_benchmark(SMP_BENCH_MB);
+    }
+    smp_print_info();
+}
+
+void cmd_sysbench(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    syscall_benchmark(SYSBENCH_ITERATIONS);
+}
+
+void cmd_clock(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    clock_print_info();
+}
+
+void cmd_date(u32int argc, char** argv) {
+    struct arena* arena = shell_arena();
+    struct rtc_date date;
+    char* line;
+
+    (void)argc; (void)argv; // Unused parameters
+    rtc_to_date(rtc_now(), &date);
+    line = arena_strdup(arena, "");
+    line = arena_append_u32(arena, line, date.year, 4);
+    line = arena_append(arena, line, "-");
+    line = arena_append_u32(arena, line, date.month, 2);
+    line = arena_append(arena, line, "-");
+    line = arena_append_u32(arena, line, date.day, 2);
+    line = arena_append(arena, line, " ");
+    line = arena_append_u32(arena, line, date.hour, 2);
+    line = arena_append(arena, line, ":");
+    line = arena_append_u32(arena, line, date.minute, 2);
+    line = arena_append(arena, line, ":");
+    line = arena_append_u32(arena, line, date.second, 2);
+    line = arena_append(arena, line, " UTC\n");
+    shell_write_line(line);
+}
+
+void cmd_uptime(u32int argc, char** argv) {
+    struct arena* arena = shell_arena();
+    u32int hz = pit_hz();
+    u32int remainder;
+    u32int seconds = (u32int) cpu_div_u64(pit_ticks(), hz, &remainder);
+    char* line;
+
+    (void)argc; (void)argv; // Unused parameters
+    line = arena_strdup(arena, "up ");
+    line = arena_append_u32(arena, line, seconds / 3600, 1);
+    line = arena_append(arena, line, ":");
+    line = arena_append_u32(arena, line, seconds / 60 % 60, 2);
+    line = arena_append(arena, line, ":");
+    line = arena_append_u32(arena, line, seconds % 60, 2);
+    line = arena_append(arena, line, " (");
+    line = arena_append_u32(arena, line, seconds, 1);
+    line = arena_append(arena, line, ".");
+    line = arena_append_u32(arena, line, remainder * 100 / hz, 2);
+    line = arena_append(arena, line, " s)\n");
+    shell_write_line(line);
+}
+
+void cmd_ticks(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
+    fb_write_number64(pit_ticks(), FB_WHITE, FB_BLACK);
+    fb_write_string(" ticks at ", FB_WHITE, FB_BLACK);
+    fb_write_number(pit_hz(), FB_WHITE, FB_BLACK);
+    fb_write_string(" Hz\n", FB_WHITE, FB_BLACK);
+    fb_write_string("Tickless idle: ", FB_WHITE, FB_BLACK);
+    fb_write_number(pit_idle_sleeps_count(), FB_WHITE, FB_BLACK);
+    fb_write_string(" sleeps, ", FB_WHITE, FB_BLACK);
+    fb_write_number64(pit_idle_skipped_ticks(), FB_WHITE, FB_BLACK);
+    fb_write_string(" ticks skipped\n", FB_WHITE, FB_BLACK);
+}
+
+static volatile u64int hpet_fired_ns = 0;
+
+/* Slack on top of the requested delay before cmd_hpet gives up */
+#define HPET_EVENT_GRACE_MS 100
+
+static void cmd_hpet_fired(void) {
+    hpet_fired_ns = hpet_ns();
+}
+
+void cmd_hpet(u32int argc, char** argv) {
+    static u32int events = 0;
+    u32int us = argc > 1 ? string_to_u32(argv[1]) : 0;
+    u64int start;
+    u64int deadline;
+    u32int ms;
+
+    if (!hpet_present()) {
+        fb_write_string("No HPET\n", FB_LIGHT_RED, FB_BLACK);
+        return;
+    }
+    if (!events) {
+        events = hpet_event_init(cmd_hpet_fired);
+    }
+    if (!events) {
+        fb_write_string("HPET events need the I/O APIC\n", FB_LIGHT_RED, FB_BLACK);
+        return;
+    }
+    if (us == 0) {
+        us = 100;
+    }
+
+    // Timed by the PIT tick, in case the comparator interrupt never comes
+    ms = us / 1000 + HPET_EVENT_GRACE_MS;
+    deadline = pit_ticks() + ms / 1000 * pit_hz() + (ms % 1000) * pit_hz() / 1000 + 2;
+
+    hpet_fired_ns = 0;
+    start = hpet_ns();
+    hpet_event_arm((u64int) us * 1000);
+    while (!hpet_fired_ns) {
+        // The event interrupt ends the wait
+        if (pit_ticks() >= deadline) {
+            fb_write_string("HPET event did not fire within ", FB_LIGHT_RED, FB_BLACK);
+            fb_write_number(ms, FB_LIGHT_RED, FB_BLACK);
+            fb_write_string(" ms; is its interrupt routed?\n", FB_LIGHT_RED, FB_BLACK);
+            return;
+        }
+    }
+
+    fb_write_string("Requested ", FB_WHITE, FB_BLACK);
+    fb_write_number(us * 1000, FB_WHITE, FB_BLACK);
+    fb_write_string(" ns, fired after ", FB_WHITE, FB_BLACK);
+    fb_write_number64(hpet_fired_ns - start, FB_WHITE, FB_BLACK);
+    fb_write_string(" ns\n", FB_WHITE, FB_BLACK);
+}
+
+void cmd_sleep(u32int argc, char** argv) {
+    u32int ms = argc > 1 ? string_to_u32(argv[1]) : 0;
+
+    if (ms == 0) {
+        fb_write_string("Usage: sleep <milliseconds>\n", FB_LIGHT_RED, FB_BLACK);
+        return;
+    }
+    ksleep(ms);
+}
+
+void cmd_version(u32int argc, char** argv) {
+    (void)argc; (void)argv; // Unused parameters
     fb_write_string("MyOS v1.0 - Operating System with Keyboard Input\n", FB_WHITE, FB_BLACK);
     fb_write_string("Built with interrupt-driven keyboard support\n", FB_WHITE, FB_BLACK);
     // Cursor position is handled internally by framebuffer
@@ -196,9 +756,30 @@ void cmd_version(char* args) {
 
 // Command table
 struct command commands[] = {
+    {"date", cmd_date},
     {"echo", cmd_echo},
     {"clear", cmd_clear},
+    {"clock", cmd_clock},
+    {"events", cmd_events},
+    {"faults", cmd_faults},
     {"help", cmd_help},
+    {"heapprof", cmd_heapprof},
+    {"hpet", cmd_hpet},
+    {"inputstat", cmd_inputstat},
+    {"locks", cmd_locks},
+    {"mem", cmd_mem},
+    {"membench", cmd_membench},
+    {"memtest", cmd_memtest},
+    {"ps", cmd_ps},
+    {"sleep", cmd_sleep},
+    {"slabinfo", cmd_slabinfo},
+    {"smp", cmd_smp},
+    {"spin", cmd_spin},
+    {"stack", cmd_stack},
+    {"sysbench", cmd_sysbench},
+    {"textprof", cmd_textprof},
+    {"ticks", cmd_ticks},
+    {"uptime", cmd_uptime},
     {"version", cmd_version},
     {0, 0} // End marker
 };
@@ -227,56 +808,46 @@ void string_copy(char* dest, const char* src, u32int max_len) {
     dest[i] = '\0';
 }
 
-// Find first space in string, return index or -1 if not found
-s32int find_space(const char* str) {
-    s32int i = 0;
-    while (str[i]) {
-        if (str[i] == ' ') return i;
-        i++;
+// Parse a decimal number, stopping at the first non-digit
+u32int string_to_u32(const char* str) {
+    u32int value = 0;
+    while (*str >= '0' && *str <= '9') {
+        value = value * 10 + (*str - '0');
+        str++;
     }
-    return -1;
+    return value;
 }
 
 void process_command(char* input) {
-    // Skip leading spaces
-    while (*input == ' ') input++;
-    
-    // Check for empty input
-    if (*input == '\0') return;
-    
-    // Find command and arguments
-    s32int space_pos = find_space(input);
-    char command[MAX_COMMAND_LENGTH];
-    char* args = 0;
-    
-    if (space_pos >= 0) {
-        // Command with arguments
-        string_copy(command, input, space_pos + 1);
-        command[space_pos] = '\0';
-        args = input + space_pos + 1;
-        // Skip leading spaces in arguments
-        while (*args == ' ') args++;
-    } else {
-        // Command without arguments
-        string_copy(command, input, MAX_COMMAND_LENGTH);
-        args = 0;
+    struct arena* arena = shell_arena();
+    char** words;
+    u32int count = arena_split(arena, input, &words);
+    u32int i;
+
+    if (!words) {
+        fb_write_string("Command line does not fit in the shell arena\n", FB_LIGHT_RED, FB_BLACK);
+        arena_reset(arena);
+        return;
+    }
+    if (count == 0) {
+        arena_reset(arena);
+        return;
     }
     
     // Look up command
-    u32int i = 0;
-    while (commands[i].name) {
-        if (string_compare(command, commands[i].name) == 0) {
-            commands[i].function(args);
+    for (i = 0; commands[i].name; i++) {
+        if (string_compare(words[0], commands[i].name) == 0) {
+            commands[i].function(count, words);
+            arena_reset(arena);
             return;
         }
-        i++;
     }
     
     // Unknown command
     fb_write_string("Unknown command: ", FB_LIGHT_RED, FB_BLACK);
-    fb_write_string(command, FB_LIGHT_RED, FB_BLACK);
+    fb_write_string(words[0], FB_LIGHT_RED, FB_BLACK);
     fb_write_string("\nType 'help' for available commands.\n", FB_WHITE, FB_BLACK);
-    // Cursor position is handled internally by framebuffer
+    arena_reset(arena);
 }
 
 void show_prompt() {
@@ -284,19 +855,52 @@ void show_prompt() {
     // Cursor position is handled internally by framebuffer
 }
 
+/*
+    The shell is driven by input events rather than blocking for a line:
+    the line being edited lives here between events, and each event takes
+    whatever characters have arrived. A complete line is run as a command
+    and the handler returns, so timer and background events queued
+    meanwhile get their turn before any type-ahead is read.
+*/
+static char shell_line[MAX_COMMAND_LENGTH];
+static u32int shell_length = 0;
+
+static void shell_input(void* data) {
+    u8int c;
+
+    (void)data; // Unused parameter
+    shell_input_posted = 0;
+
+    while ((c = getc()) != 0) {
+        if (c == '\n' || c == '\r') {
+            shell_line[shell_length] = '\0';
+            shell_length = 0;
+            fb_newline();
+            process_command(shell_line);
+            show_prompt();
+            if (buffer_size && atomic_swap(&shell_input_posted, 1) == 0) {
+                shell_input_posted = event_post(EVENT_SOURCE_INPUT, shell_input, 0);
+            }
+            return;
+        } else if (c == '\b') {
+            if (shell_length > 0) {
+                shell_length--;
+                fb_backspace();
+            }
+        } else if (shell_length < MAX_COMMAND_LENGTH - 1) {
+            shell_line[shell_length++] = c;
+            fb_putchar(c);
+        }
+    }
+}
+
 void terminal_main() {
-    char input[MAX_COMMAND_LENGTH];
-    
     // Initialize terminal
-    cmd_clear(0);
+    cmd_clear(0, 0);
     fb_write_string("Welcome to MyOS Terminal!\n", FB_LIGHT_CYAN, FB_BLACK);
     fb_write_string("Type 'help' for available commands.\n\n", FB_WHITE, FB_BLACK);
     // Cursor position is handled internally by framebuffer
-    
-    while (1) {
-        show_prompt();
-        readline(input, MAX_COMMAND_LENGTH);
-        fb_newline();
-        process_command(input);
-    }
+
+    show_prompt();
+    event_loop();
 }
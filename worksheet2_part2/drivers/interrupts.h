@@ -20,12 +20,45 @@ struct IDTDescriptor {
 	u16int offset_high; // offset bits 16..31
 } __attribute__((packed));
 
+#define INTERRUPTS_GATE_INTERRUPT 0x0E	/* clears IF on entry */
+#define INTERRUPTS_GATE_TRAP 0x0F	/* leaves IF alone */
+
 void interrupts_install_idt();
 
+/** interrupts_install_cpu:
+ *  Loads the IDT on an application processor.
+ */
+void interrupts_install_cpu(void);
+void interrupts_init_descriptor(s32int index, u32int address);
+void interrupts_init_gate(s32int index, u32int address, u8int type, u8int dpl);
+
+// Interrupt controller (APIC when present, else 8259 PIC), ISA IRQ numbering
+void interrupts_mask_irq(u32int irq);
+void interrupts_unmask_irq(u32int irq);
+u32int interrupts_irq_masked(u32int irq);
+
+/* State saved by a handler that opted into running with interrupts enabled */
+struct interrupt_nest {
+	u32int interrupt;
+	u16int saved_mask;
+};
+
+void interrupts_nest_enter(struct interrupt_nest* nest, u32int interrupt);
+void interrupts_nest_exit(struct interrupt_nest* nest);
+u32int interrupts_nesting_depth(void);
+
 // Wrappers around ASM.
 void load_idt(u32int idt_address);
+void interrupt_handler_32();
 void interrupt_handler_33();
 void interrupt_handler_14();
+void interrupt_handler_36();
+void interrupt_handler_39();
+void interrupt_handler_47();
+void interrupt_handler_48();
+void interrupt_handler_252();
+void interrupt_handler_253();
+void interrupt_handler_255();
 
 struct cpu_state {
 	u32int eax;
@@ -47,14 +80,28 @@ struct stack_state {
 void interrupt_handler(struct cpu_state cpu, u32int interrupt, struct stack_state stack);
 
 // Input buffer functions
+void input_receive_char(u8int c);
 u8int getc();
-void readline(char* buffer, u32int max_length);
 
 // Framebuffer helper functions
 void fb_backspace();
 void fb_newline();
 
+// String utility functions
+u32int string_length(const char* str);
+int string_compare(const char* str1, const char* str2);
+void string_copy(char* dest, const char* src, u32int max_len);
+u32int string_to_u32(const char* str);
+
 // Terminal functions
+struct arena;
+
+/** shell_arena:
+ *  Scratch arena for the running shell command: tokens, formatted output
+ *  and temporary tables. Everything in it is released when the command
+ *  returns.
+ */
+struct arena* shell_arena();
 void terminal_main();
 void process_command(char* input);
 void show_prompt();
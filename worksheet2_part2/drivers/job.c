@@ -0,0 +1,226 @@
+#include "job.h"
+#include "smp.h"
+#include "cpu.h"
+#include "spinlock.h"
+#include "hardware_interrupt_enabler.h"
+
+/*
+    Deques
+	top and bottom only ever grow; the jobs in between, modulo the ring
+	size, are queued. The owner works at the bottom and thieves at the
+	top, both under the deque's lock, which is held for a copy of one
+	job. Each deque gets cache lines of its own so that CPUs working
+	their own queues do not bounce a shared line.
+
+	job_queued counts queued jobs over all deques, and job_idle_mask has
+	a bit for each CPU about to halt. A CPU going idle sets its bit and
+	then checks job_queued; a submitter bumps job_queued and then checks
+	the mask. Both are locked operations, so one of the two always sees
+	the other and no job is left behind with every CPU asleep.
+*/
+
+#define JOB_DEQUE_MASK	(JOB_DEQUE_SIZE - 1)
+
+struct job_deque {
+	struct spinlock lock;
+	u32int top;		/* oldest: where thieves take */
+	u32int bottom;		/* newest: where the owner pushes and pops */
+	struct job jobs[JOB_DEQUE_SIZE];
+	struct job_stats stats;
+} __attribute__((aligned(64)));
+
+static struct job_deque job_deques[CPU_MAX] = {
+	[0 ... CPU_MAX - 1] = { .lock = SPINLOCK_INIT("job deque") }
+};
+static volatile u32int job_queued = 0;
+static volatile u32int job_idle_mask = 0;
+
+static u32int job_push(u32int cpu, const struct job* job)
+{
+	struct job_deque* deque = &job_deques[cpu];
+	u32int flags = spin_lock_irqsave(&deque->lock);
+
+	if (deque->bottom - deque->top == JOB_DEQUE_SIZE) {
+		spin_unlock_irqrestore(&deque->lock, flags);
+		return 0;
+	}
+	deque->jobs[deque->bottom & JOB_DEQUE_MASK] = *job;
+	deque->bottom++;
+	atomic_add(&job_queued, 1);
+	spin_unlock_irqrestore(&deque->lock, flags);
+	return 1;
+}
+
+/* Takes the newest job (owner) or the oldest (thief) */
+static u32int job_take_from(u32int cpu, struct job* job, u32int newest)
+{
+	struct job_deque* deque = &job_deques[cpu];
+	u32int flags;
+
+	if (deque->bottom == deque->top) {
+		return 0; // Not worth the lock
+	}
+
+	flags = spin_lock_irqsave(&deque->lock);
+	if (deque->bottom == deque->top) {
+		spin_unlock_irqrestore(&deque->lock, flags);
+		return 0;
+	}
+	if (newest) {
+		deque->bottom--;
+		*job = deque->jobs[deque->bottom & JOB_DEQUE_MASK];
+	} else {
+		*job = deque->jobs[deque->top & JOB_DEQUE_MASK];
+		deque->top++;
+	}
+	atomic_add(&job_queued, (u32int) -1);
+	spin_unlock_irqrestore(&deque->lock, flags);
+	return 1;
+}
+
+/* Own deque first, then the others in turn, starting with the next CPU */
+static u32int job_take(u32int cpu, struct job* job)
+{
+	u32int count = smp_cpu_count();
+	u32int victim;
+	u32int i;
+
+	if (job_take_from(cpu, job, 1)) {
+		return 1;
+	}
+	for (i = 1; i < count; i++) {
+		victim = (cpu + i) % count;
+		if (job_take_from(victim, job, 0)) {
+			job_deques[cpu].stats.stolen++;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void job_execute(u32int cpu, struct job* job)
+{
+	if (job->range) {
+		job->range(job->first, job->end, job->data);
+	} else {
+		job->function(job->data);
+	}
+	job_deques[cpu].stats.run++;
+	if (job->group) {
+		atomic_add(&job->group->pending, (u32int) -1);
+	}
+}
+
+static void job_wake_idle(void)
+{
+	u32int idle = job_idle_mask;
+	u32int cpu;
+
+	if (!idle) {
+		return;
+	}
+	// Each sleeper needs one IPI; whoever finds its bit clear again is awake
+	idle = atomic_swap(&job_idle_mask, 0);
+	for (cpu = 0; idle; cpu++, idle >>= 1) {
+		if (idle & 1) {
+			smp_wake(cpu);
+		}
+	}
+}
+
+static void job_enqueue(struct job* job)
+{
+	u32int cpu = cpu_current_id();
+
+	if (job->group) {
+		atomic_add(&job->group->pending, 1);
+	}
+	if (!job_push(cpu, job)) {
+		job_execute(cpu, job);
+		return;
+	}
+	job_wake_idle();
+}
+
+void job_submit(struct job_group* group, void (*function)(void* data), void* data)
+{
+	struct job job;
+
+	job.function = function;
+	job.range = 0;
+	job.data = data;
+	job.first = 0;
+	job.end = 0;
+	job.group = group;
+	job_enqueue(&job);
+}
+
+void job_wait(struct job_group* group)
+{
+	u32int cpu = cpu_current_id();
+	struct job job;
+
+	while (group->pending) {
+		if (job_take(cpu, &job)) {
+			job_execute(cpu, &job);
+		} else {
+			cpu_relax(); // The last jobs are running elsewhere
+		}
+	}
+}
+
+void parallel_for(u32int count, void (*body)(u32int first, u32int end, void* data), void* data)
+{
+	struct job_group group = JOB_GROUP_INIT;
+	u32int chunks = smp_cpu_count() * JOB_CHUNKS_PER_CPU;
+	struct job job;
+	u32int size;
+
+	if (chunks > count) {
+		chunks = count;
+	}
+	if (chunks <= 1) {
+		if (count) {
+			body(0, count, data);
+		}
+		return;
+	}
+
+	size = (count + chunks - 1) / chunks;
+	job.function = 0;
+	job.range = body;
+	job.data = data;
+	job.group = &group;
+	for (job.first = 0; job.first < count; job.first += size) {
+		job.end = count - job.first > size ? job.first + size : count;
+		job_enqueue(&job);
+	}
+	job_wait(&group);
+}
+
+void job_worker(u32int cpu)
+{
+	struct job job;
+
+	enable_hardware_interrupts();
+	for (;;) {
+		if (job_take(cpu, &job)) {
+			job_execute(cpu, &job);
+			continue;
+		}
+
+		disable_hardware_interrupts();
+		atomic_or(&job_idle_mask, 1 << cpu);
+		if (job_queued == 0) {
+			job_deques[cpu].stats.sleeps++;
+			asm volatile("sti; hlt"); // The wakeup IPI cannot slip in between
+		}
+		atomic_and(&job_idle_mask, ~(1 << cpu));
+		enable_hardware_interrupts();
+	}
+}
+
+void job_get_stats(u32int cpu, struct job_stats* stats)
+{
+	*stats = job_deques[cpu].stats;
+}
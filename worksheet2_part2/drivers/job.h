@@ -0,0 +1,78 @@
+#ifndef INCLUDE_JOB_H
+#define INCLUDE_JOB_H
+
+#include "type.h"
+
+/*
+    Work-stealing job pool, run by every online CPU.
+
+    Each CPU has a deque of jobs. The CPU that submits a job pushes it on
+    its own deque and takes work back from the same end, newest first,
+    while it is still warm in the cache; a CPU that runs out steals the
+    oldest job from another's deque, which tends to be the biggest piece
+    left. Application processors do nothing but run jobs and halt when
+    there are none; submitting a job wakes them with an IPI.
+
+    Jobs run with interrupts enabled but must not block: no sleeping,
+    waiting for input or calling into the scheduler. The page and slab
+    allocators, the framebuffer and the event queue take locks
+    (spinlock.h) and can be used from any CPU, as can the page tables
+    and demand paging, which are locked and shoot down the other CPUs'
+    TLBs from wherever they run. Threads and timers still belong to the
+    boot CPU alone.
+
+    Without application processors everything still works: job_wait() and
+    parallel_for() run the jobs on the calling CPU.
+*/
+#define JOB_DEQUE_SIZE		256	/* power of two */
+#define JOB_CHUNKS_PER_CPU	4	/* parallel_for() pieces, for balance */
+
+/* Counts the jobs of a batch still to run */
+struct job_group {
+	volatile u32int pending;
+};
+
+#define JOB_GROUP_INIT	{ 0 }
+
+struct job {
+	void (*function)(void* data);
+	void (*range)(u32int first, u32int end, void* data);	/* parallel_for() */
+	void* data;
+	u32int first;
+	u32int end;
+	struct job_group* group;
+};
+
+struct job_stats {
+	u32int run;	/* jobs this CPU ran */
+	u32int stolen;	/* of which taken from another CPU's deque */
+	u32int sleeps;	/* times it halted with nothing to do */
+};
+
+/** job_submit:
+ *  Queues function(data) on the calling CPU and counts it in group, which
+ *  may be 0 for a job nobody waits for. Runs it at once if the deque is
+ *  full.
+ */
+void job_submit(struct job_group* group, void (*function)(void* data), void* data);
+
+/** job_wait:
+ *  Runs queued jobs, its own or stolen ones, until every job of group has
+ *  finished.
+ */
+void job_wait(struct job_group* group);
+
+/** parallel_for:
+ *  Calls body(first, end, data) over disjoint ranges covering 0..count-1,
+ *  spread over the online CPUs, and returns when all have run.
+ */
+void parallel_for(u32int count, void (*body)(u32int first, u32int end, void* data), void* data);
+
+/** job_worker:
+ *  The main loop of an application processor. Never returns.
+ */
+void job_worker(u32int cpu) __attribute__((noreturn));
+
+void job_get_stats(u32int cpu, struct job_stats* stats);
+
+#endif /* INCLUDE_JOB_H */
@@ -1,7 +1,22 @@
 #include "io.h"
 #include "framebuffer.h"
+#include "keyboard.h"
+#include "input.h"
+#include "interrupts.h"
+#include "init.h"
 
 #define KEYBOARD_DATA_PORT 0x60
+#define KEYBOARD_STATUS_PORT 0x64
+#define KEYBOARD_OUTPUT_FULL 0x01
+#define KEYBOARD_IRQ 1
+
+static u32int keyboard_drain(u32int budget);
+
+static struct input_device keyboard_input = {
+	.name = "keyboard",
+	.irq = KEYBOARD_IRQ,
+	.drain = keyboard_drain,
+};
 
 /** read_scan_code:
  *  Reads a scan code from the keyboard
@@ -100,3 +115,34 @@ u8int keyboard_scan_code_to_ascii(u8int scan_code)
         default: return 0;  // Unknown scan code
     }
 }
+
+/** keyboard_drain:
+ *  Reads up to budget pending scan codes and feeds the key presses that map
+ *  to a character into the terminal input buffer.
+ *
+ *  @return The number of scan codes read
+ */
+static u32int keyboard_drain(u32int budget)
+{
+    u32int count = 0;
+    u8int input;
+    u8int ascii;
+
+    while (count < budget && (inb(KEYBOARD_STATUS_PORT) & KEYBOARD_OUTPUT_FULL)) {
+        input = keyboard_read_scan_code();
+        count++;
+        // Only process if it's not a break code (key press, not release)
+        if (!(input & 0x80) && input <= KEYBOARD_MAX_ASCII) {
+            ascii = keyboard_scan_code_to_ascii(input);
+            if (ascii != 0) {
+                input_receive_char(ascii);
+            }
+        }
+    }
+    return count;
+}
+
+void __init keyboard_init(void)
+{
+    input_register(&keyboard_input);
+}
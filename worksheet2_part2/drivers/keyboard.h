@@ -9,5 +9,8 @@ u8int keyboard_read_scan_code(void);
 
 u8int keyboard_scan_code_to_ascii(u8int);
 
+/* Registers the keyboard as an input device and unmasks IRQ1 */
+void keyboard_init(void);
+
 #endif /* INCLUDE_KEYBOARD_H */
 
@@ -0,0 +1,363 @@
+#include "membench.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "clock.h"
+#include "slab.h"
+#include "job.h"
+#include "smp.h"
+#include "framebuffer.h"
+
+#define MEMBENCH_WIDTHS		4
+#define MEMBENCH_SSE		3	/* width index needing SSE2 */
+#define MEMBENCH_BYTES		(PMM_PAGE_SIZE << MEMBENCH_ORDER)
+#define MEMBENCH_COLUMN		8
+
+static char* membench_width_names[MEMBENCH_WIDTHS] = { "byte", "dword", "rep", "sse2" };
+
+/* There is no rep string instruction worth timing for reads */
+static u32int (*membench_reads[MEMBENCH_WIDTHS])(const void* buffer, u32int bytes) = {
+	membench_read_byte, membench_read_dword, 0, membench_read_sse
+};
+static void (*membench_writes[MEMBENCH_WIDTHS])(void* buffer, u32int bytes) = {
+	membench_write_byte, membench_write_dword, membench_write_rep, membench_write_sse
+};
+static void (*membench_copies[MEMBENCH_WIDTHS])(void* destination, const void* source, u32int bytes) = {
+	membench_copy_byte, membench_copy_dword, membench_copy_rep, membench_copy_sse
+};
+
+/* Output ********************************************************************/
+
+/* Writes a number right aligned in a MEMBENCH_COLUMN wide column */
+static void membench_write_column(u32int value)
+{
+	u32int digits = 1;
+	u32int rest;
+
+	for (rest = value; rest >= 10; rest /= 10) {
+		digits++;
+	}
+	for (; digits < MEMBENCH_COLUMN; digits++) {
+		fb_write_char(' ', FB_WHITE, FB_BLACK);
+	}
+	fb_write_number(value, FB_WHITE, FB_BLACK);
+}
+
+static void membench_write_label(char* label)
+{
+	u32int length = 0;
+
+	fb_write_string(label, FB_WHITE, FB_BLACK);
+	while (label[length]) {
+		length++;
+	}
+	for (; length < MEMBENCH_COLUMN; length++) {
+		fb_write_char(' ', FB_WHITE, FB_BLACK);
+	}
+}
+
+/* Bandwidth *****************************************************************/
+
+static u32int membench_mb_per_s(u64int nanoseconds)
+{
+	u32int remainder;
+
+	if (nanoseconds == 0) {
+		nanoseconds = 1;
+	}
+	// bytes per ns is GB/s
+	return (u32int) cpu_div_u64((u64int) MEMBENCH_BYTES * 1000, (u32int) nanoseconds, &remainder);
+}
+
+/* Best of MEMBENCH_RUNS for one operation: 0 read, 1 write, 2 copy */
+static u64int membench_time(u32int operation, u32int width, u8int* destination, u8int* source)
+{
+	u64int best = 0;
+	u64int start;
+	u64int elapsed;
+	u32int run;
+
+	for (run = 0; run < MEMBENCH_RUNS; run++) {
+		start = clock_ns();
+		if (operation == 0) {
+			membench_reads[width](source, MEMBENCH_BYTES);
+		} else if (operation == 1) {
+			membench_writes[width](destination, MEMBENCH_BYTES);
+		} else {
+			membench_copies[width](destination, source, MEMBENCH_BYTES);
+		}
+		elapsed = clock_ns() - start;
+		if (run == 0 || elapsed < best) {
+			best = elapsed;
+		}
+	}
+	return best;
+}
+
+static void membench_bandwidth(u8int* destination, u8int* source, u32int sse)
+{
+	static char* operations[3] = { "read", "write", "copy" };
+	u32int operation;
+	u32int width;
+
+	fb_write_string("Bandwidth, MB/s over 1 MiB:\n", FB_LIGHT_CYAN, FB_BLACK);
+	membench_write_label("");
+	for (width = 0; width < MEMBENCH_WIDTHS; width++) {
+		fb_write_string("   ", FB_WHITE, FB_BLACK);
+		membench_write_label(membench_width_names[width]);
+	}
+	fb_newline();
+
+	for (operation = 0; operation < 3; operation++) {
+		membench_write_label(operations[operation]);
+		for (width = 0; width < MEMBENCH_WIDTHS; width++) {
+			fb_write_string("   ", FB_WHITE, FB_BLACK);
+			if ((operation == 0 && !membench_reads[width]) || (width == MEMBENCH_SSE && !sse)) {
+				membench_write_label("       -");
+				continue;
+			}
+			membench_write_column(membench_mb_per_s(membench_time(operation, width, destination, source)));
+		}
+		fb_newline();
+	}
+}
+
+/* Latency *******************************************************************/
+
+static u32int membench_random(u32int* state)
+{
+	// xorshift32
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/*
+    Links the cache lines of the first size bytes into one cycle in random
+    order. Each line's first word starts out as its own index; Sattolo's
+    shuffle turns the indices into a single cycle (line i is followed by
+    line index[i]), and the indices are then replaced by addresses.
+*/
+static void membench_build_chain(u8int* buffer, u32int size, u32int* seed)
+{
+	u32int lines = size / MEMBENCH_LINE;
+	u32int* line;
+	u32int* other;
+	u32int swap;
+	u32int i;
+
+	for (i = 0; i < lines; i++) {
+		*(u32int*) (buffer + i * MEMBENCH_LINE) = i;
+	}
+	for (i = lines - 1; i > 0; i--) {
+		line = (u32int*) (buffer + i * MEMBENCH_LINE);
+		other = (u32int*) (buffer + membench_random(seed) % i * MEMBENCH_LINE);
+		swap = *line;
+		*line = *other;
+		*other = swap;
+	}
+	for (i = 0; i < lines; i++) {
+		line = (u32int*) (buffer + i * MEMBENCH_LINE);
+		*line = (u32int) (buffer + *line * MEMBENCH_LINE);
+	}
+}
+
+static void membench_latency(u8int* buffer, u32int size)
+{
+	u32int seed = (u32int) cycles() | 1;
+	u64int best;
+	u64int start;
+	u64int elapsed;
+	u32int remainder;
+	u32int tenths;
+	u32int set;
+	u32int run;
+
+	fb_write_string("Latency, ns per dependent load:\n", FB_LIGHT_CYAN, FB_BLACK);
+	for (set = MEMBENCH_MIN_SET; set <= size; set *= 4) {
+		membench_build_chain(buffer, set, &seed);
+		best = 0;
+		for (run = 0; run < MEMBENCH_RUNS; run++) {
+			start = clock_ns();
+			membench_chase(buffer, MEMBENCH_CHASE_STEPS);
+			elapsed = clock_ns() - start;
+			if (run == 0 || elapsed < best) {
+				best = elapsed;
+			}
+		}
+
+		tenths = (u32int) cpu_div_u64(best * 10, MEMBENCH_CHASE_STEPS, &remainder);
+		membench_write_column(set / 1024);
+		fb_write_string(" KiB: ", FB_WHITE, FB_BLACK);
+		fb_write_number(tenths / 10, FB_WHITE, FB_BLACK);
+		fb_write_string(".", FB_WHITE, FB_BLACK);
+		fb_write_number(tenths % 10, FB_WHITE, FB_BLACK);
+		fb_write_string(" ns\n", FB_WHITE, FB_BLACK);
+	}
+}
+
+void membench_run(void)
+{
+	u32int sse = cpu_enable_sse();
+	u32int source = pmm_alloc_pages(MEMBENCH_ORDER);
+	u32int destination = pmm_alloc_pages(MEMBENCH_ORDER);
+	u32int chase = 0;
+	u32int order;
+
+	if (!source || !destination) {
+		fb_write_string("Not enough memory for the benchmark buffers\n", FB_LIGHT_RED, FB_BLACK);
+	} else {
+		// Touch both buffers first so no run pays for anything else
+		membench_write_rep(PMM_PHYS_TO_VIRT(source), MEMBENCH_BYTES);
+		membench_write_rep(PMM_PHYS_TO_VIRT(destination), MEMBENCH_BYTES);
+		membench_bandwidth(PMM_PHYS_TO_VIRT(destination), PMM_PHYS_TO_VIRT(source), sse);
+	}
+	if (source) {
+		pmm_free_pages(source, MEMBENCH_ORDER);
+	}
+	if (destination) {
+		pmm_free_pages(destination, MEMBENCH_ORDER);
+	}
+
+	// As large a working set as memory allows
+	for (order = MEMBENCH_CHASE_ORDER; order > 0 && !chase; order--) {
+		chase = pmm_alloc_pages(order);
+	}
+	if (!chase) {
+		fb_write_string("Not enough memory for the latency test\n", FB_LIGHT_RED, FB_BLACK);
+		return;
+	}
+	order++;
+	membench_latency(PMM_PHYS_TO_VIRT(chase), PMM_PAGE_SIZE << order);
+	pmm_free_pages(chase, order);
+}
+
+/* Memory test ***************************************************************/
+
+#define MEMBENCH_PATTERN_FIXED		0
+#define MEMBENCH_PATTERN_ADDRESS	1	/* each word holds its physical address */
+#define MEMBENCH_PATTERN_WALKING	2	/* a single one bit moving along */
+
+static u32int membench_pattern(u32int kind, u32int value, u32int physical, u32int word)
+{
+	if (kind == MEMBENCH_PATTERN_ADDRESS) {
+		return physical + word * 4;
+	}
+	if (kind == MEMBENCH_PATTERN_WALKING) {
+		return 1 << (word & 31);
+	}
+	return value;
+}
+
+/* One MiB under test, and what went wrong in it */
+struct membench_block {
+	u32int physical;
+	u32int errors;
+	u32int bad_address;	/* first word that read back wrong */
+	u32int expected;
+	u32int actual;
+};
+
+/* Fills a block with a pattern and checks it; the first bad word is recorded */
+static void membench_test_pattern(struct membench_block* result, u32int kind, u32int value)
+{
+	u32int* block = PMM_PHYS_TO_VIRT(result->physical);
+	u32int words = MEMBENCH_BYTES / 4;
+	u32int expected;
+	u32int i;
+
+	for (i = 0; i < words; i++) {
+		block[i] = membench_pattern(kind, value, result->physical, i);
+	}
+	for (i = 0; i < words; i++) {
+		expected = membench_pattern(kind, value, result->physical, i);
+		if (block[i] == expected) {
+			continue;
+		}
+		if (!result->errors) {
+			result->bad_address = result->physical + i * 4;
+			result->expected = expected;
+			result->actual = block[i];
+		}
+		result->errors++;
+	}
+}
+
+/* parallel_for() body: runs every pattern over blocks first..end-1 */
+static void membench_test_blocks(u32int first, u32int end, void* data)
+{
+	static const u32int fixed[] = { 0x00000000, 0xFFFFFFFF, 0x55555555, 0xAAAAAAAA };
+	struct membench_block* blocks = data;
+	u32int i;
+
+	for (; first < end; first++) {
+		for (i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+			membench_test_pattern(&blocks[first], MEMBENCH_PATTERN_FIXED, fixed[i]);
+		}
+		membench_test_pattern(&blocks[first], MEMBENCH_PATTERN_ADDRESS, 0);
+		membench_test_pattern(&blocks[first], MEMBENCH_PATTERN_WALKING, 0);
+	}
+}
+
+u32int membench_test(u32int megabytes)
+{
+	struct membench_block* blocks;
+	struct membench_block* bad = 0;
+	u32int errors = 0;
+	u32int count;
+	u64int start;
+	u32int i;
+
+	// No more blocks than free memory can fill, which also keeps the size in 32 bits
+	if (megabytes > pmm_free_page_count() >> MEMBENCH_ORDER) {
+		megabytes = pmm_free_page_count() >> MEMBENCH_ORDER;
+	}
+	blocks = megabytes ? kmalloc(megabytes * sizeof(*blocks)) : 0;
+	if (!blocks) {
+		fb_write_string("memtest: out of memory\n", FB_LIGHT_RED, FB_BLACK);
+		return 0;
+	}
+
+	// Every block is held until the end, so each allocation is a different one
+	for (count = 0; count < megabytes; count++) {
+		blocks[count].physical = pmm_alloc_pages(MEMBENCH_ORDER);
+		if (!blocks[count].physical) {
+			break;
+		}
+		blocks[count].errors = 0;
+	}
+
+	start = clock_ns();
+	parallel_for(count, membench_test_blocks, blocks);
+	start = clock_ns() - start;
+
+	for (i = 0; i < count; i++) {
+		if (blocks[i].errors && !bad) {
+			bad = &blocks[i];
+		}
+		errors += blocks[i].errors;
+		pmm_free_pages(blocks[i].physical, MEMBENCH_ORDER);
+	}
+
+	if (bad) {
+		fb_write_string("Error at ", FB_LIGHT_RED, FB_BLACK);
+		fb_write_hex(bad->bad_address, FB_LIGHT_RED, FB_BLACK);
+		fb_write_string(": wrote ", FB_LIGHT_RED, FB_BLACK);
+		fb_write_hex(bad->expected, FB_LIGHT_RED, FB_BLACK);
+		fb_write_string(", read ", FB_LIGHT_RED, FB_BLACK);
+		fb_write_hex(bad->actual, FB_LIGHT_RED, FB_BLACK);
+		fb_newline();
+	}
+	kfree(blocks);
+
+	fb_write_string("Tested ", FB_WHITE, FB_BLACK);
+	fb_write_number(count, FB_WHITE, FB_BLACK);
+	fb_write_string(" MiB with 6 patterns: ", FB_WHITE, FB_BLACK);
+	fb_write_number(errors, errors ? FB_LIGHT_RED : FB_LIGHT_GREEN, FB_BLACK);
+	fb_write_string(" errors, ", FB_WHITE, FB_BLACK);
+	fb_write_number((u32int) cpu_div_u64(start, 1000000, 0), FB_WHITE, FB_BLACK);
+	fb_write_string(" ms on ", FB_WHITE, FB_BLACK);
+	fb_write_number(smp_cpu_count(), FB_WHITE, FB_BLACK);
+	fb_write_string(" CPUs\n", FB_WHITE, FB_BLACK);
+	return errors;
+}
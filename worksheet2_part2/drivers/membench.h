@@ -0,0 +1,54 @@
+#ifndef INCLUDE_MEMBENCH_H
+#define INCLUDE_MEMBENCH_H
+
+#include "type.h"
+
+/*
+    Memory system characterisation.
+
+    membench_run() times sequential reads, writes and copies over a buffer
+    well beyond the caches, once per access width (byte, dword, rep
+    string instructions, SSE2 when the CPU has it), and the latency of
+    dependent loads over working sets from 4 KiB up, using a randomly
+    ordered pointer chain so the prefetcher cannot help.
+
+    membench_test() fills free memory with test patterns and reads them
+    back, one MiB block per job, so every CPU tests blocks of its own.
+*/
+#define MEMBENCH_ORDER		8	/* bandwidth buffers: 1 MiB each */
+#define MEMBENCH_CHASE_ORDER	10	/* largest latency working set: 4 MiB */
+#define MEMBENCH_MIN_SET	4096
+#define MEMBENCH_LINE		64	/* one chain link per cache line */
+#define MEMBENCH_CHASE_STEPS	(1 << 20)
+#define MEMBENCH_RUNS		3	/* the best run is reported */
+#define MEMBENCH_TEST_MB	4	/* memtest default */
+
+/** membench_run:
+ *  Runs the bandwidth and latency measurements and prints MB/s and
+ *  ns/access.
+ */
+void membench_run(void);
+
+/** membench_test:
+ *  Tests megabytes of free memory, 1 MiB at a time, with fixed, address
+ *  and walking one patterns, spread over the online CPUs.
+ *
+ *  @return the number of words that read back wrong
+ */
+u32int membench_test(u32int megabytes);
+
+/* Primitives, in membench_asm.s */
+u32int membench_read_byte(const void* buffer, u32int bytes);
+u32int membench_read_dword(const void* buffer, u32int bytes);
+u32int membench_read_sse(const void* buffer, u32int bytes);
+void membench_write_byte(void* buffer, u32int bytes);
+void membench_write_dword(void* buffer, u32int bytes);
+void membench_write_rep(void* buffer, u32int bytes);
+void membench_write_sse(void* buffer, u32int bytes);
+void membench_copy_byte(void* destination, const void* source, u32int bytes);
+void membench_copy_dword(void* destination, const void* source, u32int bytes);
+void membench_copy_rep(void* destination, const void* source, u32int bytes);
+void membench_copy_sse(void* destination, const void* source, u32int bytes);
+void* membench_chase(void* start, u32int steps);
+
+#endif /* INCLUDE_MEMBENCH_H */
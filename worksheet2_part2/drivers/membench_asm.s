@@ -0,0 +1,198 @@
+; Memory benchmark primitives (see membench.h). Written in assembly so the
+; loops measure the access width they claim to, whatever the compiler does.
+; All follow cdecl: arguments on the stack, ebx/esi/edi/ebp preserved.
+; Byte counts are multiples of 64; SSE versions need 16 byte aligned
+; buffers and SSE2 enabled (cpu_enable_sse).
+
+MEMBENCH_FILL   equ 0xA5A5A5A5
+
+section .text
+
+global  membench_read_byte
+global  membench_read_dword
+global  membench_read_sse
+global  membench_write_byte
+global  membench_write_dword
+global  membench_write_rep
+global  membench_write_sse
+global  membench_copy_byte
+global  membench_copy_dword
+global  membench_copy_rep
+global  membench_copy_sse
+global  membench_chase
+
+; u32int membench_read_*(const void* buffer, u32int bytes)
+membench_read_byte:
+        mov     edx, [esp + 4]
+        mov     ecx, [esp + 8]
+        xor     eax, eax
+.loop:
+        add     al, [edx]
+        inc     edx
+        dec     ecx
+        jnz     .loop
+        ret
+
+membench_read_dword:
+        mov     edx, [esp + 4]
+        mov     ecx, [esp + 8]
+        shr     ecx, 2
+        xor     eax, eax
+.loop:
+        add     eax, [edx]
+        add     edx, 4
+        dec     ecx
+        jnz     .loop
+        ret
+
+membench_read_sse:
+        mov     edx, [esp + 4]
+        mov     ecx, [esp + 8]
+        shr     ecx, 6
+        xor     eax, eax
+.loop:
+        movdqa  xmm0, [edx]
+        movdqa  xmm1, [edx + 16]
+        movdqa  xmm2, [edx + 32]
+        movdqa  xmm3, [edx + 48]
+        add     edx, 64
+        dec     ecx
+        jnz     .loop
+        ret
+
+; void membench_write_*(void* buffer, u32int bytes)
+membench_write_byte:
+        mov     edx, [esp + 4]
+        mov     ecx, [esp + 8]
+        mov     eax, MEMBENCH_FILL
+.loop:
+        mov     [edx], al
+        inc     edx
+        dec     ecx
+        jnz     .loop
+        ret
+
+membench_write_dword:
+        mov     edx, [esp + 4]
+        mov     ecx, [esp + 8]
+        shr     ecx, 2
+        mov     eax, MEMBENCH_FILL
+.loop:
+        mov     [edx], eax
+        add     edx, 4
+        dec     ecx
+        jnz     .loop
+        ret
+
+membench_write_rep:
+        push    edi
+        mov     edi, [esp + 8]
+        mov     ecx, [esp + 12]
+        shr     ecx, 2
+        mov     eax, MEMBENCH_FILL
+        cld
+        rep     stosd
+        pop     edi
+        ret
+
+; Non-temporal stores: the data bypasses the caches on its way out
+membench_write_sse:
+        mov     edx, [esp + 4]
+        mov     ecx, [esp + 8]
+        shr     ecx, 6
+        pcmpeqd xmm0, xmm0
+.loop:
+        movntdq [edx], xmm0
+        movntdq [edx + 16], xmm0
+        movntdq [edx + 32], xmm0
+        movntdq [edx + 48], xmm0
+        add     edx, 64
+        dec     ecx
+        jnz     .loop
+        sfence
+        ret
+
+; void membench_copy_*(void* destination, const void* source, u32int bytes)
+membench_copy_byte:
+        push    esi
+        push    edi
+        mov     edi, [esp + 12]
+        mov     esi, [esp + 16]
+        mov     ecx, [esp + 20]
+.loop:
+        mov     al, [esi]
+        mov     [edi], al
+        inc     esi
+        inc     edi
+        dec     ecx
+        jnz     .loop
+        pop     edi
+        pop     esi
+        ret
+
+membench_copy_dword:
+        push    esi
+        push    edi
+        mov     edi, [esp + 12]
+        mov     esi, [esp + 16]
+        mov     ecx, [esp + 20]
+        shr     ecx, 2
+.loop:
+        mov     eax, [esi]
+        mov     [edi], eax
+        add     esi, 4
+        add     edi, 4
+        dec     ecx
+        jnz     .loop
+        pop     edi
+        pop     esi
+        ret
+
+membench_copy_rep:
+        push    esi
+        push    edi
+        mov     edi, [esp + 12]
+        mov     esi, [esp + 16]
+        mov     ecx, [esp + 20]
+        shr     ecx, 2
+        cld
+        rep     movsd
+        pop     edi
+        pop     esi
+        ret
+
+membench_copy_sse:
+        push    esi
+        push    edi
+        mov     edi, [esp + 12]
+        mov     esi, [esp + 16]
+        mov     ecx, [esp + 20]
+        shr     ecx, 6
+.loop:
+        movdqa  xmm0, [esi]
+        movdqa  xmm1, [esi + 16]
+        movdqa  xmm2, [esi + 32]
+        movdqa  xmm3, [esi + 48]
+        movntdq [edi], xmm0
+        movntdq [edi + 16], xmm1
+        movntdq [edi + 32], xmm2
+        movntdq [edi + 48], xmm3
+        add     esi, 64
+        add     edi, 64
+        dec     ecx
+        jnz     .loop
+        sfence
+        pop     edi
+        pop     esi
+        ret
+
+; void* membench_chase(void* start, u32int steps) - follows a pointer chain;
+; every load depends on the one before, so each costs a full access latency
+membench_chase:
+        mov     eax, [esp + 4]
+        mov     ecx, [esp + 8]
+.loop:
+        mov     eax, [eax]
+        dec     ecx
+        jnz     .loop
+        ret
@@ -0,0 +1,49 @@
+#ifndef INCLUDE_MULTIBOOT_H
+#define INCLUDE_MULTIBOOT_H
+
+#include "type.h"
+
+/*
+    Multiboot (version 0.6.96) boot information, as left by GRUB in EBX.
+    Only the fields the kernel reads are spelled out.
+*/
+#define MULTIBOOT_BOOTLOADER_MAGIC	0x2BADB002
+
+/* multiboot_info.flags: which fields are valid */
+#define MULTIBOOT_INFO_MEMORY		(1 << 0)
+#define MULTIBOOT_INFO_CMDLINE		(1 << 2)
+#define MULTIBOOT_INFO_MODULES		(1 << 3)
+#define MULTIBOOT_INFO_MEMORY_MAP	(1 << 6)
+
+/* multiboot_mmap_entry.type */
+#define MULTIBOOT_MEMORY_AVAILABLE	1
+
+struct multiboot_info {
+	u32int flags;
+	u32int mem_lower;	/* KiB below 1 MiB */
+	u32int mem_upper;	/* KiB above 1 MiB, up to the first hole */
+	u32int boot_device;
+	u32int cmdline;
+	u32int mods_count;
+	u32int mods_addr;
+	u32int syms[4];
+	u32int mmap_length;
+	u32int mmap_addr;
+} __attribute__((packed));
+
+/* Entries are size bytes long, not counting the size field itself */
+struct multiboot_mmap_entry {
+	u32int size;
+	u64int base;
+	u64int length;
+	u32int type;
+} __attribute__((packed));
+
+struct multiboot_module {
+	u32int start;
+	u32int end;
+	u32int string;
+	u32int reserved;
+} __attribute__((packed));
+
+#endif /* INCLUDE_MULTIBOOT_H */
@@ -0,0 +1,450 @@
+#include "pagefault.h"
+#include "paging.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "zeropool.h"
+#include "framebuffer.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "init.h"
+
+/*
+    Shared frames
+	A frame mapped more than once by pagefault_share() has an entry in a
+	small hash table (linear probing, keyed by physical address) counting
+	its mappings. Frames without an entry have exactly one mapping, so the
+	table only ever holds what is actually shared. The zero page is never
+	counted or freed.
+
+	Locking
+	The regions, the share table and the lazy window are changed under
+	pagefault_lock, by callers and by faults on any CPU alike. It is
+	taken before paging_lock and, like it, with smp_lock_irqsave(). A
+	fault only decides what to do once it holds the lock: by then
+	another CPU may have resolved the same page already.
+*/
+
+struct pagefault_region {
+	u32int start;
+	u32int end;		/* 0 for a free slot */
+	u32int flags;
+};
+
+struct pagefault_shared {
+	u32int frame;		/* 0 for a free slot; frame 0 is never allocated */
+	u32int sharers;
+};
+
+#define PAGEFAULT_SHARED_MASK	(PAGEFAULT_SHARED_FRAMES - 1)
+
+static struct pagefault_region pagefault_regions[PAGEFAULT_MAX_REGIONS];
+static struct pagefault_shared pagefault_shared_frames[PAGEFAULT_SHARED_FRAMES];
+static u32int pagefault_shared_count = 0;
+static u32int pagefault_zero_frame = 0;
+static u32int pagefault_lazy_next = PAGING_LAZY_BASE;
+static struct pagefault_stats pagefault_counts;
+static struct spinlock pagefault_lock = SPINLOCK_INIT("page faults");
+
+void __init pagefault_init(void)
+{
+	pagefault_zero_frame = zeropool_alloc();
+}
+
+/* Share table ***************************************************************/
+
+static u32int pagefault_hash(u32int frame)
+{
+	return ((frame >> PMM_PAGE_SHIFT) * 2654435761U) >> 22 & PAGEFAULT_SHARED_MASK;
+}
+
+static struct pagefault_shared* pagefault_shared_find(u32int frame)
+{
+	u32int slot = pagefault_hash(frame);
+
+	while (pagefault_shared_frames[slot].frame) {
+		if (pagefault_shared_frames[slot].frame == frame) {
+			return &pagefault_shared_frames[slot];
+		}
+		slot = (slot + 1) & PAGEFAULT_SHARED_MASK;
+	}
+	return 0;
+}
+
+static struct pagefault_shared* pagefault_shared_insert(u32int frame)
+{
+	u32int slot = pagefault_hash(frame);
+
+	// Keep a free slot so lookups always terminate
+	if (pagefault_shared_count == PAGEFAULT_SHARED_FRAMES - 1) {
+		return 0;
+	}
+	while (pagefault_shared_frames[slot].frame) {
+		slot = (slot + 1) & PAGEFAULT_SHARED_MASK;
+	}
+	pagefault_shared_frames[slot].frame = frame;
+	pagefault_shared_frames[slot].sharers = 1;
+	pagefault_shared_count++;
+	return &pagefault_shared_frames[slot];
+}
+
+/* Removes an entry, moving later entries of its probe run back into the gap */
+static void pagefault_shared_remove(struct pagefault_shared* entry)
+{
+	u32int gap = entry - pagefault_shared_frames;
+	u32int slot = gap;
+	u32int home;
+
+	pagefault_shared_frames[gap].frame = 0;
+	pagefault_shared_count--;
+
+	for (;;) {
+		slot = (slot + 1) & PAGEFAULT_SHARED_MASK;
+		if (!pagefault_shared_frames[slot].frame) {
+			return;
+		}
+		home = pagefault_hash(pagefault_shared_frames[slot].frame);
+		// Entries whose home lies cyclically in (gap, slot] stay put
+		if (gap < slot ? (home <= gap || home > slot) : (home <= gap && home > slot)) {
+			pagefault_shared_frames[gap] = pagefault_shared_frames[slot];
+			pagefault_shared_frames[slot].frame = 0;
+			gap = slot;
+		}
+	}
+}
+
+/* Drops one mapping of a frame, freeing it with the last one */
+static void pagefault_put_frame(u32int frame)
+{
+	struct pagefault_shared* entry;
+
+	if (frame == pagefault_zero_frame) {
+		return;
+	}
+	entry = pagefault_shared_find(frame);
+	if (entry && --entry->sharers > 0) {
+		return;
+	}
+	if (entry) {
+		pagefault_shared_remove(entry);
+	}
+	pmm_free_page(frame);
+}
+
+/* Regions *******************************************************************/
+
+static struct pagefault_region* pagefault_find_region(u32int address)
+{
+	u32int i;
+
+	for (i = 0; i < PAGEFAULT_MAX_REGIONS; i++) {
+		if (pagefault_regions[i].end && address >= pagefault_regions[i].start
+		    && address < pagefault_regions[i].end) {
+			return &pagefault_regions[i];
+		}
+	}
+	return 0;
+}
+
+/* With pagefault_lock held */
+static u32int pagefault_insert_region(u32int start, u32int size, u32int flags)
+{
+	u32int i;
+
+	for (i = 0; i < PAGEFAULT_MAX_REGIONS; i++) {
+		if (!pagefault_regions[i].end) {
+			pagefault_regions[i].start = start;
+			pagefault_regions[i].end = start + size;
+			pagefault_regions[i].flags = flags & PAGING_FLAGS_MASK & ~PAGING_COW;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+u32int pagefault_add_region(u32int start, u32int size, u32int flags)
+{
+	u32int irq_flags = smp_lock_irqsave(&pagefault_lock);
+	u32int added = pagefault_insert_region(start, size, flags);
+
+	spin_unlock_irqrestore(&pagefault_lock, irq_flags);
+	return added;
+}
+
+void* pagefault_reserve(u32int size)
+{
+	u32int irq_flags = smp_lock_irqsave(&pagefault_lock);
+	u32int start = pagefault_lazy_next;
+
+	size = (size + PAGING_PAGE_SIZE - 1) & PAGING_FRAME_MASK;
+	if (!pagefault_zero_frame || size == 0 || size > PAGING_LAZY_END - start
+	    || !pagefault_insert_region(start, size, PAGING_WRITABLE)) {
+		spin_unlock_irqrestore(&pagefault_lock, irq_flags);
+		return 0;
+	}
+
+	pagefault_lazy_next += size;
+	spin_unlock_irqrestore(&pagefault_lock, irq_flags);
+	return (void*) start;
+}
+
+void pagefault_release(u32int start, u32int size)
+{
+	u32int irq_flags = smp_lock_irqsave(&pagefault_lock);
+	struct pagefault_region* region = pagefault_find_region(start);
+	u32int address;
+	u32int physical;
+
+	for (address = start; address - start < size; address += PAGING_PAGE_SIZE) {
+		physical = paging_unmap(address);
+		if (physical) {
+			pagefault_put_frame(physical);
+		}
+	}
+
+	if (region && region->start == start) {
+		// The lazy window only gets address space back from its top
+		if (region->end == pagefault_lazy_next && start >= PAGING_LAZY_BASE) {
+			pagefault_lazy_next = start;
+		}
+		region->end = 0;
+	}
+	spin_unlock_irqrestore(&pagefault_lock, irq_flags);
+}
+
+/* Copy on write *************************************************************/
+
+/* Copies a frame into a new one, mapped at destination with flags */
+static u32int pagefault_copy_frame(u32int destination, u32int frame, u32int flags)
+{
+	u32int copy = pmm_alloc_page();
+
+	if (!copy) {
+		return 0;
+	}
+	cpu_copy_page(PMM_PHYS_TO_VIRT(copy), PMM_PHYS_TO_VIRT(frame));
+	if (!paging_map(destination, copy, flags)) {
+		pmm_free_page(copy);
+		return 0;
+	}
+	return 1;
+}
+
+u32int pagefault_share(u32int destination, u32int source, u32int pages)
+{
+	u32int irq_flags = smp_lock_irqsave(&pagefault_lock);
+	struct pagefault_shared* entry;
+	u32int physical;
+	u32int frame;
+	u32int flags;
+	u32int shared_flags;
+	u32int i;
+
+	for (i = 0; i < pages; i++, source += PAGING_PAGE_SIZE, destination += PAGING_PAGE_SIZE) {
+		// Mapping over a page would leak its frame (or a sharer count)
+		if (paging_translate(destination, &flags)) {
+			break;
+		}
+		physical = paging_translate(source, &flags);
+		if (!physical) {
+			continue;
+		}
+		if (flags & PAGING_LARGE) {
+			break;
+		}
+
+		frame = physical & PAGING_FRAME_MASK;
+		flags &= ~(PAGING_ACCESSED | PAGING_DIRTY);
+		shared_flags = flags;
+		if (flags & PAGING_WRITABLE) {
+			shared_flags = (flags & ~PAGING_WRITABLE) | PAGING_COW;
+		}
+
+		if (frame == pagefault_zero_frame) {
+			if (!paging_map(destination, frame, flags)) {
+				break;
+			}
+			pagefault_counts.shared++;
+			continue;
+		}
+
+		entry = pagefault_shared_find(frame);
+		if (!entry) {
+			entry = pagefault_shared_insert(frame);
+		}
+		if (!entry) {
+			// Nowhere to count another sharer: copy now instead
+			if (!pagefault_copy_frame(destination, frame, flags)) {
+				break;
+			}
+			continue;
+		}
+
+		if (!paging_map(destination, frame, shared_flags)) {
+			if (entry->sharers == 1) {
+				pagefault_shared_remove(entry);
+			}
+			break;
+		}
+		entry->sharers++;
+		if (shared_flags != flags) {
+			paging_protect(source, shared_flags);
+		}
+		pagefault_counts.shared++;
+	}
+
+	spin_unlock_irqrestore(&pagefault_lock, irq_flags);
+	return i;
+}
+
+/* Fault handling ************************************************************/
+
+/* First touch of a demand zero page */
+static u32int pagefault_zero_fill(u32int page, u32int flags, u32int write)
+{
+	u32int frame;
+
+	if (write && !(flags & PAGING_WRITABLE)) {
+		return 0;
+	}
+
+	if (!write) {
+		// Until it is written, the page reads as the zero page
+		if (flags & PAGING_WRITABLE) {
+			flags = (flags & ~PAGING_WRITABLE) | PAGING_COW;
+		}
+		pagefault_counts.zero_page++;
+		return paging_map(page, pagefault_zero_frame, flags);
+	}
+
+	frame = zeropool_alloc();
+	if (!frame) {
+		return 0;
+	}
+	if (!paging_map(page, frame, flags)) {
+		pmm_free_page(frame);
+		return 0;
+	}
+	pagefault_counts.demand_zero++;
+	return 1;
+}
+
+/* Write to a copy on write page */
+static u32int pagefault_break_cow(u32int page, u32int frame, u32int flags)
+{
+	struct pagefault_shared* entry;
+
+	flags = (flags | PAGING_WRITABLE) & ~(PAGING_COW | PAGING_ACCESSED | PAGING_DIRTY);
+
+	if (frame == pagefault_zero_frame) {
+		frame = zeropool_alloc();
+		if (!frame) {
+			return 0;
+		}
+		if (!paging_map(page, frame, flags)) {
+			pmm_free_page(frame);
+			return 0;
+		}
+		pagefault_counts.demand_zero++;
+		return 1;
+	}
+
+	entry = pagefault_shared_find(frame);
+	if (entry && entry->sharers > 1) {
+		if (!pagefault_copy_frame(page, frame, flags)) {
+			return 0;
+		}
+		entry->sharers--;
+		pagefault_counts.cow_copies++;
+		return 1;
+	}
+
+	// Everybody else has copied already: the frame is ours
+	if (entry) {
+		pagefault_shared_remove(entry);
+	}
+	pagefault_counts.cow_reuses++;
+	return paging_protect(page, flags);
+}
+
+static void pagefault_fail(u32int address, u32int error_code, u32int eip)
+{
+	fb_write_string("\nPage fault at ", FB_LIGHT_RED, FB_BLACK);
+	fb_write_hex(address, FB_LIGHT_RED, FB_BLACK);
+	fb_write_string(", eip ", FB_LIGHT_RED, FB_BLACK);
+	fb_write_hex(eip, FB_LIGHT_RED, FB_BLACK);
+	fb_write_string(error_code & PAGEFAULT_PRESENT ? ": protection violation" : ": not present", FB_LIGHT_RED, FB_BLACK);
+	fb_write_string(error_code & PAGEFAULT_WRITE ? ", write" : ", read", FB_LIGHT_RED, FB_BLACK);
+	if (error_code & PAGEFAULT_FETCH) {
+		fb_write_string(", instruction fetch", FB_LIGHT_RED, FB_BLACK);
+	}
+	if (error_code & PAGEFAULT_RESERVED) {
+		fb_write_string(", reserved bit set", FB_LIGHT_RED, FB_BLACK);
+	}
+	fb_write_string(error_code & PAGEFAULT_USER ? ", user mode\n" : ", kernel mode\n", FB_LIGHT_RED, FB_BLACK);
+	fb_write_string("System halted.", FB_LIGHT_RED, FB_BLACK);
+
+	for (;;) {
+		asm volatile("cli; hlt");
+	}
+}
+
+void pagefault_handle(u32int error_code, u32int eip)
+{
+	u32int address = cpu_read_cr2();
+	u32int page = address & PAGING_FRAME_MASK;
+	u32int write = error_code & PAGEFAULT_WRITE;
+	u32int user = error_code & PAGEFAULT_USER;
+	struct pagefault_region* region;
+	u32int irq_flags;
+	u32int physical;
+	u32int flags = 0;
+	u32int handled = 0;
+
+	if (error_code & PAGEFAULT_RESERVED) {
+		pagefault_fail(address, error_code, eip);
+	}
+
+	irq_flags = smp_lock_irqsave(&pagefault_lock);
+	physical = paging_translate(page, &flags);
+	if (!physical) {
+		region = pagefault_find_region(address);
+		handled = region && pagefault_zero_frame
+			  && (!user || (region->flags & PAGING_USER))
+			  && pagefault_zero_fill(page, region->flags, write);
+	} else if (write && (flags & PAGING_COW)) {
+		handled = pagefault_break_cow(page, physical & PAGING_FRAME_MASK, flags);
+	} else if ((!write || (flags & PAGING_WRITABLE)) && (!user || (flags & PAGING_USER))) {
+		// Another CPU got the lock first and mapped the page; try again
+		handled = 1;
+	}
+	spin_unlock_irqrestore(&pagefault_lock, irq_flags);
+
+	if (!handled) {
+		pagefault_fail(address, error_code, eip);
+	}
+}
+
+/* Statistics ****************************************************************/
+
+void pagefault_get_stats(struct pagefault_stats* stats)
+{
+	*stats = pagefault_counts;
+}
+
+void pagefault_print_stats(void)
+{
+	fb_write_string("Demand zero: ", FB_WHITE, FB_BLACK);
+	fb_write_number(pagefault_counts.demand_zero, FB_WHITE, FB_BLACK);
+	fb_write_string(" frames, ", FB_WHITE, FB_BLACK);
+	fb_write_number(pagefault_counts.zero_page, FB_WHITE, FB_BLACK);
+	fb_write_string(" zero page reads\n", FB_WHITE, FB_BLACK);
+	fb_write_string("Copy on write: ", FB_WHITE, FB_BLACK);
+	fb_write_number(pagefault_counts.shared, FB_WHITE, FB_BLACK);
+	fb_write_string(" pages shared, ", FB_WHITE, FB_BLACK);
+	fb_write_number(pagefault_counts.cow_copies, FB_WHITE, FB_BLACK);
+	fb_write_string(" copied, ", FB_WHITE, FB_BLACK);
+	fb_write_number(pagefault_counts.cow_reuses, FB_WHITE, FB_BLACK);
+	fb_write_string(" reused, ", FB_WHITE, FB_BLACK);
+	fb_write_number(pagefault_shared_count, FB_WHITE, FB_BLACK);
+	fb_write_string(" frames shared now\n", FB_WHITE, FB_BLACK);
+}
@@ -0,0 +1,90 @@
+#ifndef INCLUDE_PAGEFAULT_H
+#define INCLUDE_PAGEFAULT_H
+
+#include "type.h"
+
+/*
+    Page fault handling.
+
+    Demand zero: a region registered with pagefault_add_region() (or carved
+    from the kernel's lazy window with pagefault_reserve()) has no memory
+    behind it until it is touched. A read maps the shared zero page; a
+    write gets a freshly zeroed frame.
+
+    Copy on write: pagefault_share() maps the frames of one range into
+    another and makes both read-only with PAGING_COW set. The first write
+    through either mapping copies the frame, unless it was the last one
+    sharing it, in which case the page is just made writable again.
+
+    Any other fault is a bug and stops the machine with a report.
+*/
+#define PAGEFAULT_VECTOR	14
+
+/* Error code bits pushed by the CPU */
+#define PAGEFAULT_PRESENT	0x01	/* protection violation, not a missing page */
+#define PAGEFAULT_WRITE		0x02
+#define PAGEFAULT_USER		0x04
+#define PAGEFAULT_RESERVED	0x08
+#define PAGEFAULT_FETCH		0x10
+
+#define PAGEFAULT_MAX_REGIONS	16
+#define PAGEFAULT_SHARED_FRAMES	1024	/* frames shared copy on write at once */
+
+struct pagefault_stats {
+	u32int demand_zero;	/* fresh zeroed frames */
+	u32int zero_page;	/* reads satisfied with the shared zero page */
+	u32int cow_copies;
+	u32int cow_reuses;	/* writes to a frame nobody else shared any more */
+	u32int shared;		/* pages mapped by pagefault_share() */
+};
+
+/** pagefault_init:
+ *  Sets aside the zero page. Needs the physical memory manager.
+ */
+void pagefault_init(void);
+
+/** pagefault_add_region:
+ *  Makes [start, start + size) demand zero: pages are mapped with flags
+ *  (PAGING_* bits) on first touch. Both ends must be page aligned.
+ *
+ *  @return 1 on success, 0 if there is no free region slot
+ */
+u32int pagefault_add_region(u32int start, u32int size, u32int flags);
+
+/** pagefault_reserve:
+ *  Takes size bytes (rounded up to pages) of kernel address space from the
+ *  lazy window and makes them demand zero and writable.
+ *
+ *  @return the start of the region, or 0
+ */
+void* pagefault_reserve(u32int size);
+
+/** pagefault_release:
+ *  Unmaps a range, frees the frames no other mapping shares and forgets
+ *  the region starting at start, if any.
+ */
+void pagefault_release(u32int start, u32int size);
+
+/** pagefault_share:
+ *  Maps the pages of [source, source + pages * 4 KiB) at destination as
+ *  well, copy on write. Pages of source that are not mapped are left
+ *  unmapped at destination, where a demand zero region gives the same
+ *  (zero) contents.
+ *
+ *  Pages are copied instead when the share table is full.
+ *
+ *  @return the number of pages done; fewer than pages if memory ran out,
+ *          source is not made of 4 KiB pages or a destination page is
+ *          already mapped
+ */
+u32int pagefault_share(u32int destination, u32int source, u32int pages);
+
+/** pagefault_handle:
+ *  Resolves the fault at CR2, or reports it and halts.
+ */
+void pagefault_handle(u32int error_code, u32int eip);
+
+void pagefault_get_stats(struct pagefault_stats* stats);
+void pagefault_print_stats(void);
+
+#endif /* INCLUDE_PAGEFAULT_H */
@@ -0,0 +1,223 @@
+#include "paging.h"
+#include "cpu.h"
+#include "zeropool.h"
+#include "smp.h"
+#include "spinlock.h"
+#include "init.h"
+
+/*
+    Paging
+	From: http://wiki.osdev.org/Paging and http://wiki.osdev.org/Higher_Half_Kernel
+	loader.asm turns paging on with a boot directory that maps 768 MiB at
+	KERNEL_VIRTUAL_BASE, enough for pmm_init() to reach every frame. Once
+	the memory map is known, paging_init() switches to a directory that
+	maps only what exists.
+
+	Page tables are ordinary frames from the physical memory manager and
+	are reached through the direct map. Kernel page tables are shared by
+	everything that runs, so changing them needs no other bookkeeping
+	than flushing the TLBs of every CPU that might have cached the old
+	entry. Any CPU may change them, one at a time under paging_lock;
+	since the holder may be waiting on a shootdown, it is taken with
+	smp_lock_irqsave(). Lookups (paging_translate()) read a single entry
+	and take no lock.
+*/
+
+/* End of the kernel image, from link.ld */
+extern char kernel_end[];
+
+static u32int paging_directory[1024] __attribute__((aligned(PAGING_PAGE_SIZE)));
+static u32int paging_global = 0;
+static u32int paging_mmio_next = PAGING_MMIO_BASE;
+static struct spinlock paging_lock = SPINLOCK_INIT("page tables");
+
+void __init paging_init(void)
+{
+	u32int top = pmm_physical_top();
+	u32int physical;
+
+	if (cpu_has_feature(CPU_FEATURE_PGE)) {
+		cpu_write_cr4(cpu_read_cr4() | CPU_CR4_PGE);
+		paging_global = PAGING_GLOBAL;
+	}
+
+	// The kernel image must be mapped whatever the memory map says
+	if (top < PMM_VIRT_TO_PHYS(kernel_end)) {
+		top = PMM_VIRT_TO_PHYS(kernel_end);
+	}
+
+	for (physical = 0; physical < top; physical += PAGING_LARGE_PAGE_SIZE) {
+		paging_directory[PAGING_DIRECTORY_INDEX(KERNEL_VIRTUAL_BASE + physical)] =
+			physical | PAGING_PRESENT | PAGING_WRITABLE | PAGING_LARGE | paging_global;
+	}
+
+	cpu_write_cr3(PMM_VIRT_TO_PHYS(paging_directory));
+	cpu_write_cr0(cpu_read_cr0() | CPU_CR0_WP);
+}
+
+/* Page tables ***************************************************************/
+
+/* Returns the page table covering an address, creating it if asked to */
+static u32int* paging_table(u32int virtual_address, u32int create, u32int flags)
+{
+	u32int* entry = &paging_directory[PAGING_DIRECTORY_INDEX(virtual_address)];
+	u32int table;
+
+	if (*entry & PAGING_PRESENT) {
+		if (*entry & PAGING_LARGE) {
+			return 0;
+		}
+		// The directory entry must allow whatever any of its pages allow
+		*entry |= flags & (PAGING_USER | PAGING_WRITABLE);
+		return PMM_PHYS_TO_VIRT(*entry & PAGING_FRAME_MASK);
+	}
+	if (!create) {
+		return 0;
+	}
+
+	table = zeropool_alloc();
+	if (!table) {
+		return 0;
+	}
+	*entry = table | PAGING_PRESENT | PAGING_WRITABLE | (flags & PAGING_USER);
+	return PMM_PHYS_TO_VIRT(table);
+}
+
+u32int paging_map(u32int virtual_address, u32int physical_address, u32int flags)
+{
+	u32int irq_flags = smp_lock_irqsave(&paging_lock);
+	u32int* table = paging_table(virtual_address, 1, flags);
+	u32int old;
+
+	if (!table) {
+		spin_unlock_irqrestore(&paging_lock, irq_flags);
+		return 0;
+	}
+
+	old = table[PAGING_TABLE_INDEX(virtual_address)];
+	table[PAGING_TABLE_INDEX(virtual_address)] =
+		(physical_address & PAGING_FRAME_MASK) | (flags & PAGING_FLAGS_MASK) | PAGING_PRESENT;
+	// Entries that were not present are never cached
+	if (old & PAGING_PRESENT) {
+		paging_flush(virtual_address);
+	}
+
+	spin_unlock_irqrestore(&paging_lock, irq_flags);
+	return 1;
+}
+
+u32int paging_unmap(u32int virtual_address)
+{
+	u32int irq_flags = smp_lock_irqsave(&paging_lock);
+	u32int* table = paging_table(virtual_address, 0, 0);
+	u32int old = 0;
+
+	if (table) {
+		old = table[PAGING_TABLE_INDEX(virtual_address)];
+		table[PAGING_TABLE_INDEX(virtual_address)] = 0;
+		if (old & PAGING_PRESENT) {
+			paging_flush(virtual_address);
+		}
+	}
+
+	spin_unlock_irqrestore(&paging_lock, irq_flags);
+	return (old & PAGING_PRESENT) ? old & PAGING_FRAME_MASK : 0;
+}
+
+u32int paging_translate(u32int virtual_address, u32int* flags)
+{
+	u32int directory_entry = paging_directory[PAGING_DIRECTORY_INDEX(virtual_address)];
+	u32int entry;
+
+	if (!(directory_entry & PAGING_PRESENT)) {
+		return 0;
+	}
+	if (directory_entry & PAGING_LARGE) {
+		if (flags) {
+			*flags = directory_entry & PAGING_FLAGS_MASK;
+		}
+		return (directory_entry & PAGING_LARGE_FRAME_MASK) | (virtual_address & ~PAGING_LARGE_FRAME_MASK);
+	}
+
+	entry = ((u32int*) PMM_PHYS_TO_VIRT(directory_entry & PAGING_FRAME_MASK))[PAGING_TABLE_INDEX(virtual_address)];
+	if (!(entry & PAGING_PRESENT)) {
+		return 0;
+	}
+	if (flags) {
+		*flags = entry & PAGING_FLAGS_MASK;
+	}
+	return (entry & PAGING_FRAME_MASK) | (virtual_address & ~PAGING_FRAME_MASK);
+}
+
+u32int paging_protect(u32int virtual_address, u32int flags)
+{
+	u32int irq_flags = smp_lock_irqsave(&paging_lock);
+	u32int* table = paging_table(virtual_address, 0, flags);
+	u32int* entry;
+
+	if (!table || !(table[PAGING_TABLE_INDEX(virtual_address)] & PAGING_PRESENT)) {
+		spin_unlock_irqrestore(&paging_lock, irq_flags);
+		return 0;
+	}
+
+	entry = &table[PAGING_TABLE_INDEX(virtual_address)];
+	*entry = (*entry & PAGING_FRAME_MASK) | (flags & PAGING_FLAGS_MASK) | PAGING_PRESENT;
+	paging_flush(virtual_address);
+
+	spin_unlock_irqrestore(&paging_lock, irq_flags);
+	return 1;
+}
+
+/* TLB ***********************************************************************/
+
+void paging_flush(u32int virtual_address)
+{
+	cpu_invlpg(virtual_address);
+	smp_shootdown(virtual_address, PAGING_PAGE_SIZE);
+}
+
+void paging_flush_range(u32int virtual_address, u32int size)
+{
+	paging_flush_local(virtual_address, size);
+	smp_shootdown(virtual_address, size);
+}
+
+void paging_flush_local(u32int virtual_address, u32int size)
+{
+	u32int pages = (size + PAGING_PAGE_SIZE - 1) / PAGING_PAGE_SIZE;
+
+	if (pages > PAGING_FLUSH_ALL_PAGES) {
+		cpu_write_cr3(cpu_read_cr3());
+		return;
+	}
+	for (; pages; pages--, virtual_address += PAGING_PAGE_SIZE) {
+		cpu_invlpg(virtual_address);
+	}
+}
+
+/* Device memory *************************************************************/
+
+void* paging_map_mmio(u32int physical_address, u32int size)
+{
+	u32int offset = physical_address & ~PAGING_FRAME_MASK;
+	u32int pages = (offset + size + PAGING_PAGE_SIZE - 1) / PAGING_PAGE_SIZE;
+	u32int flags = PAGING_WRITABLE | PAGING_NO_CACHE | PAGING_WRITE_THROUGH | paging_global;
+	u32int irq_flags = smp_lock_irqsave(&paging_lock);
+	u32int virtual_address = paging_mmio_next;
+	u32int i;
+
+	if (pages > (PAGING_MMIO_END - virtual_address) / PAGING_PAGE_SIZE) {
+		spin_unlock_irqrestore(&paging_lock, irq_flags);
+		return 0;
+	}
+	paging_mmio_next += pages * PAGING_PAGE_SIZE;
+	spin_unlock_irqrestore(&paging_lock, irq_flags);
+
+	for (i = 0; i < pages; i++) {
+		if (!paging_map(virtual_address + i * PAGING_PAGE_SIZE,
+				(physical_address & PAGING_FRAME_MASK) + i * PAGING_PAGE_SIZE, flags)) {
+			return 0;
+		}
+	}
+	return (void*) (virtual_address + offset);
+}
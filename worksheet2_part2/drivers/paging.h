@@ -0,0 +1,106 @@
+#ifndef INCLUDE_PAGING_H
+#define INCLUDE_PAGING_H
+
+#include "type.h"
+#include "pmm.h"
+
+/*
+    Two level i386 paging. Kernel memory (the image and the direct map of
+    physical memory at KERNEL_VIRTUAL_BASE) uses 4 MiB PSE pages marked
+    global, so the whole kernel costs a handful of TLB entries that survive
+    CR3 reloads. Everything mapped through paging_map() - user pages and
+    device registers - uses ordinary 4 KiB pages.
+*/
+#define PAGING_PAGE_SIZE	4096
+#define PAGING_LARGE_PAGE_SIZE	0x400000
+#define PAGING_FRAME_MASK	0xFFFFF000
+#define PAGING_LARGE_FRAME_MASK	0xFFC00000
+
+/* Page directory and page table entry bits */
+#define PAGING_PRESENT		0x001
+#define PAGING_WRITABLE		0x002
+#define PAGING_USER		0x004
+#define PAGING_WRITE_THROUGH	0x008
+#define PAGING_NO_CACHE		0x010
+#define PAGING_ACCESSED		0x020
+#define PAGING_DIRTY		0x040
+#define PAGING_LARGE		0x080	/* directory entries only */
+#define PAGING_GLOBAL		0x100
+#define PAGING_COW		0x200	/* available to software: copy on write */
+#define PAGING_FLAGS_MASK	0xFFF
+
+#define PAGING_DIRECTORY_INDEX(address)	((address) >> 22)
+#define PAGING_TABLE_INDEX(address)	(((address) >> 12) & 0x3FF)
+
+/* Kernel virtual addresses handed out for device registers */
+#define PAGING_MMIO_BASE	(KERNEL_VIRTUAL_BASE + PMM_DIRECT_MAP_SIZE)
+#define PAGING_MMIO_END		0xF8000000
+
+/* Kernel virtual addresses for memory backed on first touch (pagefault.h) */
+#define PAGING_LAZY_BASE	PAGING_MMIO_END
+#define PAGING_LAZY_END		0xFFC00000
+
+/* Above this many pages, a range flush reloads CR3 instead of invlpg */
+#define PAGING_FLUSH_ALL_PAGES	32
+
+/** paging_init:
+ *  Replaces the boot page directory with the kernel's own: the direct map
+ *  covers physical memory up to pmm_physical_top() and nothing else, and
+ *  the identity map of the first 4 MiB used during boot is gone. Call
+ *  right after pmm_init().
+ */
+void paging_init(void);
+
+/** paging_map:
+ *  Maps one 4 KiB page, allocating a page table if needed. Replacing an
+ *  existing mapping flushes its TLB entry.
+ *
+ *  @param flags PAGING_* bits; PAGING_PRESENT is implied
+ *  @return 1 on success, 0 if the address is covered by a 4 MiB page or no
+ *          memory was left for a page table
+ */
+u32int paging_map(u32int virtual_address, u32int physical_address, u32int flags);
+
+/** paging_unmap:
+ *  Removes a 4 KiB mapping and flushes it from the TLB.
+ *
+ *  @return the physical address that was mapped, or 0
+ */
+u32int paging_unmap(u32int virtual_address);
+
+/** paging_translate:
+ *  Looks up the page table entry for an address (4 KiB or 4 MiB page).
+ *
+ *  @param flags Receives the entry's PAGING_* bits if not null
+ *  @return the physical address, or 0 if it is not mapped
+ */
+u32int paging_translate(u32int virtual_address, u32int* flags);
+
+/** paging_protect:
+ *  Replaces the PAGING_* bits of an existing 4 KiB mapping.
+ */
+u32int paging_protect(u32int virtual_address, u32int flags);
+
+/** paging_flush / paging_flush_range:
+ *  Drops stale TLB entries after a page table entry was changed by hand.
+ *  Only the given pages are invalidated, unless the range is large enough
+ *  that reloading CR3 is cheaper. Global (kernel) entries are kept.
+ *  Other running CPUs are made to flush the same range.
+ */
+void paging_flush(u32int virtual_address);
+void paging_flush_range(u32int virtual_address, u32int size);
+
+/** paging_flush_local:
+ *  The same, on the calling CPU only.
+ */
+void paging_flush_local(u32int virtual_address, u32int size);
+
+/** paging_map_mmio:
+ *  Maps device registers uncached into the kernel's MMIO window.
+ *
+ *  @return the virtual address of physical_address, or 0 if the window is
+ *          full
+ */
+void* paging_map_mmio(u32int physical_address, u32int size);
+
+#endif /* INCLUDE_PAGING_H */
@@ -1,14 +1,34 @@
 #include "io.h"
 #include "pic.h"
 #include "framebuffer.h"
+#include "init.h"
 
 /*
     Programmable Interrupt Controller
 	From: http://wiki.osdev.org/PIC
 	Reinitialize the PIC controllers, giving them specified vector offsets
 	rather than 8h and 70h, as configured by default.
+
+	The Interrupt Mask Registers are write-only as far as this driver is
+	concerned: their value is cached so masking or unmasking a line is a
+	single port write, and only to the PIC that owns the line.
+
+	Building with -DPIC_AUTO_EOI puts both PICs in automatic EOI mode, which
+	removes the acknowledge write(s) from every interrupt. Handlers then lose
+	the PIC's own priority blocking, which is fine as long as they run on
+	interrupt gates or use interrupts_nest_enter().
 */
 
+/* Bit n set means IRQ n is masked; everything but the cascade line at boot */
+static u16int pic_mask_cache = (u16int) ~(1 << PIC_CASCADE_IRQ);
+static u32int pic_spurious = 0;
+
+#ifdef PIC_AUTO_EOI
+#define PIC_ICW4 (PIC_ICW4_8086 | PIC_ICW4_AUTO)
+#else
+#define PIC_ICW4 PIC_ICW4_8086
+#endif
+
 /**
   *  Acknowledges an interrupt from either PIC 1 or PIC 2.
   *
@@ -16,15 +36,107 @@
   */
 void pic_acknowledge(u32int interrupt)
 {
+#ifdef PIC_AUTO_EOI
+	(void)interrupt; // The PICs end the interrupt themselves
+#else
 	if (interrupt < PIC_1_OFFSET || interrupt > PIC_2_END) {
 		return;
 	}
 
-	if (interrupt < PIC_2_OFFSET) {
-		outb(PIC_1_COMMAND_PORT, PIC_ACKNOWLEDGE);
-	} else {
+	if (interrupt >= PIC_2_OFFSET) {
 		outb(PIC_2_COMMAND_PORT, PIC_ACKNOWLEDGE);
 	}
+	outb(PIC_1_COMMAND_PORT, PIC_ACKNOWLEDGE);	// the master also holds the cascade IRQ
+#endif
+}
+
+/**
+  *  Reads the In-Service Registers of both PICs.
+  *
+  *  @return Bit n set means IRQ n is being serviced (slave IRQs in the high byte)
+  */
+u16int pic_read_isr(void)
+{
+	outb(PIC_1_COMMAND, PIC_OCW3_READ_ISR);
+	outb(PIC_2_COMMAND, PIC_OCW3_READ_ISR);
+	return (u16int) (inb(PIC_1_COMMAND) | (inb(PIC_2_COMMAND) << 8));
+}
+
+/**
+  *  Checks whether an IRQ7/IRQ15 is spurious, i.e. the PIC raised it but
+  *  withdrew the request before the CPU acknowledged it. A spurious IRQ15
+  *  still needs an EOI on the master, since the master did see the cascade.
+  *
+  *  @param interrupt The vector that was raised
+  *  @return 1 if the interrupt must be discarded without a (slave) EOI
+  */
+u32int pic_is_spurious(u32int interrupt)
+{
+	u32int irq = interrupt - PIC_1_OFFSET;
+	u32int spurious;
+
+	if (irq != PIC_SPURIOUS_IRQ_1 && irq != PIC_SPURIOUS_IRQ_2) {
+		return 0;
+	}
+
+#ifdef PIC_AUTO_EOI
+	// The ISR bit is already gone in auto EOI mode; only unused lines can be told apart
+	spurious = (pic_mask_cache >> irq) & 1;
+#else
+	spurious = !((pic_read_isr() >> irq) & 1);
+	if (spurious && irq == PIC_SPURIOUS_IRQ_2) {
+		outb(PIC_1_COMMAND_PORT, PIC_ACKNOWLEDGE);
+	}
+#endif
+
+	if (spurious) {
+		pic_spurious++;
+	}
+	return spurious;
+}
+
+u32int pic_spurious_count(void)
+{
+	return pic_spurious;
+}
+
+/**
+  *  Returns the cached Interrupt Mask Registers of both PICs.
+  *
+  *  @return Bit n set means IRQ n is masked (slave IRQs in the high byte)
+  */
+u16int pic_get_mask(void)
+{
+	return pic_mask_cache;
+}
+
+/**
+  *  Writes the Interrupt Mask Registers, touching only the PIC(s) whose half
+  *  of the mask changed.
+  *
+  *  @param mask Bit n set masks IRQ n (slave IRQs in the high byte)
+  */
+void pic_set_mask(u16int mask)
+{
+	u16int changed = pic_mask_cache ^ mask;
+
+	pic_mask_cache = mask;
+	if (changed & 0x00FF) {
+		outb(PIC_1_DATA, mask & 0xFF);
+	}
+	if (changed & 0xFF00) {
+		outb(PIC_2_DATA, (mask >> 8) & 0xFF);
+	}
+}
+
+void pic_mask_irq(u32int irq)
+{
+	pic_set_mask(pic_mask_cache | (u16int) (1 << irq));
+}
+
+void pic_unmask_irq(u32int irq)
+{
+	pic_set_mask(pic_mask_cache & (u16int) ~(1 << irq));
 }
 
 /*
@@ -33,7 +145,7 @@ arguments:
 		vectors on the master become offset1..offset1+7
 	offset2 - same for slave PIC: offset2..offset2+7
 */
-void pic_remap(s32int offset1, s32int offset2)
+void __init pic_remap(s32int offset1, s32int offset2)
 {
 	outb(PIC_1_COMMAND, PIC_ICW1_INIT + PIC_ICW1_ICW4);	// starts the initialization sequence (in cascade mode)
 	outb(PIC_2_COMMAND, PIC_ICW1_INIT + PIC_ICW1_ICW4);
@@ -42,12 +154,10 @@ void pic_remap(s32int offset1, s32int offset2)
 	outb(PIC_1_DATA, 4);					// ICW3: tell Master PIC that there is a slave PIC at IRQ2 (0000 0100)
 	outb(PIC_2_DATA, 2);					// ICW3: tell Slave PIC its cascade identity (0000 0010)
 
-	outb(PIC_1_DATA, PIC_ICW4_8086);
-	outb(PIC_2_DATA, PIC_ICW4_8086);
-
-        // Setup Interrupt Mask Register (IMR)
-	outb(PIC_1_DATA, 0xFD); // 1111 1101 - Enable IRQ 1 only (keyboard).
-	outb(PIC_2_DATA, 0xFF);
+	outb(PIC_1_DATA, PIC_ICW4);
+	outb(PIC_2_DATA, PIC_ICW4);
 
-	asm("sti"); // Enable interrupts.
+        // Setup Interrupt Mask Register (IMR) from the cache; drivers unmask their own lines
+	outb(PIC_1_DATA, pic_mask_cache & 0xFF);
+	outb(PIC_2_DATA, (pic_mask_cache >> 8) & 0xFF);
 }
@@ -19,6 +19,13 @@
 #define PIC_2_COMMAND_PORT 0xA0
 #define PIC_ACKNOWLEDGE 0x20
 
+#define PIC_IRQ_COUNT 16
+#define PIC_CASCADE_IRQ 2
+#define PIC_SPURIOUS_IRQ_1 7
+#define PIC_SPURIOUS_IRQ_2 15
+
+#define PIC_OCW3_READ_ISR 0x0B
+
 #define PIC_ICW1_ICW4            0x01	/* ICW4 (not) needed */
 #define PIC_ICW1_SINGLE          0x02	/* Single (cascade) mode */
 #define PIC_ICW1_INTERVAL4       0x04	/* Call address interval 4 (8) */
@@ -33,5 +40,12 @@
 
 void pic_remap(s32int offset1, s32int offset2);
 void pic_acknowledge(u32int interrupt);
+u16int pic_get_mask(void);
+void pic_set_mask(u16int mask);
+void pic_mask_irq(u32int irq);
+void pic_unmask_irq(u32int irq);
+u16int pic_read_isr(void);
+u32int pic_is_spurious(u32int interrupt);
+u32int pic_spurious_count(void);
 
 #endif /* INCLUDE_PIC_H */
@@ -0,0 +1,190 @@
+#include "pit.h"
+#include "io.h"
+#include "interrupts.h"
+#include "init.h"
+
+/*
+    Programmable Interval Timer
+	From: http://wiki.osdev.org/PIT
+	Channel 0 drives IRQ0 at a fixed rate and the handler counts ticks.
+
+	The 64-bit counter cannot be read atomically on a 32-bit CPU, so it is
+	published under a sequence count: the (single) writer makes the sequence
+	odd while it updates the counter, and readers retry if they saw an odd
+	sequence or the sequence changed under them. Readers never block the
+	interrupt handler and never need to disable interrupts.
+
+	Tickless idle: instead of waking every tick, the idle loop can switch
+	channel 0 to mode 0 (interrupt on terminal count) for several ticks at
+	once. The one-shot count starts with whatever was left of the current
+	period, so it ends on a tick boundary and the periodic tick that is
+	restarted afterwards stays in phase. A 16-bit count limits one sleep to
+	0xFFFF input clocks (about 55 ms); the idle loop simply goes round again.
+	If some other interrupt wakes the CPU first, the ticks that passed are
+	worked out from the remaining count.
+*/
+
+static volatile u32int pit_sequence = 0;
+static volatile u64int pit_tick_count = 0;
+static u32int pit_rate = 0;
+static u32int pit_divisor = 0;
+
+static volatile u32int pit_oneshot_ticks = 0;	/* 0 while periodic */
+static u32int pit_oneshot_count;		/* count the one-shot started at */
+static u32int pit_oneshot_first;		/* counts until the first boundary */
+
+static u32int pit_idle_sleeps = 0;
+static u64int pit_idle_skipped = 0;
+
+#define pit_barrier() asm volatile("" : : : "memory")
+
+static void pit_program(u8int command, u32int count)
+{
+	outb(PIT_COMMAND, command);
+	outb(PIT_CHANNEL_0_DATA, count & 0xFF);
+	outb(PIT_CHANNEL_0_DATA, (count >> 8) & 0xFF);
+}
+
+static u32int pit_read_count(void)
+{
+	u32int low;
+
+	outb(PIT_COMMAND, PIT_CMD_CHANNEL_0_LATCH);
+	low = inb(PIT_CHANNEL_0_DATA);
+	return low | (inb(PIT_CHANNEL_0_DATA) << 8);
+}
+
+void __init pit_init(u32int hz)
+{
+	u32int divisor = hz ? PIT_FREQUENCY / hz : PIT_DIVISOR_MAX;
+
+	if (divisor < PIT_DIVISOR_MIN) {
+		divisor = PIT_DIVISOR_MIN;
+	}
+	if (divisor > PIT_DIVISOR_MAX) {
+		divisor = PIT_DIVISOR_MAX;
+	}
+	pit_rate = PIT_FREQUENCY / divisor;
+	pit_divisor = divisor;
+
+	pit_program(PIT_CMD_CHANNEL_0_RATE, divisor);
+
+	interrupts_unmask_irq(PIT_IRQ);
+}
+
+static void pit_advance(u32int ticks)
+{
+	pit_sequence++;
+	pit_barrier();
+	pit_tick_count += ticks;
+	pit_barrier();
+	pit_sequence++;
+}
+
+void pit_handle_interrupt(void)
+{
+	u32int ticks = pit_oneshot_ticks;
+
+	if (ticks) {
+		// The one-shot ran out on a tick boundary: resume the periodic tick
+		pit_program(PIT_CMD_CHANNEL_0_RATE, pit_divisor);
+		pit_oneshot_ticks = 0;
+		pit_idle_skipped += ticks - 1;
+		pit_advance(ticks);
+	} else {
+		pit_advance(1);
+	}
+}
+
+u32int pit_oneshot(u32int ticks)
+{
+	u32int remaining;
+	u32int max;
+
+	if (pit_oneshot_ticks || ticks < 2 || pit_divisor == 0) {
+		return 0;
+	}
+
+	// In mode 2 the count runs from the divisor down to 1
+	remaining = pit_read_count();
+	if (remaining == 0 || remaining > pit_divisor) {
+		remaining = pit_divisor;
+	}
+
+	max = (0xFFFF - remaining) / pit_divisor + 1;
+	if (ticks > max) {
+		ticks = max;
+	}
+	if (ticks < 2) {
+		return 0;
+	}
+
+	pit_oneshot_first = remaining;
+	pit_oneshot_count = remaining + (ticks - 1) * pit_divisor;
+	pit_program(PIT_CMD_CHANNEL_0_ONESHOT, pit_oneshot_count);
+	pit_oneshot_ticks = ticks;
+	pit_idle_sleeps++;
+	return ticks;
+}
+
+void pit_wake(void)
+{
+	u32int left;
+	u32int elapsed;
+	u32int ticks;
+
+	if (!pit_oneshot_ticks) {
+		return;
+	}
+
+	// In mode 0 the count wraps past zero and keeps going. If it has run out
+	// (or is about to) IRQ0 is on its way and will do the accounting.
+	left = pit_read_count();
+	if (left <= PIT_ONESHOT_GUARD || left > pit_oneshot_count) {
+		return;
+	}
+
+	elapsed = pit_oneshot_count - left;
+	ticks = 0;
+	if (elapsed >= pit_oneshot_first) {
+		ticks = 1 + (elapsed - pit_oneshot_first) / pit_divisor;
+	}
+
+	// Restarting the period here shifts the tick phase by less than a tick
+	pit_program(PIT_CMD_CHANNEL_0_RATE, pit_divisor);
+	pit_oneshot_ticks = 0;
+	if (ticks) {
+		pit_idle_skipped += ticks;
+		pit_advance(ticks);
+	}
+}
+
+u64int pit_ticks(void)
+{
+	u32int sequence;
+	u64int ticks;
+
+	do {
+		sequence = pit_sequence;
+		pit_barrier();
+		ticks = pit_tick_count;
+		pit_barrier();
+	} while ((sequence & 1) || sequence != pit_sequence);
+
+	return ticks;
+}
+
+u32int pit_hz(void)
+{
+	return pit_rate;
+}
+
+u32int pit_idle_sleeps_count(void)
+{
+	return pit_idle_sleeps;
+}
+
+u64int pit_idle_skipped_ticks(void)
+{
+	return pit_idle_skipped;
+}
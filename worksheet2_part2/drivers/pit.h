@@ -0,0 +1,73 @@
+#ifndef INCLUDE_PIT_H
+#define INCLUDE_PIT_H
+
+#include "type.h"
+
+/* Programmable Interval Timer (8253/8254) */
+#define PIT_FREQUENCY		1193182	/* input clock in Hz */
+#define PIT_CHANNEL_0_DATA	0x40
+#define PIT_CHANNEL_2_DATA	0x42
+#define PIT_COMMAND		0x43
+#define PIT_CHANNEL_2_GATE	0x61	/* bit 0 gate, bit 1 speaker, bit 5 OUT2 */
+#define PIT_IRQ			0
+
+/* Command byte: channel 0, lobyte/hibyte access, mode 2 (rate generator) */
+#define PIT_CMD_CHANNEL_0_RATE	0x34
+/* Command byte: channel 0, lobyte/hibyte access, mode 0 (one-shot) */
+#define PIT_CMD_CHANNEL_0_ONESHOT	0x30
+/* Command byte: latch the channel 0 count for reading */
+#define PIT_CMD_CHANNEL_0_LATCH		0x00
+/* Reload values channel 0 accepts in mode 2; 0 would mean 65536 */
+#define PIT_DIVISOR_MIN		2
+#define PIT_DIVISOR_MAX		0xFFFF
+/* Counts left below which a one-shot is treated as already expired */
+#define PIT_ONESHOT_GUARD	16
+/* Command byte: channel 2, lobyte/hibyte access, mode 0 (one-shot) */
+#define PIT_CMD_CHANNEL_2_ONESHOT	0xB0
+
+/* Tick rate; override with make KERNEL_OPTIONS="-DPIT_HZ=1000" */
+#ifndef PIT_HZ
+#define PIT_HZ 100
+#endif
+
+/** pit_init:
+ *  Programs channel 0 to interrupt hz times per second and unmasks IRQ0.
+ *  Rates outside what the divisor can express (about 19 Hz to 597 kHz)
+ *  are clamped; 0 gets the slowest.
+ */
+void pit_init(u32int hz);
+
+/** pit_handle_interrupt:
+ *  IRQ0 handler body: advances the tick counter.
+ */
+void pit_handle_interrupt(void);
+
+/** pit_ticks:
+ *  Returns the number of ticks since pit_init(). Safe to call from any
+ *  context, including while the tick is being updated.
+ */
+u64int pit_ticks(void);
+
+u32int pit_hz(void);
+
+/** pit_oneshot:
+ *  Stops the periodic tick and makes channel 0 fire once, ticks ticks from
+ *  the last one. Call with interrupts disabled just before halting.
+ *
+ *  @return the number of ticks actually programmed (the 16-bit counter
+ *          limits the range), or 0 if the periodic tick was left running
+ */
+u32int pit_oneshot(u32int ticks);
+
+/** pit_wake:
+ *  Called on entry to every interrupt: if a one-shot is pending, credits the
+ *  ticks that have passed and restarts the periodic tick.
+ */
+void pit_wake(void);
+
+/* Tickless idle statistics: one-shot sleeps, and ticks that passed without
+   an interrupt of their own */
+u32int pit_idle_sleeps_count(void);
+u64int pit_idle_skipped_ticks(void);
+
+#endif /* INCLUDE_PIT_H */
@@ -0,0 +1,469 @@
+#include "pmm.h"
+#include "framebuffer.h"
+#include "spinlock.h"
+#include "init.h"
+
+/*
+    Buddy allocator
+	A free block of order k starts at a frame aligned to 2^k and its buddy
+	is the frame number with bit k flipped. Free blocks keep their list
+	links and order in their own first bytes, so the allocator needs no
+	memory besides the bitmap.
+
+	All frames of a free block have their bitmap bit clear; allocated and
+	reserved frames have it set. When a block is freed, its buddy can only
+	be free as a whole block of the same or a lower order (a larger free
+	block would contain the block being freed), so a clear bit plus a
+	matching order in the buddy's header is enough to merge.
+*/
+
+#define PMM_FRAME(address)	((address) >> PMM_PAGE_SHIFT)
+#define PMM_ALIGN_DOWN(address)	((address) & ~(PMM_PAGE_SIZE - 1))
+#define PMM_ALIGN_UP(address)	PMM_ALIGN_DOWN((address) + PMM_PAGE_SIZE - 1)
+
+/* Free lists, bitmap and count; pages are freed from any CPU */
+static struct spinlock pmm_lock = SPINLOCK_INIT("pmm");
+
+struct pmm_block {
+	struct pmm_block* next;
+	struct pmm_block* prev;
+	u32int order;
+};
+
+/* Bounds of the kernel image, from link.ld */
+extern char kernel_start[];
+extern char kernel_end[];
+
+/* Boot-only code, page aligned at both ends */
+extern char __init_start[];
+extern char __init_end[];
+
+static u32int* pmm_bitmap = 0;
+static u32int pmm_frame_count = 0;	/* frames covered by the bitmap */
+static u32int pmm_top = 0;
+static u32int pmm_total = 0;
+static u32int pmm_free = 0;
+static u32int pmm_init_freed = 0;	/* pages of __init code given back */
+static struct pmm_block* pmm_free_lists[PMM_MAX_ORDER + 1];
+static u32int pmm_free_blocks[PMM_MAX_ORDER + 1];
+
+/* Bitmap ********************************************************************/
+
+static u32int pmm_test(u32int frame)
+{
+	return (pmm_bitmap[frame / 32] >> (frame % 32)) & 1;
+}
+
+static void pmm_mark(u32int frame, u32int count, u32int used)
+{
+	u32int end = frame + count;
+
+	while (frame < end) {
+		if (frame % 32 == 0 && end - frame >= 32) {
+			pmm_bitmap[frame / 32] = used ? 0xFFFFFFFF : 0;
+			frame += 32;
+		} else {
+			if (used) {
+				pmm_bitmap[frame / 32] |= 1 << (frame % 32);
+			} else {
+				pmm_bitmap[frame / 32] &= ~(1 << (frame % 32));
+			}
+			frame++;
+		}
+	}
+}
+
+/* Marks the pages overlapping [start, end) as in use */
+static void __init pmm_reserve(u32int start, u32int end)
+{
+	u32int first = PMM_FRAME(PMM_ALIGN_DOWN(start));
+	u32int last = PMM_FRAME(PMM_ALIGN_UP(end));
+
+	if (first >= pmm_frame_count) {
+		return;
+	}
+	if (last > pmm_frame_count) {
+		last = pmm_frame_count;
+	}
+	pmm_mark(first, last - first, 1);
+}
+
+/* Free lists ****************************************************************/
+
+static void pmm_push(u32int frame, u32int order)
+{
+	struct pmm_block* block = PMM_PHYS_TO_VIRT(frame << PMM_PAGE_SHIFT);
+
+	block->order = order;
+	block->prev = 0;
+	block->next = pmm_free_lists[order];
+	if (block->next) {
+		block->next->prev = block;
+	}
+	pmm_free_lists[order] = block;
+	pmm_free_blocks[order]++;
+}
+
+static void pmm_remove(struct pmm_block* block)
+{
+	if (block->prev) {
+		block->prev->next = block->next;
+	} else {
+		pmm_free_lists[block->order] = block->next;
+	}
+	if (block->next) {
+		block->next->prev = block->prev;
+	}
+	pmm_free_blocks[block->order]--;
+}
+
+static u32int pmm_block_frame(struct pmm_block* block)
+{
+	return PMM_FRAME(PMM_VIRT_TO_PHYS(block));
+}
+
+/* Initialisation ************************************************************/
+
+static u32int pmm_region_end(struct multiboot_mmap_entry* entry)
+{
+	u64int end = entry->base + entry->length;
+
+	// Frames outside the direct map could not be reached through it
+	return end > PMM_DIRECT_MAP_SIZE ? PMM_DIRECT_MAP_SIZE : (u32int) end;
+}
+
+/* Address just past a boot loader string, terminator included */
+static u32int __init pmm_string_end(u32int address)
+{
+	const char* string = PMM_PHYS_TO_VIRT(address);
+	u32int length = 0;
+
+	while (string[length]) {
+		length++;
+	}
+	return address + length + 1;
+}
+
+/*
+    Boot data
+	Memory the kernel image and the boot loader's hand-over occupy, one
+	range per index: the kernel, the multiboot info, the memory map, the
+	command line, the module list, then each module and its string. The
+	bitmap must miss all of them and all of them are reserved. Ranges a
+	boot loader did not provide come back empty.
+*/
+static u32int __init pmm_boot_range(struct multiboot_info* info, u32int index, u32int* start, u32int* end)
+{
+	struct multiboot_module* modules = PMM_PHYS_TO_VIRT(info->mods_addr);
+	u32int module_count = info->flags & MULTIBOOT_INFO_MODULES ? info->mods_count : 0;
+	u32int module;
+
+	*start = 0;
+	*end = 0;
+	switch (index) {
+	case 0:
+		*start = PMM_VIRT_TO_PHYS(kernel_start);
+		*end = PMM_VIRT_TO_PHYS(kernel_end);
+		break;
+	case 1:
+		*start = PMM_VIRT_TO_PHYS(info);
+		*end = PMM_VIRT_TO_PHYS(info + 1);
+		break;
+	case 2:
+		if (info->flags & MULTIBOOT_INFO_MEMORY_MAP) {
+			*start = info->mmap_addr;
+			*end = info->mmap_addr + info->mmap_length;
+		}
+		break;
+	case 3:
+		if ((info->flags & MULTIBOOT_INFO_CMDLINE) && info->cmdline) {
+			*start = info->cmdline;
+			*end = pmm_string_end(info->cmdline);
+		}
+		break;
+	case 4:
+		*start = info->mods_addr;
+		*end = info->mods_addr + module_count * sizeof(struct multiboot_module);
+		break;
+	default:
+		module = (index - 5) / 2;
+		if (module >= module_count) {
+			return 0;
+		}
+		if ((index - 5) % 2 == 0) {
+			*start = modules[module].start;
+			*end = modules[module].end;
+		} else if (modules[module].string) {
+			*start = modules[module].string;
+			*end = pmm_string_end(modules[module].string);
+		}
+		break;
+	}
+	return 1;
+}
+
+/* First page aligned place after the kernel for size bytes that misses all boot data */
+static u32int __init pmm_place_bitmap(struct multiboot_info* info, u32int size)
+{
+	u32int place = PMM_ALIGN_UP(PMM_VIRT_TO_PHYS(kernel_end));
+	u32int start, end;
+	u32int moved;
+	u32int i;
+
+	do {
+		moved = 0;
+		for (i = 0; pmm_boot_range(info, i, &start, &end); i++) {
+			if (start < end && start < place + size && end > place) {
+				place = PMM_ALIGN_UP(end);
+				moved = 1;
+			}
+		}
+	} while (moved);
+	return place;
+}
+
+/* Hands every run of clear bits to the free lists as maximal aligned blocks */
+static void __init pmm_build_free_lists(void)
+{
+	u32int frame = 0;
+	u32int end;
+	u32int order;
+
+	while (frame < pmm_frame_count) {
+		if (pmm_test(frame)) {
+			frame++;
+			continue;
+		}
+		for (end = frame; end < pmm_frame_count && !pmm_test(end); end++) {
+		}
+
+		while (frame < end) {
+			order = 0;
+			while (order < PMM_MAX_ORDER && (frame & ((1 << (order + 1)) - 1)) == 0 &&
+			       frame + (1 << (order + 1)) <= end) {
+				order++;
+			}
+			pmm_push(frame, order);
+			pmm_free += 1 << order;
+			frame += 1 << order;
+		}
+	}
+}
+
+void __init pmm_init(struct multiboot_info* info)
+{
+	struct multiboot_mmap_entry* entry;
+	u32int mmap_end = 0;
+	u32int top = 0;
+	u32int bitmap_start;
+	u32int bitmap_bytes;
+	u32int start, end;
+	u32int i;
+
+	if (info->flags & MULTIBOOT_INFO_MEMORY_MAP) {
+		mmap_end = info->mmap_addr + info->mmap_length;
+		for (entry = PMM_PHYS_TO_VIRT(info->mmap_addr); PMM_VIRT_TO_PHYS(entry) < mmap_end;
+		     entry = (struct multiboot_mmap_entry*) ((u32int) entry + entry->size + 4)) {
+			if (entry->base >= PMM_DIRECT_MAP_SIZE) {
+				continue;
+			}
+			if (pmm_region_end(entry) > pmm_top) {
+				pmm_top = pmm_region_end(entry);
+			}
+			if (entry->type == MULTIBOOT_MEMORY_AVAILABLE && pmm_region_end(entry) > top) {
+				top = pmm_region_end(entry);
+			}
+		}
+	} else if (info->flags & MULTIBOOT_INFO_MEMORY) {
+		top = PMM_LOW_MEMORY + info->mem_upper * 1024;
+		if (top > PMM_DIRECT_MAP_SIZE) {
+			top = PMM_DIRECT_MAP_SIZE;
+		}
+		pmm_top = top;
+	}
+	pmm_frame_count = PMM_FRAME(PMM_ALIGN_DOWN(top));
+
+	// The bitmap goes after the kernel, clear of everything the boot loader left
+	bitmap_bytes = (pmm_frame_count + 31) / 32 * 4;
+	bitmap_start = pmm_place_bitmap(info, bitmap_bytes);
+	if (bitmap_start + bitmap_bytes > top) {
+		fb_write_string("No room for the page frame bitmap. System halted.", FB_LIGHT_RED, FB_BLACK);
+		for (;;) {
+			asm volatile("cli; hlt");
+		}
+	}
+	pmm_bitmap = PMM_PHYS_TO_VIRT(bitmap_start);
+
+	// Everything is in use until the memory map says otherwise
+	pmm_mark(0, pmm_frame_count, 1);
+	if (info->flags & MULTIBOOT_INFO_MEMORY_MAP) {
+		for (entry = PMM_PHYS_TO_VIRT(info->mmap_addr); PMM_VIRT_TO_PHYS(entry) < mmap_end;
+		     entry = (struct multiboot_mmap_entry*) ((u32int) entry + entry->size + 4)) {
+			if (entry->type != MULTIBOOT_MEMORY_AVAILABLE || entry->base >= PMM_DIRECT_MAP_SIZE) {
+				continue;
+			}
+			start = PMM_FRAME(PMM_ALIGN_UP((u32int) entry->base));
+			end = PMM_FRAME(PMM_ALIGN_DOWN(pmm_region_end(entry)));
+			if (start < end) {
+				pmm_mark(start, end - start, 0);
+			}
+		}
+	} else {
+		pmm_mark(PMM_FRAME(PMM_LOW_MEMORY), pmm_frame_count - PMM_FRAME(PMM_LOW_MEMORY), 0);
+	}
+
+	// Count usable RAM before taking out what is already spoken for
+	for (i = 0; i < pmm_frame_count; i++) {
+		pmm_total += !pmm_test(i);
+	}
+
+	pmm_reserve(0, PMM_LOW_MEMORY);
+	pmm_reserve(bitmap_start, bitmap_start + bitmap_bytes);
+	for (i = 0; pmm_boot_range(info, i, &start, &end); i++) {
+		if (start < end) {
+			pmm_reserve(start, end);
+		}
+	}
+
+	pmm_build_free_lists();
+}
+
+/* Allocation ****************************************************************/
+
+u32int pmm_alloc_pages(u32int order)
+{
+	struct pmm_block* block;
+	u32int frame;
+	u32int level;
+	u32int flags;
+
+	if (order > PMM_MAX_ORDER) {
+		return 0;
+	}
+
+	flags = spin_lock_irqsave(&pmm_lock);
+	for (level = order; level <= PMM_MAX_ORDER && !pmm_free_lists[level]; level++) {
+	}
+	if (level > PMM_MAX_ORDER) {
+		spin_unlock_irqrestore(&pmm_lock, flags);
+		return 0;
+	}
+
+	block = pmm_free_lists[level];
+	pmm_remove(block);
+	frame = pmm_block_frame(block);
+
+	// Split down to the requested size, freeing the upper halves
+	while (level > order) {
+		level--;
+		pmm_push(frame + (1 << level), level);
+	}
+
+	pmm_mark(frame, 1 << order, 1);
+	pmm_free -= 1 << order;
+	spin_unlock_irqrestore(&pmm_lock, flags);
+
+	return frame << PMM_PAGE_SHIFT;
+}
+
+void pmm_free_pages(u32int address, u32int order)
+{
+	u32int frame = PMM_FRAME(address);
+	struct pmm_block* buddy;
+	u32int buddy_frame;
+	u32int flags;
+	u32int i;
+
+	if (order > PMM_MAX_ORDER || frame + (1 << order) > pmm_frame_count || (frame & ((1 << order) - 1))) {
+		return;
+	}
+
+	flags = spin_lock_irqsave(&pmm_lock);
+	for (i = 0; i < (1U << order); i++) {
+		if (!pmm_test(frame + i)) {
+			spin_unlock_irqrestore(&pmm_lock, flags); // Double free, whole or in part
+			return;
+		}
+	}
+	pmm_mark(frame, 1 << order, 0);
+	pmm_free += 1 << order;
+
+	while (order < PMM_MAX_ORDER) {
+		buddy_frame = frame ^ (1 << order);
+		if (buddy_frame + (1 << order) > pmm_frame_count || pmm_test(buddy_frame)) {
+			break;
+		}
+		buddy = PMM_PHYS_TO_VIRT(buddy_frame << PMM_PAGE_SHIFT);
+		if (buddy->order != order) {
+			break;
+		}
+		pmm_remove(buddy);
+		frame &= ~(1 << order);
+		order++;
+	}
+	pmm_push(frame, order);
+
+	spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+u32int pmm_alloc_page(void)
+{
+	return pmm_alloc_pages(0);
+}
+
+void pmm_free_page(u32int address)
+{
+	pmm_free_pages(address, 0);
+}
+
+u32int pmm_free_init(void)
+{
+	u32int address;
+
+	if (pmm_init_freed || !pmm_frame_count) {
+		return 0;
+	}
+	for (address = PMM_VIRT_TO_PHYS(__init_start); address < PMM_VIRT_TO_PHYS(__init_end); address += PMM_PAGE_SIZE) {
+		pmm_free_page(address);
+		pmm_init_freed++;
+	}
+	return pmm_init_freed;
+}
+
+u32int pmm_physical_top(void)
+{
+	return pmm_top;
+}
+
+u32int pmm_total_pages(void)
+{
+	return pmm_total;
+}
+
+u32int pmm_free_page_count(void)
+{
+	return pmm_free;
+}
+
+void pmm_print_info(void)
+{
+	u32int order;
+
+	fb_write_string("Memory: ", FB_WHITE, FB_BLACK);
+	fb_write_number(pmm_total * (PMM_PAGE_SIZE / 1024), FB_WHITE, FB_BLACK);
+	fb_write_string(" KiB usable, ", FB_WHITE, FB_BLACK);
+	fb_write_number(pmm_free * (PMM_PAGE_SIZE / 1024), FB_WHITE, FB_BLACK);
+	fb_write_string(" KiB free", FB_WHITE, FB_BLACK);
+	if (pmm_init_freed) {
+		fb_write_string(" (", FB_WHITE, FB_BLACK);
+		fb_write_number(pmm_init_freed * (PMM_PAGE_SIZE / 1024), FB_WHITE, FB_BLACK);
+		fb_write_string(" KiB of boot code reclaimed)", FB_WHITE, FB_BLACK);
+	}
+	fb_newline();
+	fb_write_string("Free blocks by order:", FB_WHITE, FB_BLACK);
+	for (order = 0; order <= PMM_MAX_ORDER; order++) {
+		fb_write_string(" ", FB_WHITE, FB_BLACK);
+		fb_write_number(pmm_free_blocks[order], FB_WHITE, FB_BLACK);
+	}
+	fb_newline();
+}
@@ -0,0 +1,77 @@
+#ifndef INCLUDE_PMM_H
+#define INCLUDE_PMM_H
+
+#include "type.h"
+#include "multiboot.h"
+
+/*
+    Physical memory manager: page frames from the multiboot memory map.
+
+    A bitmap records which frames are in use or reserved (kernel image,
+    boot modules, boot information, everything below 1 MiB). Free frames
+    are kept in buddy free lists, one per power of two up to PMM_MAX_ORDER,
+    so a contiguous block of 2^order pages is found, split and merged back
+    in O(log n).
+*/
+#define PMM_PAGE_SIZE		4096
+#define PMM_PAGE_SHIFT		12
+#define PMM_MAX_ORDER		10		/* largest block: 4 MiB */
+#define PMM_LOW_MEMORY		0x100000	/* left to the BIOS and real mode */
+
+/*
+    The kernel runs in the higher half: physical memory from 0 up to
+    PMM_DIRECT_MAP_SIZE is mapped at KERNEL_VIRTUAL_BASE + physical, and the
+    allocator only hands out frames inside that window.
+*/
+#define KERNEL_VIRTUAL_BASE	0xC0000000
+#define PMM_DIRECT_MAP_SIZE	0x30000000	/* 768 MiB */
+
+#define PMM_PHYS_TO_VIRT(address)	((void*) ((u32int) (address) + KERNEL_VIRTUAL_BASE))
+#define PMM_VIRT_TO_PHYS(pointer)	((u32int) (pointer) - KERNEL_VIRTUAL_BASE)
+
+/** pmm_init:
+ *  Builds the allocator from the memory map GRUB passed in.
+ *
+ *  @param info The multiboot information (EBX at entry)
+ */
+void pmm_init(struct multiboot_info* info);
+
+/** pmm_alloc_pages:
+ *  Allocates 2^order physically contiguous pages, aligned to their size.
+ *
+ *  @return the physical address, or 0 if no block that large is free
+ */
+u32int pmm_alloc_pages(u32int order);
+
+/** pmm_free_pages:
+ *  Returns a block from pmm_alloc_pages() with the same order.
+ */
+void pmm_free_pages(u32int address, u32int order);
+
+u32int pmm_alloc_page(void);
+void pmm_free_page(u32int address);
+
+/** pmm_free_init:
+ *  Frees the pages holding __init functions (see init.h). Called once,
+ *  at the end of kmain; nothing marked __init may run afterwards.
+ *
+ *  @return the number of pages freed
+ */
+u32int pmm_free_init(void);
+
+/** pmm_physical_top:
+ *  Returns the end of the highest memory map region (of any type, so ACPI
+ *  tables are included) inside the direct map window.
+ */
+u32int pmm_physical_top(void);
+
+/* Usable RAM and what is left of it, in pages */
+u32int pmm_total_pages(void);
+u32int pmm_free_page_count(void);
+
+/** pmm_print_info:
+ *  Prints memory totals and the free blocks of each order.
+ */
+void pmm_print_info(void);
+
+#endif /* INCLUDE_PMM_H */
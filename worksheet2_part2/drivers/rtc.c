@@ -0,0 +1,192 @@
+#include "rtc.h"
+#include "io.h"
+#include "acpi.h"
+#include "clock.h"
+#include "cpu.h"
+#include "timer.h"
+#include "hardware_interrupt_enabler.h"
+#include "init.h"
+
+/*
+    CMOS real time clock
+	From: http://wiki.osdev.org/CMOS
+	Fields may be BCD or binary and the hour 12 or 24 hour, as status
+	register B says. The clock updates itself once a second; a read is
+	only trusted once two passes taken outside an update agree.
+
+	The century comes from the register the ACPI FADT names, if any.
+*/
+
+#define RTC_FADT_CENTURY	108	/* offset of the century index in the FADT */
+#define RTC_NS_PER_SECOND	1000000000ULL
+
+static u64int rtc_epoch_ns = 0;	/* wall clock at clock_ns() == 0 */
+static u32int rtc_century_register = 0;
+static u32int rtc_steps = 0;
+static struct timer rtc_resync_timer;
+
+static u8int cmos_read(u8int reg)
+{
+	outb(CMOS_INDEX, reg);
+	return inb(CMOS_DATA);
+}
+
+static u32int rtc_from_bcd(u8int value)
+{
+	return (value & 0x0F) + (value >> 4) * 10;
+}
+
+static void rtc_read_raw(u8int* raw, u8int* century)
+{
+	static const u8int registers[6] = {
+		RTC_REG_SECONDS, RTC_REG_MINUTES, RTC_REG_HOURS,
+		RTC_REG_DAY, RTC_REG_MONTH, RTC_REG_YEAR
+	};
+	u32int i;
+
+	while (cmos_read(RTC_REG_STATUS_A) & RTC_STATUS_A_UPDATING) {
+		// Fields are inconsistent while an update is in progress
+	}
+	for (i = 0; i < 6; i++) {
+		raw[i] = cmos_read(registers[i]);
+	}
+	*century = rtc_century_register ? cmos_read(rtc_century_register) : 0;
+}
+
+void rtc_read(struct rtc_date* date)
+{
+	u8int raw[6], again[6];
+	u8int century, century_again;
+	u8int status;
+	u32int flags;
+	u32int i;
+	u32int pm;
+
+	flags = save_and_disable_hardware_interrupts();
+	rtc_read_raw(again, &century_again);
+	do {
+		for (i = 0; i < 6; i++) {
+			raw[i] = again[i];
+		}
+		century = century_again;
+		rtc_read_raw(again, &century_again);
+		for (i = 0; i < 6 && raw[i] == again[i]; i++) {
+		}
+	} while (i < 6 || century != century_again);
+	status = cmos_read(RTC_REG_STATUS_B);
+	restore_hardware_interrupts(flags);
+
+	pm = raw[2] & RTC_HOUR_PM;
+	raw[2] &= ~RTC_HOUR_PM;
+	if (!(status & RTC_STATUS_B_BINARY)) {
+		for (i = 0; i < 6; i++) {
+			raw[i] = rtc_from_bcd(raw[i]);
+		}
+		century = rtc_from_bcd(century);
+	}
+
+	date->second = raw[0];
+	date->minute = raw[1];
+	date->hour = raw[2];
+	date->day = raw[3];
+	date->month = raw[4];
+	date->year = (century ? century : RTC_DEFAULT_CENTURY) * 100 + raw[5];
+
+	// 12 hour mode: 12 AM is midnight and 12 PM is noon
+	if (!(status & RTC_STATUS_B_24_HOUR)) {
+		date->hour %= 12;
+		if (pm) {
+			date->hour += 12;
+		}
+	}
+}
+
+/*
+    Days since 1970-01-01 for a proleptic Gregorian date, counting years
+    from March so the leap day is the last day of the year.
+*/
+u32int rtc_from_date(struct rtc_date* date)
+{
+	u32int year = date->year - (date->month <= 2);
+	u32int era = year / 400;
+	u32int year_of_era = year - era * 400;
+	u32int day_of_year = (153 * (date->month + (date->month > 2 ? -3 : 9)) + 2) / 5 + date->day - 1;
+	u32int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	u32int days = era * 146097 + day_of_era - 719468;
+
+	return days * 86400 + date->hour * 3600 + date->minute * 60 + date->second;
+}
+
+void rtc_to_date(u32int seconds, struct rtc_date* date)
+{
+	u32int days = seconds / 86400 + 719468;
+	u32int era = days / 146097;
+	u32int day_of_era = days - era * 146097;
+	u32int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	u32int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	u32int month_index = (5 * day_of_year + 2) / 153;
+
+	date->day = day_of_year - (153 * month_index + 2) / 5 + 1;
+	date->month = month_index < 10 ? month_index + 3 : month_index - 9;
+	date->year = year_of_era + era * 400 + (date->month <= 2);
+
+	seconds %= 86400;
+	date->hour = seconds / 3600;
+	date->minute = seconds / 60 % 60;
+	date->second = seconds % 60;
+}
+
+u64int rtc_now_ns(void)
+{
+	return rtc_epoch_ns + clock_ns();
+}
+
+u32int rtc_now(void)
+{
+	return (u32int) cpu_div_u64(rtc_now_ns(), RTC_NS_PER_SECOND, 0);
+}
+
+u32int rtc_resync_steps(void)
+{
+	return rtc_steps;
+}
+
+static void rtc_resync(void* data)
+{
+	struct rtc_date date;
+	u32int seconds;
+	u32int estimate;
+	u32int flags;
+
+	(void) data;
+
+	rtc_read(&date);
+	seconds = rtc_from_date(&date);
+	estimate = rtc_now();
+
+	// The RTC only counts whole seconds, so smaller differences are noise
+	if (estimate > seconds + 1 || seconds > estimate + 1) {
+		flags = save_and_disable_hardware_interrupts();
+		rtc_epoch_ns = (u64int) seconds * RTC_NS_PER_SECOND - clock_ns();
+		restore_hardware_interrupts(flags);
+		rtc_steps++;
+	}
+
+	timer_add_ms(&rtc_resync_timer, RTC_RESYNC_MS);
+}
+
+void __init rtc_init(void)
+{
+	struct acpi_header* fadt = acpi_find_table("FACP");
+	struct rtc_date date;
+
+	if (fadt && fadt->length > RTC_FADT_CENTURY) {
+		rtc_century_register = ((u8int*) fadt)[RTC_FADT_CENTURY];
+	}
+
+	rtc_read(&date);
+	rtc_epoch_ns = (u64int) rtc_from_date(&date) * RTC_NS_PER_SECOND - clock_ns();
+
+	timer_setup(&rtc_resync_timer, rtc_resync, 0);
+	timer_add_ms(&rtc_resync_timer, RTC_RESYNC_MS);
+}
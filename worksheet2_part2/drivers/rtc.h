@@ -0,0 +1,74 @@
+#ifndef INCLUDE_RTC_H
+#define INCLUDE_RTC_H
+
+#include "type.h"
+
+/*
+    Wall-clock time. The CMOS real time clock is slow to read (an index
+    write and a data read per field, after waiting out any update), so it is
+    read once at boot and the time is carried forward with clock_ns(). A
+    timer compares the two every RTC_RESYNC_MS and steps the wall clock if
+    they have drifted more than a second apart (the RTC's resolution).
+*/
+#define CMOS_INDEX		0x70
+#define CMOS_DATA		0x71
+
+#define RTC_REG_SECONDS		0x00
+#define RTC_REG_MINUTES		0x02
+#define RTC_REG_HOURS		0x04
+#define RTC_REG_DAY		0x07
+#define RTC_REG_MONTH		0x08
+#define RTC_REG_YEAR		0x09
+#define RTC_REG_STATUS_A	0x0A
+#define RTC_REG_STATUS_B	0x0B
+
+#define RTC_STATUS_A_UPDATING	0x80
+#define RTC_STATUS_B_24_HOUR	0x02
+#define RTC_STATUS_B_BINARY	0x04
+#define RTC_HOUR_PM		0x80
+
+#define RTC_RESYNC_MS		600000
+#define RTC_DEFAULT_CENTURY	20
+
+/* Broken down UTC time */
+struct rtc_date {
+	u32int year;
+	u32int month;		/* 1..12 */
+	u32int day;		/* 1..31 */
+	u32int hour;
+	u32int minute;
+	u32int second;
+};
+
+/** rtc_init:
+ *  Reads the RTC and starts the periodic resync. Needs clock_init() and
+ *  timer_init() to have run.
+ */
+void rtc_init(void);
+
+/** rtc_read:
+ *  Reads the CMOS clock directly (slow; prefer rtc_now_ns()).
+ */
+void rtc_read(struct rtc_date* date);
+
+/** rtc_now_ns:
+ *  Returns nanoseconds since 1970-01-01 00:00:00 UTC, derived from
+ *  clock_ns() without touching the CMOS.
+ */
+u64int rtc_now_ns(void);
+
+/** rtc_now:
+ *  Returns seconds since the Unix epoch.
+ */
+u32int rtc_now(void);
+
+/** rtc_to_date / rtc_from_date:
+ *  Convert between Unix seconds and a broken down UTC date.
+ */
+void rtc_to_date(u32int seconds, struct rtc_date* date);
+u32int rtc_from_date(struct rtc_date* date);
+
+/* Number of times the resync had to step the wall clock */
+u32int rtc_resync_steps(void);
+
+#endif /* INCLUDE_RTC_H */
@@ -0,0 +1,95 @@
+#include "serial.h"
+#include "io.h"
+#include "input.h"
+#include "interrupts.h"
+#include "init.h"
+
+/*
+    16550 UART on COM1
+	From: https://wiki.osdev.org/Serial_Ports
+	Received bytes go into the terminal input buffer like keystrokes.
+*/
+
+#define SERIAL_LOOPBACK_TEST 0xAE
+
+static u32int serial_found = 0;
+
+static u32int serial_drain(u32int budget);
+
+static struct input_device serial_input = {
+	.name = "serial",
+	.irq = SERIAL_COM1_IRQ,
+	.drain = serial_drain,
+};
+
+/** serial_configure_baud_rate:
+ *  Sets the speed of the data being sent. The default speed of a serial
+ *  port is 115200 bits/s. The argument is a divisor of that number.
+ */
+static void serial_configure_baud_rate(u16int com, u16int divisor)
+{
+	outb(SERIAL_LINE_COMMAND_PORT(com), SERIAL_LINE_ENABLE_DLAB);
+	outb(SERIAL_DIVISOR_LOW_PORT(com), divisor & 0x00FF);
+	outb(SERIAL_DIVISOR_HIGH_PORT(com), (divisor >> 8) & 0x00FF);
+}
+
+/**
+  *  Reads up to budget received bytes into the input buffer. Carriage return
+  *  and DEL are translated to what the keyboard would have produced.
+  */
+static u32int serial_drain(u32int budget)
+{
+	u32int count = 0;
+	u8int data;
+
+	while (count < budget &&
+	       (inb(SERIAL_LINE_STATUS_PORT(SERIAL_COM1_BASE)) & SERIAL_STATUS_DATA_READY)) {
+		data = inb(SERIAL_DATA_PORT(SERIAL_COM1_BASE));
+		count++;
+
+		if (data == '\r') {
+			data = '\n';
+		} else if (data == 0x7F) {
+			data = '\b';
+		}
+		input_receive_char(data);
+	}
+	return count;
+}
+
+u32int __init serial_init(void)
+{
+	u16int com = SERIAL_COM1_BASE;
+
+	outb(SERIAL_INTERRUPT_ENABLE_PORT(com), 0x00);
+	serial_configure_baud_rate(com, 1);
+	outb(SERIAL_LINE_COMMAND_PORT(com), SERIAL_LINE_8N1);
+	outb(SERIAL_FIFO_COMMAND_PORT(com), SERIAL_FIFO_ENABLE_14);
+
+	// Loopback test: a missing UART reads back 0xFF
+	outb(SERIAL_MODEM_COMMAND_PORT(com), SERIAL_MODEM_LOOPBACK);
+	outb(SERIAL_DATA_PORT(com), SERIAL_LOOPBACK_TEST);
+	if (inb(SERIAL_DATA_PORT(com)) != SERIAL_LOOPBACK_TEST) {
+		return 0;
+	}
+
+	outb(SERIAL_MODEM_COMMAND_PORT(com), SERIAL_MODEM_NORMAL);
+	outb(SERIAL_INTERRUPT_ENABLE_PORT(com), SERIAL_INTERRUPT_RECEIVED);
+	serial_found = 1;
+
+	input_register(&serial_input);
+	return 1;
+}
+
+u32int serial_present(void)
+{
+	return serial_found;
+}
+
+void serial_write_byte(u8int data)
+{
+	while (!(inb(SERIAL_LINE_STATUS_PORT(SERIAL_COM1_BASE)) & SERIAL_STATUS_TRANSMIT_EMPTY)) {
+		// Wait for the transmit holding register
+	}
+	outb(SERIAL_DATA_PORT(SERIAL_COM1_BASE), data);
+}
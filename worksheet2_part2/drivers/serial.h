@@ -0,0 +1,53 @@
+#ifndef INCLUDE_SERIAL_H
+#define INCLUDE_SERIAL_H
+
+#include "type.h"
+
+/* The I/O ports */
+
+/* All the I/O ports are calculated relative to the data port. This is because
+ * all serial ports (COM1, COM2, COM3, COM4) have their ports in the same
+ * order, but they start at different values.
+ */
+#define SERIAL_COM1_BASE                0x3F8      /* COM1 base port */
+#define SERIAL_COM1_IRQ                 4
+
+#define SERIAL_DATA_PORT(base)          (base)
+#define SERIAL_INTERRUPT_ENABLE_PORT(base) (base + 1)
+#define SERIAL_FIFO_COMMAND_PORT(base)  (base + 2)
+#define SERIAL_LINE_COMMAND_PORT(base)  (base + 3)
+#define SERIAL_MODEM_COMMAND_PORT(base) (base + 4)
+#define SERIAL_LINE_STATUS_PORT(base)   (base + 5)
+/* While DLAB is set the first two ports hold the baud rate divisor */
+#define SERIAL_DIVISOR_LOW_PORT(base)   (base)
+#define SERIAL_DIVISOR_HIGH_PORT(base)  (base + 1)
+
+/* The I/O port commands */
+
+/* SERIAL_LINE_ENABLE_DLAB:
+ * Tells the serial port to expect first the highest 8 bits on the data port,
+ * then the lowest 8 bits will follow
+ */
+#define SERIAL_LINE_ENABLE_DLAB         0x80
+
+#define SERIAL_LINE_8N1                 0x03       /* 8 bits, no parity, one stop bit */
+#define SERIAL_FIFO_ENABLE_14           0xC7       /* enable + clear FIFOs, 14 byte threshold */
+#define SERIAL_MODEM_LOOPBACK           0x1E       /* RTS, OUT1, OUT2, loopback */
+#define SERIAL_MODEM_NORMAL             0x0F       /* DTR, RTS, OUT1, OUT2 (IRQ enable) */
+#define SERIAL_INTERRUPT_RECEIVED       0x01
+
+#define SERIAL_STATUS_DATA_READY        0x01
+#define SERIAL_STATUS_TRANSMIT_EMPTY    0x20
+
+/** serial_init:
+ *  Probes COM1, configures it for 115200 8N1 with FIFOs and registers it as
+ *  an input device. Does nothing if no UART answers.
+ *
+ *  @return 1 if the port is present
+ */
+u32int serial_init(void);
+
+u32int serial_present(void);
+void serial_write_byte(u8int data);
+
+#endif /* INCLUDE_SERIAL_H */
@@ -0,0 +1,352 @@
+#include "slab.h"
+#include "pmm.h"
+#include "framebuffer.h"
+#include "spinlock.h"
+#include "init.h"
+#ifdef HEAP_PROFILE
+#include "heapprof.h"
+#endif
+
+/*
+    Slabs
+	Every slab, and every block kmalloc() takes from the page allocator
+	directly, starts on a page boundary with a struct slab header. Any
+	pointer handed out therefore finds its header by rounding down to
+	SLAB_SIZE, which is all kfree() needs to know.
+
+	A slab sits on its cache's empty, partial or full list according to
+	how many of its objects are in use. Allocation prefers partial slabs
+	so that empty ones can be given back.
+
+	Each cache has a lock of its own, so CPUs allocating different sizes
+	do not wait on each other. The list of caches only changes when one
+	is created and is otherwise only walked for statistics, which a
+	reader writer lock lets any number of walkers do at once.
+*/
+
+struct slab {
+	u32int magic;
+	struct slab_cache* cache;	/* 0 for a large kmalloc block */
+	struct slab* next;
+	struct slab* prev;
+	void* free;			/* first free object */
+	u32int in_use;
+	u32int order;			/* page allocator order of a large block */
+};
+
+#define SLAB_HEADER_SIZE	((sizeof(struct slab) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+#define SLAB_OF(pointer)	((struct slab*) ((u32int) (pointer) & ~(SLAB_SIZE - 1)))
+#define SLAB_LINK(cache, object)	((void**) ((u8int*) (object) + (cache)->link_offset))
+
+static struct slab_cache slab_cache_cache;	/* where created caches come from */
+static struct slab_cache slab_kmalloc_caches[SLAB_KMALLOC_CLASSES];
+static struct slab_cache* slab_caches = 0;	/* all caches, for statistics */
+static struct rwlock slab_caches_lock = RWLOCK_INIT("slab caches");
+
+static const char* slab_kmalloc_names[SLAB_KMALLOC_CLASSES] = {
+	"kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+	"kmalloc-256", "kmalloc-512", "kmalloc-1024"
+};
+
+static volatile u32int slab_large_blocks = 0;
+
+/* Slab lists ****************************************************************/
+
+static struct slab** slab_list(struct slab_cache* cache, struct slab* slab)
+{
+	if (slab->in_use == 0) {
+		return &cache->empty;
+	}
+	return slab->in_use == cache->per_slab ? &cache->full : &cache->partial;
+}
+
+static void slab_link(struct slab** list, struct slab* slab)
+{
+	slab->prev = 0;
+	slab->next = *list;
+	if (slab->next) {
+		slab->next->prev = slab;
+	}
+	*list = slab;
+}
+
+static void slab_unlink(struct slab** list, struct slab* slab)
+{
+	if (slab->prev) {
+		slab->prev->next = slab->next;
+	} else {
+		*list = slab->next;
+	}
+	if (slab->next) {
+		slab->next->prev = slab->prev;
+	}
+}
+
+/* Gets a page, lays out and constructs its objects, and files it as empty */
+static struct slab* slab_grow(struct slab_cache* cache)
+{
+	u32int page = pmm_alloc_page();
+	struct slab* slab;
+	u8int* object;
+	u32int i;
+
+	if (!page) {
+		return 0;
+	}
+
+	slab = PMM_PHYS_TO_VIRT(page);
+	slab->magic = SLAB_MAGIC;
+	slab->cache = cache;
+	slab->in_use = 0;
+	slab->free = 0;
+
+	// Chain from the last object back so the list runs in address order
+	object = (u8int*) slab + SLAB_HEADER_SIZE + (cache->per_slab - 1) * cache->stride;
+	for (i = 0; i < cache->per_slab; i++, object -= cache->stride) {
+		if (cache->constructor) {
+			cache->constructor(object);
+		}
+		*SLAB_LINK(cache, object) = slab->free;
+		slab->free = object;
+	}
+
+	slab_link(&cache->empty, slab);
+	cache->empty_count++;
+	cache->slabs++;
+	return slab;
+}
+
+/* Caches ********************************************************************/
+
+static void slab_cache_setup(struct slab_cache* cache, const char* name, u32int size,
+			     void (*constructor)(void* object))
+{
+	u32int stride = (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+
+	if (stride < sizeof(void*)) {
+		stride = sizeof(void*);
+	}
+
+	cache->name = name;
+	cache->object_size = size;
+	cache->constructor = constructor;
+	// A constructed object must keep its contents while free
+	cache->link_offset = constructor ? stride : 0;
+	cache->stride = constructor ? stride + SLAB_ALIGN : stride;
+	cache->per_slab = (SLAB_SIZE - SLAB_HEADER_SIZE) / cache->stride;
+	cache->partial = 0;
+	cache->full = 0;
+	cache->empty = 0;
+	cache->empty_count = 0;
+	cache->slabs = 0;
+	cache->active = 0;
+	cache->allocations = 0;
+	cache->frees = 0;
+	spin_lock_init(&cache->lock, name);
+
+	rw_write_lock(&slab_caches_lock);
+	cache->next = slab_caches;
+	slab_caches = cache;
+	rw_write_unlock(&slab_caches_lock);
+}
+
+void __init slab_init(void)
+{
+	u32int i;
+
+	slab_cache_setup(&slab_cache_cache, "slab_cache", sizeof(struct slab_cache), 0);
+	for (i = 0; i < SLAB_KMALLOC_CLASSES; i++) {
+		slab_cache_setup(&slab_kmalloc_caches[i], slab_kmalloc_names[i],
+				 1 << (SLAB_KMALLOC_MIN_SHIFT + i), 0);
+	}
+}
+
+struct slab_cache* slab_cache_create(const char* name, u32int size, void (*constructor)(void* object))
+{
+	struct slab_cache* cache;
+
+	if (size == 0 || size + 2 * SLAB_ALIGN > SLAB_SIZE - SLAB_HEADER_SIZE) {
+		return 0;
+	}
+
+	cache = slab_alloc(&slab_cache_cache);
+	if (cache) {
+		slab_cache_setup(cache, name, size, constructor);
+	}
+	return cache;
+}
+
+void* slab_alloc(struct slab_cache* cache)
+{
+	u32int flags = spin_lock_irqsave(&cache->lock);
+	struct slab* slab = cache->partial;
+	void* object;
+
+	if (!slab) {
+		slab = cache->empty ? cache->empty : slab_grow(cache);
+		if (!slab) {
+			spin_unlock_irqrestore(&cache->lock, flags);
+			return 0;
+		}
+	}
+
+	slab_unlink(slab_list(cache, slab), slab);
+	if (slab->in_use == 0) {
+		cache->empty_count--;
+	}
+
+	object = slab->free;
+	slab->free = *SLAB_LINK(cache, object);
+	slab->in_use++;
+	slab_link(slab_list(cache, slab), slab);
+
+	cache->active++;
+	cache->allocations++;
+	spin_unlock_irqrestore(&cache->lock, flags);
+	return object;
+}
+
+void slab_free(struct slab_cache* cache, void* object)
+{
+	struct slab* slab = SLAB_OF(object);
+	u32int flags;
+
+	if (slab->magic != SLAB_MAGIC || slab->cache != cache) {
+		return; // Not one of ours
+	}
+
+	flags = spin_lock_irqsave(&cache->lock);
+	slab_unlink(slab_list(cache, slab), slab);
+
+	*SLAB_LINK(cache, object) = slab->free;
+	slab->free = object;
+	slab->in_use--;
+	cache->active--;
+	cache->frees++;
+
+	// Keep a few empty slabs for the next burst; the rest go back
+	if (slab->in_use == 0 && cache->empty_count >= SLAB_KEEP_EMPTY) {
+		slab->magic = 0;
+		cache->slabs--;
+		pmm_free_page(PMM_VIRT_TO_PHYS(slab));
+	} else {
+		if (slab->in_use == 0) {
+			cache->empty_count++;
+		}
+		slab_link(slab_list(cache, slab), slab);
+	}
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/* kmalloc *******************************************************************/
+
+static void* slab_kmalloc(u32int size)
+{
+	struct slab* block;
+	u32int order = 0;
+	u32int class = 0;
+	u32int page;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	if (size <= SLAB_KMALLOC_MAX) {
+		while ((1U << (SLAB_KMALLOC_MIN_SHIFT + class)) < size) {
+			class++;
+		}
+		return slab_alloc(&slab_kmalloc_caches[class]);
+	}
+
+	// Large: whole pages, with the header in front
+	while (((u32int) SLAB_SIZE << order) < size + SLAB_HEADER_SIZE) {
+		order++;
+	}
+	page = pmm_alloc_pages(order);
+	if (!page) {
+		return 0;
+	}
+
+	block = PMM_PHYS_TO_VIRT(page);
+	block->magic = SLAB_MAGIC;
+	block->cache = 0;
+	block->order = order;
+	atomic_add(&slab_large_blocks, 1);
+	return (u8int*) block + SLAB_HEADER_SIZE;
+}
+
+static void slab_kfree(void* pointer)
+{
+	struct slab* slab;
+
+	if (!pointer) {
+		return;
+	}
+
+	slab = SLAB_OF(pointer);
+	if (slab->magic != SLAB_MAGIC) {
+		return;
+	}
+	if (slab->cache) {
+		slab_free(slab->cache, pointer);
+		return;
+	}
+
+	slab->magic = 0;
+	atomic_add(&slab_large_blocks, (u32int) -1);
+	pmm_free_pages(PMM_VIRT_TO_PHYS(slab), slab->order);
+}
+
+void* kmalloc(u32int size)
+{
+#ifdef HEAP_PROFILE
+	u8int* block;
+
+	if (size == 0 || !(block = slab_kmalloc(size + HEAPPROF_HEADER_SIZE))) {
+		return 0;
+	}
+	heapprof_record_alloc(block, size, (u32int) __builtin_return_address(0));
+	return block + HEAPPROF_HEADER_SIZE;
+#else
+	return slab_kmalloc(size);
+#endif
+}
+
+void kfree(void* pointer)
+{
+#ifdef HEAP_PROFILE
+	if (pointer) {
+		pointer = (u8int*) pointer - HEAPPROF_HEADER_SIZE;
+		heapprof_record_free(pointer);
+	}
+#endif
+	slab_kfree(pointer);
+}
+
+void slab_print_stats(void)
+{
+	struct slab_cache* cache;
+
+	fb_write_string("cache: size, slabs, active/capacity, allocs, frees\n", FB_LIGHT_CYAN, FB_BLACK);
+	rw_read_lock(&slab_caches_lock);
+	for (cache = slab_caches; cache; cache = cache->next) {
+		fb_write_string((char*) cache->name, FB_WHITE, FB_BLACK);
+		fb_write_string(": ", FB_WHITE, FB_BLACK);
+		fb_write_number(cache->object_size, FB_WHITE, FB_BLACK);
+		fb_write_string(", ", FB_WHITE, FB_BLACK);
+		fb_write_number(cache->slabs, FB_WHITE, FB_BLACK);
+		fb_write_string(", ", FB_WHITE, FB_BLACK);
+		fb_write_number(cache->active, FB_WHITE, FB_BLACK);
+		fb_write_string("/", FB_WHITE, FB_BLACK);
+		fb_write_number(cache->slabs * cache->per_slab, FB_WHITE, FB_BLACK);
+		fb_write_string(", ", FB_WHITE, FB_BLACK);
+		fb_write_number(cache->allocations, FB_WHITE, FB_BLACK);
+		fb_write_string(", ", FB_WHITE, FB_BLACK);
+		fb_write_number(cache->frees, FB_WHITE, FB_BLACK);
+		fb_newline();
+	}
+	rw_read_unlock(&slab_caches_lock);
+	fb_write_string("large kmalloc blocks: ", FB_WHITE, FB_BLACK);
+	fb_write_number(slab_large_blocks, FB_WHITE, FB_BLACK);
+	fb_newline();
+}
@@ -0,0 +1,83 @@
+#ifndef INCLUDE_SLAB_H
+#define INCLUDE_SLAB_H
+
+#include "type.h"
+#include "spinlock.h"
+
+/*
+    Slab allocator. A cache hands out objects of one size, carved from
+    one page slabs; free objects are chained through a link stored in the
+    object itself, so a cached object costs no memory beyond its size
+    rounded up to SLAB_ALIGN.
+
+    kmalloc() picks the smallest of the power of two caches that fits and
+    sends anything larger than SLAB_KMALLOC_MAX straight to the page
+    allocator.
+*/
+#define SLAB_SIZE		4096
+#define SLAB_ALIGN		8
+#define SLAB_MAGIC		0x51AB51AB
+#define SLAB_KMALLOC_MIN_SHIFT	4	/* smallest kmalloc class: 16 bytes */
+#define SLAB_KMALLOC_CLASSES	7	/* 16 .. 1024 bytes */
+#define SLAB_KMALLOC_MAX	(1 << (SLAB_KMALLOC_MIN_SHIFT + SLAB_KMALLOC_CLASSES - 1))
+#define SLAB_KEEP_EMPTY		1	/* empty slabs a cache holds on to */
+
+struct slab;
+
+struct slab_cache {
+	const char* name;
+	u32int object_size;	/* as requested */
+	u32int stride;		/* distance between objects */
+	u32int link_offset;	/* where a free object keeps its next pointer */
+	u32int per_slab;
+	void (*constructor)(void* object);
+
+	struct spinlock lock;	/* the lists and statistics below */
+	struct slab* partial;
+	struct slab* full;
+	struct slab* empty;
+	u32int empty_count;
+
+	/* Statistics */
+	u32int slabs;
+	u32int active;
+	u32int allocations;
+	u32int frees;
+
+	struct slab_cache* next;
+};
+
+/** slab_init:
+ *  Sets up the kmalloc caches. Needs the physical memory manager.
+ */
+void slab_init(void);
+
+/** slab_cache_create:
+ *  Creates a cache of fixed size objects. A constructor, if given, runs
+ *  once when an object is first carved out of a new slab; objects must be
+ *  returned to the cache in their constructed state, and the free list
+ *  link is then kept after the object instead of inside it.
+ *
+ *  @return the cache, or 0 if size does not fit in a slab
+ */
+struct slab_cache* slab_cache_create(const char* name, u32int size, void (*constructor)(void* object));
+
+void* slab_alloc(struct slab_cache* cache);
+void slab_free(struct slab_cache* cache, void* object);
+
+/** kmalloc:
+ *  Allocates size bytes (aligned to SLAB_ALIGN), or returns 0.
+ */
+void* kmalloc(u32int size);
+
+/** kfree:
+ *  Frees memory from kmalloc(). A null pointer is ignored.
+ */
+void kfree(void* pointer);
+
+/** slab_print_stats:
+ *  Prints every cache with its object size, slab count and usage.
+ */
+void slab_print_stats(void);
+
+#endif /* INCLUDE_SLAB_H */
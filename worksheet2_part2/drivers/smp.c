@@ -0,0 +1,341 @@
+#include "smp.h"
+#include "acpi.h"
+#include "apic.h"
+#include "clock.h"
+#include "cpu.h"
+#include "gdt.h"
+#include "interrupts.h"
+#include "job.h"
+#include "paging.h"
+#include "pmm.h"
+#include "stack.h"
+#include "spinlock.h"
+#include "framebuffer.h"
+#include "hardware_interrupt_enabler.h"
+#include "init.h"
+
+/*
+    Start-up
+	From: http://wiki.osdev.org/Symmetric_Multiprocessing
+	APs are started one at a time, so a single parameter block in the
+	trampoline and smp_booting are enough to tell each where it stands.
+	If one does not come up in time the rest are not tried: it may still
+	wake up later, and must not find its index handed out again.
+
+	TLB shootdown
+	Every CPU caches translations of the shared kernel page tables. After
+	changing an entry a CPU flushes its own TLB, then sends SMP_TLB_VECTOR
+	to every other CPU and spins until each has cleared its bit in
+	smp_shootdown_targets. Page tables change on any CPU that runs a job
+	or takes a page fault, so two CPUs may start a shootdown at once: the
+	one that does not get the lock keeps answering the other's request
+	while it waits, since its interrupts are already off. A handler that
+	finds its bit clear (answered by polling) does nothing. The page table
+	locks, held across shootdowns, are taken the same way
+	(smp_lock_irqsave()).
+*/
+
+#define SMP_STACK_BYTES		((u32int) PMM_PAGE_SIZE << SMP_STACK_ORDER)
+#define SMP_INIT_DELAY_US	10000
+#define SMP_STARTUP_DELAY_US	200
+
+/* Laid out by smp_trampoline.s */
+struct smp_trampoline_params {
+	u32int boot_cr3;
+	u32int kernel_cr3;
+	u32int cr4;
+	u32int stack;
+	u32int entry;
+};
+
+extern u8int smp_trampoline_start[];
+extern u8int smp_trampoline_params[];
+extern u8int smp_trampoline_end[];
+extern u32int boot_page_directory[];	/* loader.asm */
+void smp_ap_entry(void);
+
+static struct smp_cpu smp_cpus[CPU_MAX];
+static u32int smp_count = 1;
+static volatile u32int smp_booting = 0;	/* index of the AP being started */
+
+static struct spinlock smp_shootdown_lock = SPINLOCK_INIT("tlb shootdown");
+static volatile u32int smp_shootdown_address = 0;
+static volatile u32int smp_shootdown_size = 0;
+static volatile u32int smp_shootdown_targets = 0;	/* CPUs yet to flush */
+
+static void smp_delay_us(u32int microseconds)
+{
+	u64int end = clock_ns() + (u64int) microseconds * 1000;
+
+	while (clock_ns() < end) {
+		cpu_relax();
+	}
+}
+
+/* Start-up ******************************************************************/
+
+void smp_ap_main(void)
+{
+	u32int index = smp_booting;
+
+	gdt_install_cpu();
+	interrupts_install_cpu();
+	apic_init_cpu();
+	smp_cpus[index].started = 1;
+
+	job_worker(index);
+}
+
+static u32int __init smp_start_cpu(struct smp_trampoline_params* params, u32int index, u32int apic_id)
+{
+	struct smp_cpu* cpu = &smp_cpus[index];
+	u32int stack = pmm_alloc_pages(SMP_STACK_ORDER);
+	u32int irq_stack = pmm_alloc_pages(SMP_STACK_ORDER);
+	u64int deadline;
+	u32int attempt;
+
+	if (!stack || !irq_stack) {
+		if (stack) {
+			pmm_free_pages(stack, SMP_STACK_ORDER);
+		}
+		if (irq_stack) {
+			pmm_free_pages(irq_stack, SMP_STACK_ORDER);
+		}
+		return 0;
+	}
+
+	cpu->apic_id = apic_id;
+	cpu->stack = PMM_PHYS_TO_VIRT(stack);
+	cpu->irq_stack = PMM_PHYS_TO_VIRT(irq_stack);
+	stack_paint(cpu->stack, SMP_STACK_BYTES - STACK_GUARD_SIZE);
+	stack_set_irq(index, cpu->irq_stack, SMP_STACK_BYTES - STACK_GUARD_SIZE);
+	cpu_set_index(apic_id, index);
+
+	params->stack = (u32int) cpu->stack + SMP_STACK_BYTES;
+	smp_booting = index;
+
+	// INIT, then up to two start-up IPIs, as the MP specification asks
+	apic_send_ipi(apic_id, APIC_ICR_INIT | APIC_ICR_LEVEL | APIC_ICR_ASSERT);
+	smp_delay_us(SMP_INIT_DELAY_US);
+	for (attempt = 0; attempt < 2 && !cpu->started; attempt++) {
+		apic_send_ipi(apic_id, APIC_ICR_STARTUP | (SMP_TRAMPOLINE >> 12));
+		smp_delay_us(SMP_STARTUP_DELAY_US);
+	}
+
+	deadline = clock_ns() + (u64int) SMP_START_TIMEOUT_MS * 1000000;
+	while (!cpu->started && clock_ns() < deadline) {
+		cpu_relax();
+	}
+	return cpu->started;
+}
+
+void __init smp_init(void)
+{
+	struct acpi_madt* madt;
+	struct acpi_madt_local_apic* entry;
+	struct smp_trampoline_params* params;
+	u8int* trampoline = PMM_PHYS_TO_VIRT(SMP_TRAMPOLINE);
+	u8int* next;
+	u8int* end;
+	u32int boot_id;
+	u32int i;
+
+	// The start-up delays need a clock that runs with interrupts off
+	if (!apic_enabled() || clock_current_source() == CLOCK_SOURCE_PIT) {
+		return;
+	}
+	madt = (struct acpi_madt*) acpi_find_table("APIC");
+	if (!madt) {
+		return;
+	}
+
+	boot_id = apic_current_id();
+	smp_cpus[0].apic_id = boot_id;
+	smp_cpus[0].started = 1;
+	cpu_set_index(boot_id, 0);
+	cpu_use_apic_ids(apic_id_register());
+
+	for (i = 0; i < (u32int) (smp_trampoline_end - smp_trampoline_start); i++) {
+		trampoline[i] = smp_trampoline_start[i];
+	}
+	params = (struct smp_trampoline_params*) (trampoline + (smp_trampoline_params - smp_trampoline_start));
+	params->boot_cr3 = PMM_VIRT_TO_PHYS(boot_page_directory);
+	params->kernel_cr3 = cpu_read_cr3();
+	params->cr4 = cpu_read_cr4();
+	params->entry = (u32int) smp_ap_entry;
+
+	next = (u8int*) (madt + 1);
+	end = (u8int*) madt + madt->header.length;
+	for (; next + sizeof(*entry) <= end && next[1] >= 2; next += next[1]) {
+		entry = (struct acpi_madt_local_apic*) next;
+		if (entry->type != ACPI_MADT_LOCAL_APIC || !(entry->flags & ACPI_MADT_ENABLED) ||
+		    entry->apic_id == boot_id) {
+			continue;
+		}
+		if (smp_count == CPU_MAX) {
+			break;
+		}
+		if (!smp_start_cpu(params, smp_count, entry->apic_id)) {
+			fb_write_string("SMP: CPU with APIC ID ", FB_LIGHT_RED, FB_BLACK);
+			fb_write_number(entry->apic_id, FB_LIGHT_RED, FB_BLACK);
+			fb_write_string(" did not start\n", FB_LIGHT_RED, FB_BLACK);
+			break;
+		}
+		smp_count++;
+	}
+}
+
+u32int smp_cpu_count(void)
+{
+	return smp_count;
+}
+
+void smp_wake(u32int cpu)
+{
+	apic_send_ipi(smp_cpus[cpu].apic_id, APIC_ICR_FIXED | SMP_WAKE_VECTOR);
+}
+
+/* TLB shootdown *************************************************************/
+
+void smp_shootdown(u32int virtual_address, u32int size)
+{
+	u32int self = apic_current_id();
+	u32int flags;
+	u32int cpu;
+
+	if (smp_count == 1) {
+		return;
+	}
+
+	flags = smp_lock_irqsave(&smp_shootdown_lock);
+	smp_shootdown_address = virtual_address;
+	smp_shootdown_size = size;
+	for (cpu = 0; cpu < smp_count; cpu++) {
+		if (smp_cpus[cpu].apic_id != self) {
+			atomic_or(&smp_shootdown_targets, 1 << cpu);
+		}
+	}
+	for (cpu = 0; cpu < smp_count; cpu++) {
+		if (smp_cpus[cpu].apic_id != self) {
+			apic_send_ipi(smp_cpus[cpu].apic_id, APIC_ICR_FIXED | SMP_TLB_VECTOR);
+		}
+	}
+	while (smp_shootdown_targets) {
+		cpu_relax();
+	}
+	spin_unlock_irqrestore(&smp_shootdown_lock, flags);
+}
+
+u32int smp_lock_irqsave(struct spinlock* lock)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	while (!spin_trylock(lock)) {
+		smp_handle_shootdown();
+		cpu_relax();
+	}
+	return flags;
+}
+
+void smp_handle_shootdown(void)
+{
+	u32int bit = 1 << cpu_current_id();
+
+	if (smp_shootdown_targets & bit) {
+		paging_flush_local(smp_shootdown_address, smp_shootdown_size);
+		atomic_and(&smp_shootdown_targets, ~bit);
+	}
+}
+
+/* Benchmark *****************************************************************/
+
+static volatile u32int smp_bench_sum = 0;
+
+/* parallel_for() body: sums SMP_BENCH_CHUNK byte pieces first..end-1 */
+static void smp_bench_range(u32int first, u32int end, void* data)
+{
+	const u32int* words = data;
+	u32int sum = 0;
+	u32int i;
+
+	for (i = first * (SMP_BENCH_CHUNK / 4); i < end * (SMP_BENCH_CHUNK / 4); i++) {
+		sum += words[i];
+	}
+	atomic_add(&smp_bench_sum, sum);
+}
+
+void smp_benchmark(u32int megabytes)
+{
+	u32int available = (pmm_physical_top() - SMP_BENCH_START) >> 20;
+	u32int* memory = PMM_PHYS_TO_VIRT(SMP_BENCH_START);
+	u32int chunks;
+	u64int serial;
+	u64int parallel;
+
+	if (megabytes > available) {
+		megabytes = available;
+	}
+	chunks = megabytes * ((1 << 20) / SMP_BENCH_CHUNK);
+
+	smp_bench_sum = 0;
+	serial = clock_ns();
+	smp_bench_range(0, chunks, memory);
+	serial = clock_ns() - serial;
+
+	smp_bench_sum = 0;
+	parallel = clock_ns();
+	parallel_for(chunks, smp_bench_range, memory);
+	parallel = clock_ns() - parallel;
+
+	fb_write_string("Checksum of ", FB_WHITE, FB_BLACK);
+	fb_write_number(megabytes, FB_WHITE, FB_BLACK);
+	fb_write_string(" MiB: 1 CPU ", FB_WHITE, FB_BLACK);
+	fb_write_number((u32int) cpu_div_u64(serial, 1000, 0), FB_WHITE, FB_BLACK);
+	fb_write_string(" us, ", FB_WHITE, FB_BLACK);
+	fb_write_number(smp_count, FB_WHITE, FB_BLACK);
+	fb_write_string(" CPUs ", FB_WHITE, FB_BLACK);
+	fb_write_number((u32int) cpu_div_u64(parallel, 1000, 0), FB_WHITE, FB_BLACK);
+	fb_write_string(" us, speedup x", FB_WHITE, FB_BLACK);
+	fb_write_number(parallel ? (u32int) cpu_div_u64(serial * 100, (u32int) parallel, 0) : 0,
+			FB_LIGHT_GREEN, FB_BLACK);
+	fb_write_string("/100\n", FB_WHITE, FB_BLACK);
+}
+
+/* Output ********************************************************************/
+
+/* Writes a number right aligned in a field of width characters */
+static void smp_write_column(u32int value, u32int width)
+{
+	u32int digits = 1;
+	u32int rest;
+
+	for (rest = value; rest >= 10; rest /= 10) {
+		digits++;
+	}
+	for (; digits < width; digits++) {
+		fb_write_char(' ', FB_WHITE, FB_BLACK);
+	}
+	fb_write_number(value, FB_WHITE, FB_BLACK);
+}
+
+void smp_print_info(void)
+{
+	struct job_stats stats;
+	u32int cpu;
+
+	fb_write_string("CPU APIC     JOBS   STOLEN   SLEEPS  IRQ STACK\n", FB_LIGHT_CYAN, FB_BLACK);
+	for (cpu = 0; cpu < smp_count; cpu++) {
+		job_get_stats(cpu, &stats);
+		smp_write_column(cpu, 3);
+		smp_write_column(smp_cpus[cpu].apic_id, 5);
+		smp_write_column(stats.run, 9);
+		smp_write_column(stats.stolen, 9);
+		smp_write_column(stats.sleeps, 9);
+		if (cpu == 0) {
+			fb_write_string("          -", FB_WHITE, FB_BLACK); // see the stack command
+		} else {
+			smp_write_column(stack_used(smp_cpus[cpu].irq_stack, SMP_STACK_BYTES - STACK_GUARD_SIZE), 11);
+		}
+		fb_newline();
+	}
+}
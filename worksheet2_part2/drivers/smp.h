@@ -0,0 +1,94 @@
+#ifndef INCLUDE_SMP_H
+#define INCLUDE_SMP_H
+
+#include "type.h"
+
+/*
+    Symmetric multiprocessing: finding the application processors (APs) in
+    the ACPI MADT and starting them with the INIT-SIPI-SIPI sequence.
+
+    An AP wakes up in real mode at SMP_TRAMPOLINE, where smp_init() copied
+    smp_trampoline.s. The trampoline switches to protected mode, turns on
+    paging with the boot page directory (which still identity maps the
+    first 4 MiB), then jumps to the higher half, loads the kernel's page
+    directory and calls smp_ap_main() on a stack of its own. From there
+    the AP loads the GDT and IDT, enables its local APIC and runs the job
+    pool (job.h) for the rest of its life.
+
+    CPU indexes are dense: 0 is the boot CPU, the APs follow in MADT order.
+    Only the boot CPU runs threads, the timer and device interrupts; APs
+    only ever take the IPIs below.
+
+    Try it with make run QEMU_SMP=4.
+*/
+#define SMP_TRAMPOLINE		0x8000	/* physical; page aligned, below 1 MiB */
+#define SMP_STACK_ORDER		1	/* 8 KiB AP stacks, guard included */
+#define SMP_START_TIMEOUT_MS	100
+#define SMP_BENCH_START		0x100000	/* smp bench reads memory from here */
+#define SMP_BENCH_CHUNK		65536		/* bytes per parallel_for() index */
+#define SMP_BENCH_MB		8		/* smp bench default */
+
+#define SMP_WAKE_VECTOR		0xFC	/* job waiting: leave hlt */
+#define SMP_TLB_VECTOR		0xFD	/* flush the TLB range in smp_shootdown_* */
+
+struct smp_cpu {
+	u32int apic_id;
+	volatile u32int started;
+	u32int* stack;		/* kernel stack, guard included */
+	u32int* irq_stack;
+};
+
+struct spinlock;
+
+/** smp_init:
+ *  Starts every enabled AP listed in the MADT, up to CPU_MAX CPUs in all.
+ *  Needs the APIC and a calibrated clock (TSC or HPET) for the start-up
+ *  delays; does nothing without them. Call with interrupts disabled,
+ *  after thread_init().
+ */
+void smp_init(void);
+
+/** smp_cpu_count:
+ *  @return the number of CPUs running, the boot CPU included
+ */
+u32int smp_cpu_count(void);
+
+/** smp_wake:
+ *  Sends SMP_WAKE_VECTOR to a CPU, to get it out of hlt.
+ */
+void smp_wake(u32int cpu);
+
+/** smp_shootdown:
+ *  Makes every other running CPU drop its TLB entries for a range and
+ *  waits until they have. Called by paging_flush() on any CPU; a no-op
+ *  on one CPU.
+ */
+void smp_shootdown(u32int virtual_address, u32int size);
+
+/** smp_lock_irqsave:
+ *  spin_lock_irqsave() for locks held across a shootdown, such as the
+ *  page table locks. Spinning with interrupts off, a waiter could not
+ *  answer the holder's SMP_TLB_VECTOR and both would wait forever, so
+ *  this answers shootdowns while it waits. Release the lock with
+ *  spin_unlock_irqrestore().
+ */
+u32int smp_lock_irqsave(struct spinlock* lock);
+
+/** smp_handle_shootdown:
+ *  SMP_TLB_VECTOR handler body; also polled by a CPU waiting to start a
+ *  shootdown of its own.
+ */
+void smp_handle_shootdown(void);
+
+/** smp_benchmark:
+ *  Checksums megabytes of memory on the calling CPU alone, then with
+ *  parallel_for(), and prints both times.
+ */
+void smp_benchmark(u32int megabytes);
+
+void smp_print_info(void);
+
+/* Entered from the trampoline, on the AP's own stack */
+void smp_ap_main(void) __attribute__((noreturn));
+
+#endif /* INCLUDE_SMP_H */
@@ -0,0 +1,91 @@
+global smp_trampoline_start
+global smp_trampoline_params
+global smp_trampoline_end
+global smp_ap_entry
+extern smp_ap_main
+
+SMP_TRAMPOLINE  equ 0x8000                   ; where smp_init() copies the code below; see smp.h
+CODE_SELECTOR   equ 0x08
+DATA_SELECTOR   equ 0x10
+CR0_PE          equ 0x00000001
+CR0_PG_WP       equ 0x80010000               ; paging, write protect in ring 0
+CR4_PSE         equ 0x00000010
+
+; Addresses inside the trampoline once it sits at SMP_TRAMPOLINE
+%define TRAMPOLINE(label) (SMP_TRAMPOLINE + (label) - smp_trampoline_start)
+
+; Only ever run from the copy, so it can live with the read-only data
+section .rodata
+
+; An AP starts here in real mode, CS:IP = SMP_TRAMPOLINE >> 4 : 0
+bits 16
+smp_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax                               ; offsets below are then physical addresses
+    o32 lgdt [TRAMPOLINE(trampoline_gdt_pointer)]
+
+    mov eax, cr0
+    or eax, CR0_PE
+    mov cr0, eax
+    jmp dword CODE_SELECTOR:TRAMPOLINE(trampoline_protected)
+
+bits 32
+trampoline_protected:
+    mov ax, DATA_SELECTOR
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; Paging with the boot directory, as in loader.asm: this code keeps
+    ; running through its identity mapping of the first 4 MiB
+    mov ecx, cr4
+    or ecx, CR4_PSE
+    mov cr4, ecx
+    mov ecx, [TRAMPOLINE(params_boot_cr3)]
+    mov cr3, ecx
+    mov ecx, cr0
+    or ecx, CR0_PG_WP
+    mov cr0, ecx
+
+    ; What smp_ap_entry needs, then off to the higher half
+    mov esp, [TRAMPOLINE(params_stack)]
+    mov edx, [TRAMPOLINE(params_kernel_cr3)]
+    mov esi, [TRAMPOLINE(params_cr4)]
+    mov eax, [TRAMPOLINE(params_entry)]
+    jmp eax
+
+align 8
+trampoline_gdt:                              ; flat code and data, like the kernel's
+    dq 0
+    dq 0x00CF9A000000FFFF
+    dq 0x00CF92000000FFFF
+trampoline_gdt_pointer:
+    dw 3 * 8 - 1
+    dd TRAMPOLINE(trampoline_gdt)
+
+; Filled in by smp_init() for each AP; struct smp_trampoline_params in smp.c
+align 4
+smp_trampoline_params:
+params_boot_cr3:    dd 0                     ; physical address of boot_page_directory
+params_kernel_cr3:  dd 0
+params_cr4:         dd 0                     ; the boot CPU's, for PGE and SSE
+params_stack:       dd 0                     ; top of the AP's kernel stack
+params_entry:       dd 0                     ; smp_ap_entry
+smp_trampoline_end:
+
+section .text
+
+; smp_ap_entry - first code of an AP in the higher half
+; edx: the kernel's page directory, esi: CR4, esp: the AP's stack
+smp_ap_entry:
+    mov cr4, esi
+    mov cr3, edx
+    call smp_ap_main                         ; never returns
+.halt:
+    cli
+    hlt
+    jmp .halt
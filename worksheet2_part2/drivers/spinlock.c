@@ -0,0 +1,336 @@
+#include "spinlock.h"
+#include "clock.h"
+#include "framebuffer.h"
+#include "hardware_interrupt_enabler.h"
+
+/*
+    Ticket locks
+	spin_lock() draws a ticket from next with one locked add and spins on
+	a plain read of owner, which stays in its own cache until the holder
+	hands the lock on. Only the holder writes owner, and x86 does not
+	reorder a store with earlier loads or stores, so releasing is a
+	compiler barrier and a plain increment.
+
+	Reader writer locks
+	state counts the readers inside, with RWLOCK_WRITER set while a
+	writer holds the lock and RWLOCK_WRITER_WAITING while one waits for
+	the readers to leave. Readers only come in while neither flag is set.
+	A writer takes the lock by swapping a state of nothing but (at most)
+	the waiting flag for RWLOCK_WRITER; other waiting writers set the
+	flag again on their next try.
+
+	Statistics
+	A lock registers itself on the list the locks command walks the first
+	time it is taken. The list only ever grows, at its head, so it can be
+	read without a lock. Counters of exclusive holders are protected by
+	the lock itself; readers share theirs, hence the locked adds.
+*/
+
+#define LOCK_KIND_SPIN	0
+#define LOCK_KIND_RW	1
+
+/* Atomics *******************************************************************/
+
+u32int atomic_swap(volatile u32int* target, u32int value)
+{
+	asm volatile("xchgl %0, %1" : "+r" (value), "+m" (*target) : : "memory");
+	return value;
+}
+
+u32int atomic_add(volatile u32int* target, u32int value)
+{
+	u32int old = value;
+
+	asm volatile("lock xaddl %0, %1" : "+r" (old), "+m" (*target) : : "memory");
+	return old + value;
+}
+
+u32int atomic_compare_swap(volatile u32int* target, u32int expected, u32int value)
+{
+	asm volatile("lock cmpxchgl %2, %1" : "+a" (expected), "+m" (*target) : "r" (value) : "memory");
+	return expected;
+}
+
+void atomic_or(volatile u32int* target, u32int bits)
+{
+	asm volatile("lock orl %1, %0" : "+m" (*target) : "r" (bits) : "memory");
+}
+
+void atomic_and(volatile u32int* target, u32int bits)
+{
+	asm volatile("lock andl %1, %0" : "+m" (*target) : "r" (bits) : "memory");
+}
+
+/* Statistics ****************************************************************/
+
+#ifdef LOCK_STATS
+
+static struct lock_stats* volatile lock_registry = 0;
+static const char* lock_kind_names[] = { "spin", "rw" };
+
+static void lock_stats_init(struct lock_stats* stats, const char* name)
+{
+	stats->name = name;
+	stats->next = 0;
+	stats->registered = 0;
+	stats->acquisitions = 0;
+	stats->contended = 0;
+	stats->spins = 0;
+	stats->acquired_at = 0;
+	stats->max_hold = 0;
+}
+
+static void lock_stats_register(struct lock_stats* stats, u32int kind)
+{
+	u32int head;
+
+	if (stats->registered || atomic_swap(&stats->registered, 1)) {
+		return;
+	}
+	stats->kind = kind;
+	do {
+		head = (u32int) lock_registry;
+		stats->next = (struct lock_stats*) head;
+	} while (atomic_compare_swap((volatile u32int*) &lock_registry, head, (u32int) stats) != head);
+}
+
+static void lock_stats_acquired(struct lock_stats* stats, u32int kind, u32int spins)
+{
+	lock_stats_register(stats, kind);
+	atomic_add(&stats->acquisitions, 1);
+	if (spins) {
+		atomic_add(&stats->contended, 1);
+		atomic_add(&stats->spins, spins);
+	}
+}
+
+/* Exclusive holders only: the lock protects acquired_at and max_hold */
+static void lock_stats_hold_start(struct lock_stats* stats)
+{
+	stats->acquired_at = cycles();
+}
+
+static void lock_stats_hold_end(struct lock_stats* stats)
+{
+	u64int held = cycles() - stats->acquired_at;
+
+	if (held > stats->max_hold) {
+		stats->max_hold = held;
+	}
+}
+
+/* Writes a number right aligned in a field of width characters */
+static void lock_write_column(u32int value, u32int width)
+{
+	u32int digits = 1;
+	u32int rest;
+
+	for (rest = value; rest >= 10; rest /= 10) {
+		digits++;
+	}
+	for (; digits < width; digits++) {
+		fb_write_char(' ', FB_WHITE, FB_BLACK);
+	}
+	fb_write_number(value, FB_WHITE, FB_BLACK);
+}
+
+void lock_print_stats(void)
+{
+	struct lock_stats* stats;
+	const char* name;
+	u32int used;
+
+	fb_write_string("LOCK              KIND  ACQUIRED CONTENDED     SPINS MAX HOLD ns\n", FB_LIGHT_CYAN, FB_BLACK);
+	for (stats = lock_registry; stats; stats = stats->next) {
+		name = stats->name ? stats->name : "?";
+		fb_write_string((char*) name, FB_WHITE, FB_BLACK);
+		for (used = 0; name[used]; used++) {
+		}
+		for (; used < 18; used++) {
+			fb_write_char(' ', FB_WHITE, FB_BLACK);
+		}
+		fb_write_string((char*) lock_kind_names[stats->kind], FB_WHITE, FB_BLACK);
+		lock_write_column(stats->acquisitions, stats->kind == LOCK_KIND_SPIN ? 10 : 12);
+		lock_write_column(stats->contended, 10);
+		lock_write_column(stats->spins, 10);
+		lock_write_column((u32int) cycles_to_ns(stats->max_hold), 12);
+		fb_newline();
+	}
+}
+
+#else
+
+void lock_print_stats(void)
+{
+	fb_write_string("Lock statistics are off; build with KERNEL_OPTIONS=-DLOCK_STATS\n", FB_LIGHT_RED, FB_BLACK);
+}
+
+#endif /* LOCK_STATS */
+
+/* Spinlocks *****************************************************************/
+
+void spin_lock_init(struct spinlock* lock, const char* name)
+{
+	lock->next = 0;
+	lock->owner = 0;
+#ifdef LOCK_STATS
+	lock_stats_init(&lock->stats, name);
+#else
+	(void) name;
+#endif
+}
+
+void spin_lock(struct spinlock* lock)
+{
+	u32int ticket = atomic_add(&lock->next, 1) - 1;
+	u32int spins = 0;
+
+	while (lock->owner != ticket) {
+		cpu_relax();
+		spins++;
+	}
+#ifdef LOCK_STATS
+	lock_stats_acquired(&lock->stats, LOCK_KIND_SPIN, spins);
+	lock_stats_hold_start(&lock->stats);
+#else
+	(void) spins;
+#endif
+}
+
+u32int spin_trylock(struct spinlock* lock)
+{
+	u32int ticket = lock->owner;
+
+	// Free exactly when nobody holds a ticket past the one being served
+	if (atomic_compare_swap(&lock->next, ticket, ticket + 1) != ticket) {
+		return 0;
+	}
+#ifdef LOCK_STATS
+	lock_stats_acquired(&lock->stats, LOCK_KIND_SPIN, 0);
+	lock_stats_hold_start(&lock->stats);
+#endif
+	return 1;
+}
+
+void spin_unlock(struct spinlock* lock)
+{
+#ifdef LOCK_STATS
+	lock_stats_hold_end(&lock->stats);
+#endif
+	asm volatile("" : : : "memory");
+	lock->owner++;
+}
+
+u32int spin_lock_irqsave(struct spinlock* lock)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	spin_lock(lock);
+	return flags;
+}
+
+void spin_unlock_irqrestore(struct spinlock* lock, u32int flags)
+{
+	spin_unlock(lock);
+	restore_hardware_interrupts(flags);
+}
+
+/* Reader writer locks *******************************************************/
+
+void rw_lock_init(struct rwlock* lock, const char* name)
+{
+	lock->state = 0;
+#ifdef LOCK_STATS
+	lock_stats_init(&lock->stats, name);
+#else
+	(void) name;
+#endif
+}
+
+void rw_read_lock(struct rwlock* lock)
+{
+	u32int spins = 0;
+	u32int state;
+
+	for (;;) {
+		state = lock->state;
+		if (!(state & (RWLOCK_WRITER | RWLOCK_WRITER_WAITING)) &&
+		    atomic_compare_swap(&lock->state, state, state + 1) == state) {
+			break;
+		}
+		cpu_relax();
+		spins++;
+	}
+#ifdef LOCK_STATS
+	lock_stats_acquired(&lock->stats, LOCK_KIND_RW, spins);
+#else
+	(void) spins;
+#endif
+}
+
+void rw_read_unlock(struct rwlock* lock)
+{
+	atomic_add(&lock->state, (u32int) -1);
+}
+
+void rw_write_lock(struct rwlock* lock)
+{
+	u32int spins = 0;
+	u32int state;
+
+	for (;;) {
+		state = lock->state;
+		if ((state & ~RWLOCK_WRITER_WAITING) == 0 &&
+		    atomic_compare_swap(&lock->state, state, RWLOCK_WRITER) == state) {
+			break;
+		}
+		if (!(state & RWLOCK_WRITER_WAITING)) {
+			atomic_or(&lock->state, RWLOCK_WRITER_WAITING);
+		}
+		cpu_relax();
+		spins++;
+	}
+#ifdef LOCK_STATS
+	lock_stats_acquired(&lock->stats, LOCK_KIND_RW, spins);
+	lock_stats_hold_start(&lock->stats);
+#else
+	(void) spins;
+#endif
+}
+
+void rw_write_unlock(struct rwlock* lock)
+{
+#ifdef LOCK_STATS
+	lock_stats_hold_end(&lock->stats);
+#endif
+	// Keeps the flag of a writer waiting behind us
+	atomic_and(&lock->state, ~RWLOCK_WRITER);
+}
+
+u32int rw_read_lock_irqsave(struct rwlock* lock)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	rw_read_lock(lock);
+	return flags;
+}
+
+void rw_read_unlock_irqrestore(struct rwlock* lock, u32int flags)
+{
+	rw_read_unlock(lock);
+	restore_hardware_interrupts(flags);
+}
+
+u32int rw_write_lock_irqsave(struct rwlock* lock)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	rw_write_lock(lock);
+	return flags;
+}
+
+void rw_write_unlock_irqrestore(struct rwlock* lock, u32int flags)
+{
+	rw_write_unlock(lock);
+	restore_hardware_interrupts(flags);
+}
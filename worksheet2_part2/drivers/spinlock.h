@@ -0,0 +1,130 @@
+#ifndef INCLUDE_SPINLOCK_H
+#define INCLUDE_SPINLOCK_H
+
+#include "type.h"
+
+/*
+    Locks and atomic operations, for state shared between CPUs or between
+    an interrupt handler and the code it interrupts.
+
+    Disabling interrupts (save_and_disable_hardware_interrupts()) only
+    keeps the calling CPU out; once application processors run kernel
+    code, anything they share with the boot CPU needs a lock as well. A
+    holder must not sleep or wait for an interrupt. Take the _irqsave
+    variants whenever an interrupt handler on the same CPU may want the
+    lock too, or it would spin forever on the lock its own CPU holds.
+
+    Spinlocks are ticket locks: each CPU draws a ticket and waits for its
+    number to be served, so waiters get the lock in arrival order. Reader
+    writer locks let any number of readers in at once; a waiting writer
+    holds off new readers so it cannot be starved.
+
+    Built with KERNEL_OPTIONS=-DLOCK_STATS, every lock counts its
+    acquisitions, the ones that had to wait, the total spins and the
+    longest hold (writers only, for reader writer locks); the locks
+    command lists every lock taken so far.
+*/
+
+#ifdef LOCK_STATS
+struct lock_stats {
+	const char* name;
+	struct lock_stats* next;	/* registered on first acquisition */
+	volatile u32int registered;
+	u32int kind;
+	volatile u32int acquisitions;
+	volatile u32int contended;
+	volatile u32int spins;
+	u64int acquired_at;		/* cycles() when the holder got it */
+	u64int max_hold;		/* in cycles */
+};
+
+#define LOCK_STATS_INIT(lock_name)	, .stats = { .name = lock_name }
+#else
+#define LOCK_STATS_INIT(lock_name)
+#endif
+
+struct spinlock {
+	volatile u32int next;		/* ticket for the next to arrive */
+	volatile u32int owner;		/* ticket now holding the lock */
+#ifdef LOCK_STATS
+	struct lock_stats stats;
+#endif
+};
+
+/* A reader count, and the two flags below */
+struct rwlock {
+	volatile u32int state;
+#ifdef LOCK_STATS
+	struct lock_stats stats;
+#endif
+};
+
+#define RWLOCK_WRITER		0x80000000
+#define RWLOCK_WRITER_WAITING	0x40000000
+
+/* Static initializers; name shows up in the locks command */
+#define SPINLOCK_INIT(lock_name)	{ .next = 0, .owner = 0 LOCK_STATS_INIT(lock_name) }
+#define RWLOCK_INIT(lock_name)		{ .state = 0 LOCK_STATS_INIT(lock_name) }
+
+void spin_lock_init(struct spinlock* lock, const char* name);
+void spin_lock(struct spinlock* lock);
+void spin_unlock(struct spinlock* lock);
+
+/** spin_trylock:
+ *  Takes the lock if it is free, without drawing a ticket otherwise.
+ *
+ *  @return 1 if the lock is now held, 0 if someone else has it
+ */
+u32int spin_trylock(struct spinlock* lock);
+
+/** spin_lock_irqsave:
+ *  Disables interrupts, then takes the lock.
+ *
+ *  @return the flags to pass to spin_unlock_irqrestore()
+ */
+u32int spin_lock_irqsave(struct spinlock* lock);
+void spin_unlock_irqrestore(struct spinlock* lock, u32int flags);
+
+void rw_lock_init(struct rwlock* lock, const char* name);
+void rw_read_lock(struct rwlock* lock);
+void rw_read_unlock(struct rwlock* lock);
+void rw_write_lock(struct rwlock* lock);
+void rw_write_unlock(struct rwlock* lock);
+u32int rw_read_lock_irqsave(struct rwlock* lock);
+void rw_read_unlock_irqrestore(struct rwlock* lock, u32int flags);
+u32int rw_write_lock_irqsave(struct rwlock* lock);
+void rw_write_unlock_irqrestore(struct rwlock* lock, u32int flags);
+
+/** lock_print_stats:
+ *  Lists the statistics of every lock taken so far (LOCK_STATS builds).
+ */
+void lock_print_stats(void);
+
+/** atomic_add:
+ *  Adds value to *target as one locked operation.
+ *
+ *  @return the new value
+ */
+u32int atomic_add(volatile u32int* target, u32int value);
+
+/** atomic_swap:
+ *  Stores value in *target.
+ *
+ *  @return the previous value
+ */
+u32int atomic_swap(volatile u32int* target, u32int value);
+
+/** atomic_compare_swap:
+ *  Stores value in *target if it still holds expected.
+ *
+ *  @return what *target held; the store happened if that is expected
+ */
+u32int atomic_compare_swap(volatile u32int* target, u32int expected, u32int value);
+
+void atomic_or(volatile u32int* target, u32int bits);
+void atomic_and(volatile u32int* target, u32int bits);
+
+/* Tells a hyper-threaded sibling (and the memory system) we are spinning */
+#define cpu_relax()	asm volatile("pause" : : : "memory")
+
+#endif /* INCLUDE_SPINLOCK_H */
@@ -0,0 +1,148 @@
+#include "stack.h"
+#include "cpu.h"
+#include "framebuffer.h"
+#include "init.h"
+
+/*
+    Stack layout (addresses grow to the right, stacks grow to the left)
+
+	| guard: STACK_CANARY ... | painted ... used | top
+	^ kernel_stack / stack_irq_memory
+
+	The guard word right below the usable area is the first one an
+	overflow reaches, so stack_check() only looks at that one; the
+	shell command scans the whole guard.
+*/
+
+/* Reserved in loader.asm with the same layout */
+extern u32int kernel_stack[];
+
+static u32int stack_irq_memory[(STACK_GUARD_SIZE + IRQ_STACK_SIZE) / 4] __attribute__((aligned(16)));
+
+/* The boot CPU's is static; application processors get theirs from smp_init() */
+u32int stack_irq_bottom[CPU_MAX] = { (u32int) stack_irq_memory };
+u32int stack_irq_top[CPU_MAX] = { (u32int) stack_irq_memory + STACK_GUARD_SIZE + IRQ_STACK_SIZE };
+
+static const char* stack_names[STACK_COUNT] = { "boot", "interrupt" };
+
+static u32int* stack_base(u32int stack)
+{
+	return stack == STACK_BOOT ? kernel_stack : stack_irq_memory;
+}
+
+static u32int stack_size(u32int stack)
+{
+	return stack == STACK_BOOT ? KERNEL_STACK_SIZE : IRQ_STACK_SIZE;
+}
+
+void __init stack_init(void)
+{
+	u32int esp;
+	u32int* word;
+	u32int stack;
+
+	asm volatile("mov %%esp, %0" : "=r" (esp));
+
+	for (stack = 0; stack < STACK_COUNT; stack++) {
+		for (word = stack_base(stack); word < stack_base(stack) + STACK_GUARD_SIZE / 4; word++) {
+			*word = STACK_CANARY;
+		}
+		// Leave alone what the boot stack already holds; the interrupt
+		// stack is not in use yet and gets painted in full
+		for (; word < stack_base(stack) + (STACK_GUARD_SIZE + stack_size(stack)) / 4
+		       && (stack != STACK_BOOT || (u32int) word < esp - 64); word++) {
+			*word = STACK_PAINT;
+		}
+	}
+}
+
+void stack_paint(u32int* base, u32int size)
+{
+	u32int* word;
+
+	for (word = base; word < base + STACK_GUARD_SIZE / 4; word++) {
+		*word = STACK_CANARY;
+	}
+	for (; word < base + (STACK_GUARD_SIZE + size) / 4; word++) {
+		*word = STACK_PAINT;
+	}
+}
+
+u32int stack_used(u32int* base, u32int size)
+{
+	u32int* word = base + STACK_GUARD_SIZE / 4;
+	u32int* top = base + (STACK_GUARD_SIZE + size) / 4;
+
+	while (word < top && *word == STACK_PAINT) {
+		word++;
+	}
+	return (top - word) * 4;
+}
+
+void stack_overflow(const char* name)
+{
+	fb_write_string("\nStack overflow: ", FB_LIGHT_RED, FB_BLACK);
+	fb_write_string((char*) name, FB_LIGHT_RED, FB_BLACK);
+	fb_write_string(" stack guard overwritten. System halted.", FB_LIGHT_RED, FB_BLACK);
+	for (;;) {
+		asm volatile("cli; hlt");
+	}
+}
+
+void stack_set_irq(u32int cpu, u32int* base, u32int size)
+{
+	stack_paint(base, size);
+	stack_irq_bottom[cpu] = (u32int) base;
+	stack_irq_top[cpu] = (u32int) base + STACK_GUARD_SIZE + size;
+}
+
+void stack_check(void)
+{
+	u32int* irq_stack = (u32int*) stack_irq_bottom[cpu_current_id()];
+
+	if (kernel_stack[STACK_GUARD_SIZE / 4 - 1] != STACK_CANARY) {
+		stack_overflow(stack_names[STACK_BOOT]);
+	}
+	if (irq_stack[STACK_GUARD_SIZE / 4 - 1] != STACK_CANARY) {
+		stack_overflow(stack_names[STACK_IRQ]);
+	}
+}
+
+void stack_get_info(u32int stack, struct stack_info* info)
+{
+	u32int* base;
+
+	info->name = stack_names[stack];
+	info->size = stack_size(stack);
+
+	info->guard_intact = 1;
+	for (base = stack_base(stack); base < stack_base(stack) + STACK_GUARD_SIZE / 4; base++) {
+		if (*base != STACK_CANARY) {
+			info->guard_intact = 0;
+		}
+	}
+	info->high_water = stack_used(stack_base(stack), stack_size(stack));
+}
+
+void stack_print_info(void)
+{
+	struct stack_info info;
+	u32int stack;
+
+	for (stack = 0; stack < STACK_COUNT; stack++) {
+		stack_get_info(stack, &info);
+		fb_write_string((char*) info.name, FB_WHITE, FB_BLACK);
+		fb_write_string(" stack: ", FB_WHITE, FB_BLACK);
+		fb_write_number(info.high_water, FB_WHITE, FB_BLACK);
+		fb_write_string(" of ", FB_WHITE, FB_BLACK);
+		fb_write_number(info.size, FB_WHITE, FB_BLACK);
+		fb_write_string(" bytes used at most (", FB_WHITE, FB_BLACK);
+		fb_write_number(info.high_water * 100 / info.size, FB_WHITE, FB_BLACK);
+		fb_write_string("%), guard ", FB_WHITE, FB_BLACK);
+		if (info.guard_intact) {
+			fb_write_string("intact\n", FB_LIGHT_GREEN, FB_BLACK);
+		} else {
+			fb_write_string("OVERWRITTEN\n", FB_LIGHT_RED, FB_BLACK);
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#ifndef INCLUDE_STACK_H
+#define INCLUDE_STACK_H
+
+#include "type.h"
+
+/*
+    Kernel stacks. The boot stack (reserved in loader.asm) runs kmain and
+    the shell; interrupt handlers switch to a separate interrupt stack on
+    entry, unless they interrupted a handler already running on it. Each
+    CPU has an interrupt stack of its own; the one reported here is the
+    boot CPU's.
+
+    Below each stack sits a guard of STACK_GUARD_SIZE bytes filled with
+    STACK_CANARY; the rest is painted with STACK_PAINT at boot, so the
+    deepest point either stack ever reached can be found by scanning for
+    the first word that no longer holds the paint.
+
+    Sizes can be set at build time, e.g. make KERNEL_STACK_SIZE=32768.
+*/
+#ifndef KERNEL_STACK_SIZE
+#define KERNEL_STACK_SIZE	16384
+#endif
+#ifndef IRQ_STACK_SIZE
+#define IRQ_STACK_SIZE		8192
+#endif
+/* One value for loader.asm and C alike: the Makefile passes it to both */
+#ifndef STACK_GUARD_SIZE
+#error "STACK_GUARD_SIZE comes from the Makefile's STACK_OPTIONS"
+#endif
+#define STACK_CANARY		0xDEADC0DE
+#define STACK_PAINT		0x5A5A5A5A
+
+#define STACK_BOOT		0
+#define STACK_IRQ		1
+#define STACK_COUNT		2
+
+struct stack_info {
+	const char* name;
+	u32int size;		/* usable bytes, without the guard */
+	u32int high_water;	/* deepest use seen, in bytes */
+	u32int guard_intact;
+};
+
+/** stack_init:
+ *  Fills the guards and paints the unused part of both stacks. Call first
+ *  thing in kmain, with interrupts disabled.
+ */
+void stack_init(void);
+
+/** stack_check:
+ *  Cheap check, run on every return from the outermost interrupt: halts
+ *  with a report if the guard word next to the boot stack or the calling
+ *  CPU's interrupt stack was overwritten.
+ */
+void stack_check(void);
+
+/** stack_set_irq:
+ *  Paints a stack of size usable bytes above base and makes it the
+ *  interrupt stack of a CPU. Call before the CPU takes interrupts.
+ */
+void stack_set_irq(u32int cpu, u32int* base, u32int size);
+
+/** stack_paint:
+ *  Gives a stack of size usable bytes above base the same guard and paint,
+ *  for stacks allocated later (thread stacks).
+ */
+void stack_paint(u32int* base, u32int size);
+
+/** stack_used:
+ *  @return the deepest use of a painted stack, in bytes
+ */
+u32int stack_used(u32int* base, u32int size);
+
+/** stack_overflow:
+ *  Reports an overwritten guard and halts.
+ */
+void stack_overflow(const char* name);
+
+void stack_get_info(u32int stack, struct stack_info* info);
+void stack_print_info(void);
+
+/* Used by common_interrupt_handler to find the interrupt stack, by CPU index */
+extern u32int stack_irq_bottom[];
+extern u32int stack_irq_top[];
+
+#endif /* INCLUDE_STACK_H */
@@ -0,0 +1,130 @@
+#include "symbols.h"
+#include "pmm.h"
+#include "framebuffer.h"
+#include "init.h"
+
+static const char* symbols_start = 0;
+static const char* symbols_end = 0;
+
+/* Does the module command line end in SYMBOLS_MODULE_NAME? */
+static u32int symbols_is_module(const char* string)
+{
+	const char* name = SYMBOLS_MODULE_NAME;
+	u32int length = 0;
+	u32int name_length = 0;
+
+	while (string[length]) {
+		length++;
+	}
+	while (name[name_length]) {
+		name_length++;
+	}
+	if (length < name_length) {
+		return 0;
+	}
+
+	string += length - name_length;
+	while (*name && *name == *string) {
+		name++;
+		string++;
+	}
+	return *name == '\0';
+}
+
+void __init symbols_init(struct multiboot_info* info)
+{
+	struct multiboot_module* modules;
+	u32int i;
+
+	if (!(info->flags & MULTIBOOT_INFO_MODULES)) {
+		return;
+	}
+
+	modules = PMM_PHYS_TO_VIRT(info->mods_addr);
+	for (i = 0; i < info->mods_count; i++) {
+		if (modules[i].string && symbols_is_module(PMM_PHYS_TO_VIRT(modules[i].string))) {
+			symbols_start = PMM_PHYS_TO_VIRT(modules[i].start);
+			symbols_end = PMM_PHYS_TO_VIRT(modules[i].end);
+			return;
+		}
+	}
+}
+
+u32int symbols_present(void)
+{
+	return symbols_start != 0;
+}
+
+/* Parses the address at the start of a line; 0 if it is not one */
+static u32int symbols_parse_line(const char* line, u32int* address)
+{
+	u32int value = 0;
+	u32int digits;
+	char c;
+
+	for (digits = 0; digits < 8 && line + digits < symbols_end; digits++) {
+		c = line[digits];
+		if (c >= '0' && c <= '9') {
+			value = value << 4 | (c - '0');
+		} else if (c >= 'a' && c <= 'f') {
+			value = value << 4 | (c - 'a' + 10);
+		} else {
+			return 0;
+		}
+	}
+	// "xxxxxxxx T name"
+	if (digits != 8 || line + 11 >= symbols_end || line[8] != ' ' || line[10] != ' ') {
+		return 0;
+	}
+	*address = value;
+	return 1;
+}
+
+const char* symbols_lookup(u32int address, u32int* length, u32int* offset)
+{
+	const char* line = symbols_start;
+	const char* best = 0;
+	u32int best_address = 0;
+	u32int symbol;
+
+	// Sorted by address: the last symbol at or below address wins
+	while (line && line < symbols_end) {
+		if (symbols_parse_line(line, &symbol)) {
+			if (symbol > address) {
+				break;
+			}
+			best = line + 11;
+			best_address = symbol;
+		}
+		while (line < symbols_end && *line != '\n') {
+			line++;
+		}
+		line++;
+	}
+
+	if (!best) {
+		return 0;
+	}
+	for (*length = 0; best + *length < symbols_end && best[*length] != '\n'; (*length)++) {
+	}
+	*offset = address - best_address;
+	return best;
+}
+
+void symbols_write(u32int address, unsigned char fg, unsigned char bg)
+{
+	u32int length;
+	u32int offset;
+	const char* name = symbols_lookup(address, &length, &offset);
+	u32int i;
+
+	if (!name) {
+		fb_write_hex(address, fg, bg);
+		return;
+	}
+	for (i = 0; i < length; i++) {
+		fb_write_char(name[i], fg, bg);
+	}
+	fb_write_string("+", fg, bg);
+	fb_write_number(offset, fg, bg);
+}
@@ -0,0 +1,38 @@
+#ifndef INCLUDE_SYMBOLS_H
+#define INCLUDE_SYMBOLS_H
+
+#include "type.h"
+#include "multiboot.h"
+
+/*
+    Kernel symbol table. The build writes the text symbols of kernel.elf,
+    sorted by address (nm -n), to kernel.sym and GRUB loads that file as a
+    boot module. Lines look like "c0100010 T kmain"; the module is used in
+    place, nothing is copied.
+*/
+#define SYMBOLS_MODULE_NAME	"kernel.sym"
+
+/** symbols_init:
+ *  Finds the symbol module among those GRUB loaded. Without it, addresses
+ *  are printed as plain hex.
+ */
+void symbols_init(struct multiboot_info* info);
+
+u32int symbols_present(void);
+
+/** symbols_lookup:
+ *  Finds the symbol containing an address.
+ *
+ *  @param length Receives the length of the name (it is not terminated)
+ *  @param offset Receives address minus the symbol's address
+ *  @return the name, or 0 if no symbol starts at or below address
+ */
+const char* symbols_lookup(u32int address, u32int* length, u32int* offset);
+
+/** symbols_write:
+ *  Prints an address as name+offset (in bytes), or as hex if it has no
+ *  symbol.
+ */
+void symbols_write(u32int address, unsigned char fg, unsigned char bg);
+
+#endif /* INCLUDE_SYMBOLS_H */
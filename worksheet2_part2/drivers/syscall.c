@@ -0,0 +1,184 @@
+#include "syscall.h"
+#include "gdt.h"
+#include "cpu.h"
+#include "interrupts.h"
+#include "framebuffer.h"
+#include "paging.h"
+#include "init.h"
+
+/*
+    System calls
+	Two entry paths into the same dispatch table: a DPL 3 trap gate at
+	int 0x80, and SYSENTER/SYSEXIT, which skips the IDT lookup, the
+	privilege checks and the stack frame of an interrupt.
+*/
+
+#define SYSCALL_STACK_SIZE	4096
+
+typedef u32int (*syscall_function)(u32int arg1, u32int arg2, u32int arg3);
+
+/* Kernel stack for ring 3 -> ring 0 transitions (TSS esp0 and SYSENTER) */
+static u8int syscall_stack[SYSCALL_STACK_SIZE] __attribute__((aligned(16)));
+static u32int syscall_bench_active = 0;
+static u32int syscall_bench_mapped = 0;
+static u32int syscall_have_sysenter = 0;
+
+static u32int sys_nop(u32int arg1, u32int arg2, u32int arg3)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	return 0;
+}
+
+/**
+  *  Whether [address, address + length) is user memory that is mapped now,
+  *  so the kernel can read it for the caller without faulting.
+  */
+static u32int syscall_user_readable(u32int address, u32int length)
+{
+	u32int page;
+	u32int flags;
+
+	if (length > KERNEL_VIRTUAL_BASE || address > KERNEL_VIRTUAL_BASE - length) {
+		return 0;
+	}
+	if (!length) {
+		return 1;
+	}
+	for (page = address & PAGING_FRAME_MASK; page < address + length; page += PAGING_PAGE_SIZE) {
+		if (!paging_translate(page, &flags) || !(flags & PAGING_USER)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static u32int sys_write(u32int buffer, u32int length, u32int arg3)
+{
+	const char* str = (const char*) buffer;
+	u32int i;
+
+	(void)arg3;
+	if (!syscall_user_readable(buffer, length)) {
+		return SYSCALL_ERROR;
+	}
+	for (i = 0; i < length; i++) {
+		fb_putchar(str[i]);
+	}
+	return length;
+}
+
+static u32int sys_bench_done(u32int arg1, u32int arg2, u32int arg3)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+	if (!syscall_bench_active) {
+		return SYSCALL_ERROR;
+	}
+	syscall_bench_active = 0;
+	syscall_bench_resume();
+	return 0; // Not reached
+}
+
+static syscall_function syscall_table[SYSCALL_COUNT] = {
+	[SYSCALL_NOP] = sys_nop,
+	[SYSCALL_WRITE] = sys_write,
+	[SYSCALL_BENCH_DONE] = sys_bench_done,
+};
+
+u32int syscall_dispatch(struct syscall_frame* frame)
+{
+	if (frame->eax >= SYSCALL_COUNT || !syscall_table[frame->eax]) {
+		return SYSCALL_ERROR;
+	}
+	return syscall_table[frame->eax](frame->ebx, frame->esi, frame->edi);
+}
+
+void __init syscall_init(void)
+{
+	u32int stack_top = (u32int) &syscall_stack[SYSCALL_STACK_SIZE];
+
+	gdt_set_kernel_stack(stack_top);
+	interrupts_init_gate(SYSCALL_VECTOR, (u32int) syscall_int80_entry,
+		INTERRUPTS_GATE_TRAP, GDT_RPL_USER);
+
+	syscall_have_sysenter = cpu_has_feature(CPU_FEATURE_SEP) && cpu_has_feature(CPU_FEATURE_MSR);
+	if (syscall_have_sysenter) {
+		cpu_write_msr(SYSENTER_CS_MSR, GDT_KERNEL_CODE);
+		cpu_write_msr(SYSENTER_ESP_MSR, stack_top);
+		cpu_write_msr(SYSENTER_EIP_MSR, (u32int) syscall_sysenter_entry);
+	}
+}
+
+static void syscall_print_cycles(char* label, u64int start, u64int end, u32int iterations)
+{
+	// Truncated to 32 bits: iterations are kept small enough for that
+	u32int cycles = (u32int) (end - start);
+
+	fb_write_string(label, FB_WHITE, FB_BLACK);
+	fb_write_number(cycles / iterations, FB_LIGHT_GREEN, FB_BLACK);
+	fb_write_string(" cycles/call\n", FB_WHITE, FB_BLACK);
+}
+
+/* Ring 3 cannot touch kernel pages, so the user half gets its own mappings */
+static u32int syscall_bench_map(void)
+{
+	u32int code = (u32int) syscall_bench_user & PAGING_FRAME_MASK;
+	u32int data;
+	u32int i;
+
+	if (syscall_bench_mapped) {
+		return 1;
+	}
+
+	data = pmm_alloc_page();
+	if (!data) {
+		return 0;
+	}
+	for (i = 0; i < SYSCALL_BENCH_CODE_PAGES; i++) {
+		if (!paging_map(SYSCALL_BENCH_CODE + i * PAGING_PAGE_SIZE,
+				paging_translate(code + i * PAGING_PAGE_SIZE, 0), PAGING_USER)) {
+			break;
+		}
+	}
+	if (i == SYSCALL_BENCH_CODE_PAGES &&
+	    paging_map(SYSCALL_BENCH_DATA, data, PAGING_USER | PAGING_WRITABLE)) {
+		syscall_bench_mapped = 1;
+		return 1;
+	}
+
+	// Undo the code pages mapped so far; their frames are the kernel's own
+	while (i--) {
+		paging_unmap(SYSCALL_BENCH_CODE + i * PAGING_PAGE_SIZE);
+	}
+	pmm_free_page(data);
+	return 0;
+}
+
+void syscall_benchmark(u32int iterations)
+{
+	struct syscall_bench_result* result = (struct syscall_bench_result*) SYSCALL_BENCH_DATA;
+	u32int entry = SYSCALL_BENCH_CODE + ((u32int) syscall_bench_user & ~PAGING_FRAME_MASK);
+
+	if (!cpu_has_feature(CPU_FEATURE_TSC)) {
+		fb_write_string("sysbench: no time stamp counter\n", FB_LIGHT_RED, FB_BLACK);
+		return;
+	}
+	if (!syscall_bench_map()) {
+		fb_write_string("sysbench: cannot map the user pages\n", FB_LIGHT_RED, FB_BLACK);
+		return;
+	}
+
+	result->has_sysenter = syscall_have_sysenter;
+	syscall_bench_active = 1;
+	syscall_bench_enter(iterations, result, SYSCALL_BENCH_DATA + PAGING_PAGE_SIZE, entry);
+
+	syscall_print_cycles("int 0x80: ", result->start, result->int80_end, iterations);
+	if (result->has_sysenter) {
+		syscall_print_cycles("sysenter: ", result->int80_end, result->sysenter_end, iterations);
+	} else {
+		fb_write_string("sysenter: not supported by this CPU\n", FB_WHITE, FB_BLACK);
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef INCLUDE_SYSCALL_H
+#define INCLUDE_SYSCALL_H
+
+#include "type.h"
+
+/*
+    System call ABI, identical for both entry paths:
+	eax = system call number, ebx/esi/edi = arguments 1-3, eax = result.
+	int 0x80 preserves every other register.
+	sysenter additionally takes the return ESP in ecx and EIP in edx
+	(they cannot carry arguments because SYSEXIT consumes them).
+*/
+#define SYSCALL_VECTOR		0x80
+
+#define SYSCALL_NOP		0
+#define SYSCALL_WRITE		1	// write(buffer, length) to the console
+#define SYSCALL_BENCH_DONE	2	// internal: ends a sysbench run
+#define SYSCALL_COUNT		3
+
+#define SYSCALL_ERROR		0xFFFFFFFF
+
+/* SYSENTER model specific registers */
+#define SYSENTER_CS_MSR		0x174
+#define SYSENTER_ESP_MSR	0x175
+#define SYSENTER_EIP_MSR	0x176
+
+/* Registers as pushed by both entry stubs */
+struct syscall_frame {
+	u32int eax;
+	u32int ebx;
+	u32int ecx;
+	u32int edx;
+	u32int esi;
+	u32int edi;
+} __attribute__((packed));
+
+/* Filled in by the ring 3 half of the benchmark; offsets used in syscall_asm.s */
+struct syscall_bench_result {
+	u64int start;
+	u64int int80_end;
+	u64int sysenter_end;
+	u32int has_sysenter;
+} __attribute__((packed));
+
+/*
+    User mappings for the ring 3 half of the benchmark: an alias of the
+    kernel pages holding its (position independent) code, and a page for
+    its stack and results.
+*/
+#define SYSCALL_BENCH_CODE	0x00400000
+#define SYSCALL_BENCH_CODE_PAGES	2	/* the code may straddle a page */
+#define SYSCALL_BENCH_DATA	(SYSCALL_BENCH_CODE + SYSCALL_BENCH_CODE_PAGES * 4096)
+
+/** syscall_init:
+ *  Installs the int 0x80 trap gate (callable from ring 3) and, when the CPU
+ *  supports it, programs the SYSENTER MSRs.
+ */
+void syscall_init(void);
+
+u32int syscall_dispatch(struct syscall_frame* frame);
+
+/** syscall_benchmark:
+ *  Drops to ring 3 and times a number of null system calls through each
+ *  entry path, then prints the average round trip in cycles.
+ */
+void syscall_benchmark(u32int iterations);
+
+// Wrappers around ASM.
+void syscall_int80_entry();
+void syscall_sysenter_entry();
+void syscall_bench_enter(u32int iterations, struct syscall_bench_result* result, u32int user_stack_top, u32int user_entry);
+void syscall_bench_resume();
+void syscall_bench_user();
+
+#endif /* INCLUDE_SYSCALL_H */
@@ -0,0 +1,162 @@
+; System call entry points and the ring 3 half of the sysbench benchmark.
+; Both entry points build a struct syscall_frame (eax first) on the kernel
+; stack and call syscall_dispatch with a pointer to it.
+
+extern syscall_dispatch
+
+SYSCALL_NOP             equ 0
+SYSCALL_BENCH_DONE      equ 2
+KERNEL_DATA_SELECTOR    equ 0x10
+USER_CODE_SELECTOR      equ 0x18 | 3
+USER_DATA_SELECTOR      equ 0x20 | 3
+
+section .text
+
+global  syscall_int80_entry
+
+; syscall_int80_entry - int 0x80 trap gate. The CPU has already switched to
+;                       the TSS kernel stack and pushed the iret frame.
+syscall_int80_entry:
+        push    edi
+        push    esi
+        push    edx
+        push    ecx
+        push    ebx
+        push    eax
+
+        push    esp                     ; struct syscall_frame *
+        call    syscall_dispatch        ; result in eax
+
+        add     esp, 8                  ; drop the frame pointer and saved eax
+        pop     ebx
+        pop     ecx
+        pop     edx
+        pop     esi
+        pop     edi
+        iret
+
+global  syscall_sysenter_entry
+
+; syscall_sysenter_entry - SYSENTER target. ESP comes from SYSENTER_ESP_MSR
+;                          and interrupts are disabled; ecx/edx hold the
+;                          user ESP/EIP for SYSEXIT.
+syscall_sysenter_entry:
+        push    edi
+        push    esi
+        push    edx
+        push    ecx
+        push    ebx
+        push    eax
+
+        push    esp                     ; struct syscall_frame *
+        call    syscall_dispatch        ; result in eax
+
+        add     esp, 8                  ; drop the frame pointer and saved eax
+        pop     ebx
+        pop     ecx                     ; user ESP
+        pop     edx                     ; user EIP
+        pop     esi
+        pop     edi
+        sti                             ; takes effect after sysexit
+        sysexit
+
+global  syscall_bench_enter
+
+; syscall_bench_enter - Saves the kernel context and irets to the user
+;                       mapping of syscall_bench_user in ring 3. Returns
+;                       when the user side issues SYSCALL_BENCH_DONE.
+; stack: [esp + 16] the user entry point
+;        [esp + 12] the user stack top
+;        [esp +  8] the struct syscall_bench_result address
+;        [esp +  4] the number of iterations
+;        [esp     ] the return address
+syscall_bench_enter:
+        push    ebx
+        push    esi
+        push    edi
+        push    ebp
+        mov     [syscall_bench_kernel_esp], esp
+
+        mov     esi, [esp + 20]         ; iterations
+        mov     edi, [esp + 24]         ; results
+        mov     ecx, [esp + 28]         ; user stack top
+        mov     edx, [esp + 32]         ; user entry point
+
+        mov     ax, USER_DATA_SELECTOR
+        mov     ds, ax
+        mov     es, ax
+
+        push    dword USER_DATA_SELECTOR        ; ss
+        push    ecx                             ; esp
+        pushfd                                  ; eflags
+        push    dword USER_CODE_SELECTOR        ; cs
+        push    edx                             ; eip
+        iret
+
+global  syscall_bench_resume
+
+; syscall_bench_resume - Called from the SYSCALL_BENCH_DONE handler; abandons
+;                        the system call stack and returns from
+;                        syscall_bench_enter.
+syscall_bench_resume:
+        mov     ax, KERNEL_DATA_SELECTOR
+        mov     ds, ax
+        mov     es, ax
+
+        mov     esp, [syscall_bench_kernel_esp]
+        pop     ebp
+        pop     edi
+        pop     esi
+        pop     ebx
+        ret
+
+global  syscall_bench_user
+
+; syscall_bench_user - Ring 3. esi = iterations, edi = struct syscall_bench_result.
+;                      Position independent, so it runs from a user
+;                      mapping of this page.
+syscall_bench_user:
+        call    .base
+.base:
+        pop     ebx
+        add     ebx, .sysenter_return - .base   ; SYSEXIT lands here
+
+        rdtsc
+        mov     [edi], eax              ; start
+        mov     [edi + 4], edx
+
+        mov     ebp, esi
+.int80_loop:
+        mov     eax, SYSCALL_NOP
+        int     0x80
+        dec     ebp
+        jnz     .int80_loop
+
+        rdtsc
+        mov     [edi + 8], eax          ; int80_end
+        mov     [edi + 12], edx
+
+        cmp     dword [edi + 24], 0     ; has_sysenter
+        je      .done
+
+        mov     ebp, esi
+.sysenter_loop:
+        mov     eax, SYSCALL_NOP
+        mov     ecx, esp
+        mov     edx, ebx
+        sysenter
+.sysenter_return:
+        dec     ebp
+        jnz     .sysenter_loop
+
+.done:
+        rdtsc
+        mov     [edi + 16], eax         ; sysenter_end
+        mov     [edi + 20], edx
+
+        mov     eax, SYSCALL_BENCH_DONE
+        int     0x80                    ; does not return
+
+section .bss
+syscall_bench_kernel_esp:
+        resd    1
@@ -0,0 +1,193 @@
+#include "textprof.h"
+#include "slab.h"
+#include "symbols.h"
+#include "serial.h"
+#include "framebuffer.h"
+#include "hardware_interrupt_enabler.h"
+
+#define TEXTPROF_MASK		(TEXTPROF_ADDRESSES - 1)
+
+struct textprof_address {
+	u32int eip;		/* 0 for a free slot */
+	u32int samples;
+};
+
+/* Samples folded into the function containing them */
+struct textprof_function {
+	const char* name;	/* in the symbol module, not terminated */
+	u32int length;
+	u32int samples;
+};
+
+static struct textprof_address textprof_addresses[TEXTPROF_ADDRESSES];
+static u32int textprof_used = 0;
+static u32int textprof_total = 0;
+static u32int textprof_dropped = 0;	/* samples that found the table full */
+
+void textprof_sample(u32int eip)
+{
+	u32int slot = (eip * 2654435761U) >> 22 & TEXTPROF_MASK;
+	u32int probes;
+
+	textprof_total++;
+	for (probes = 0; probes < TEXTPROF_ADDRESSES; probes++, slot = (slot + 1) & TEXTPROF_MASK) {
+		if (textprof_addresses[slot].eip == eip) {
+			textprof_addresses[slot].samples++;
+			return;
+		}
+		if (!textprof_addresses[slot].eip) {
+			// Keep one slot free so misses stop quickly
+			if (textprof_used == TEXTPROF_ADDRESSES - 1) {
+				break;
+			}
+			textprof_addresses[slot].eip = eip;
+			textprof_addresses[slot].samples = 1;
+			textprof_used++;
+			return;
+		}
+	}
+	textprof_dropped++;
+}
+
+void textprof_reset(void)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+	u32int i;
+
+	for (i = 0; i < TEXTPROF_ADDRESSES; i++) {
+		textprof_addresses[i].eip = 0;
+	}
+	textprof_used = 0;
+	textprof_total = 0;
+	textprof_dropped = 0;
+	restore_hardware_interrupts(flags);
+}
+
+/* Output ********************************************************************/
+
+#ifdef TEXT_PROFILE
+
+/* Writes to the screen and, when there is one, the serial port */
+static void textprof_write(const char* string, u32int length)
+{
+	u32int i;
+
+	for (i = 0; i < length; i++) {
+		fb_write_char(string[i], FB_WHITE, FB_BLACK);
+		if (serial_present()) {
+			serial_write_byte(string[i]);
+		}
+	}
+}
+
+static void textprof_write_string(const char* string)
+{
+	u32int length = 0;
+
+	while (string[length]) {
+		length++;
+	}
+	textprof_write(string, length);
+}
+
+static void textprof_write_number(u32int value)
+{
+	char digits[10];
+	u32int count = 0;
+
+	do {
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (count) {
+		textprof_write(&digits[--count], 1);
+	}
+}
+
+/* Adds samples to the function named name, or starts a new one */
+static u32int textprof_fold(struct textprof_function* functions, u32int count,
+			    const char* name, u32int length, u32int samples)
+{
+	u32int i;
+
+	// Names point into the module, so one function always has one pointer
+	for (i = 0; i < count; i++) {
+		if (functions[i].name == name) {
+			functions[i].samples += samples;
+			return count;
+		}
+	}
+	functions[count].name = name;
+	functions[count].length = length;
+	functions[count].samples = samples;
+	return count + 1;
+}
+
+void textprof_print(void)
+{
+	struct textprof_function* functions;
+	struct textprof_function swap;
+	const char* name;
+	u32int unknown = 0;
+	u32int count = 0;
+	u32int length;
+	u32int offset;
+	u32int i;
+	u32int j;
+
+	if (!symbols_present()) {
+		fb_write_string("No kernel.sym module: samples cannot be named\n", FB_LIGHT_RED, FB_BLACK);
+		return;
+	}
+	// One entry per sampled address at worst: 12 KiB, too much for the shell arena
+	functions = kmalloc(TEXTPROF_ADDRESSES * sizeof(struct textprof_function));
+	if (!functions) {
+		fb_write_string("Out of memory\n", FB_LIGHT_RED, FB_BLACK);
+		return;
+	}
+
+	// Samples keep arriving meanwhile; a few more or less make no difference
+	for (i = 0; i < TEXTPROF_ADDRESSES; i++) {
+		if (!textprof_addresses[i].eip) {
+			continue;
+		}
+		name = symbols_lookup(textprof_addresses[i].eip, &length, &offset);
+		if (name) {
+			count = textprof_fold(functions, count, name, length, textprof_addresses[i].samples);
+		} else {
+			unknown += textprof_addresses[i].samples;
+		}
+	}
+
+	textprof_write_string("/* ");
+	textprof_write_number(textprof_total);
+	textprof_write_string(" samples, ");
+	textprof_write_number(unknown + textprof_dropped);
+	textprof_write_string(" outside known functions */\n");
+
+	// Selection sort of the first few: only TEXTPROF_TOP are shown
+	for (i = 0; i < count && i < TEXTPROF_TOP; i++) {
+		for (j = i + 1; j < count; j++) {
+			if (functions[j].samples > functions[i].samples) {
+				swap = functions[i];
+				functions[i] = functions[j];
+				functions[j] = swap;
+			}
+		}
+		textprof_write_string("*(.text.");
+		textprof_write(functions[i].name, functions[i].length);
+		textprof_write_string(")  /* ");
+		textprof_write_number(functions[i].samples);
+		textprof_write_string(" */\n");
+	}
+	kfree(functions);
+}
+
+#else
+
+void textprof_print(void)
+{
+	fb_write_string("Text profiling is off; build with KERNEL_OPTIONS=-DTEXT_PROFILE\n", FB_LIGHT_RED, FB_BLACK);
+}
+
+#endif /* TEXT_PROFILE */
@@ -0,0 +1,34 @@
+#ifndef INCLUDE_TEXTPROF_H
+#define INCLUDE_TEXTPROF_H
+
+#include "type.h"
+
+/*
+    Sampling code profiler for the text layout, built in with
+    KERNEL_OPTIONS=-DTEXT_PROFILE.
+
+    Every timer tick records the interrupted EIP in a fixed size hash
+    table. textprof_print() folds the samples into functions with the
+    symbol module and prints the hottest ones as linker script lines,
+    "*(.text.name)", ready to paste into source/text_order.ld. The kernel
+    is compiled with -ffunction-sections, so that file decides which
+    functions share the first pages of .text.
+*/
+#define TEXTPROF_ADDRESSES	1024	/* power of two */
+#define TEXTPROF_TOP		24	/* functions printed */
+
+/** textprof_sample:
+ *  Called by the timer interrupt with the EIP it interrupted.
+ */
+void textprof_sample(u32int eip);
+
+/** textprof_print:
+ *  Prints the hottest functions, also to the serial port when there is
+ *  one so the list can be captured. The per function totals are
+ *  sorted in a table taken from kmalloc().
+ */
+void textprof_print(void);
+
+void textprof_reset(void);
+
+#endif /* INCLUDE_TEXTPROF_H */
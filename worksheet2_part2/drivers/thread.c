@@ -0,0 +1,421 @@
+#include "thread.h"
+#include "pmm.h"
+#include "stack.h"
+#include "zeropool.h"
+#include "framebuffer.h"
+#include "hardware_interrupt_enabler.h"
+#include "init.h"
+
+/*
+    Switching
+	A thread that is not running has its context on its own stack, as
+	pushed by thread_switch(): EFLAGS, EDI, ESI, EBX, EBP and the address
+	to return to. A new thread's stack is made to look the same, returning
+	into thread_start() with interrupts off.
+
+	All scheduler state is only touched with interrupts disabled.
+*/
+
+/* Reserved in loader.asm; the boot thread keeps running on it */
+extern u32int kernel_stack[];
+
+#define THREAD_STACK_BYTES	((u32int) PMM_PAGE_SIZE << THREAD_STACK_ORDER)
+#define THREAD_EFLAGS		0x2	/* reserved bit set, IF clear */
+#define THREAD_EFLAGS_IF	0x200
+
+static struct thread thread_table[THREAD_MAX];
+static struct thread* thread_queue_heads[THREAD_PRIORITIES];
+static struct thread* thread_queue_tails[THREAD_PRIORITIES];
+static u32int thread_ready_mask = 0;		/* bit n: queue n is not empty */
+static struct thread* thread_running = 0;	/* 0 until thread_init() */
+static struct thread* thread_waiters = 0;	/* in thread_wait_interrupt() */
+static struct thread* thread_dead = 0;		/* exited, stack not yet freed */
+static u32int thread_next_id = 0;
+
+volatile u32int thread_need_resched = 0;
+
+static const char* thread_state_names[] = { "unused", "running", "ready", "sleeping", "waiting", "dead" };
+
+/* Run queues ****************************************************************/
+
+static void thread_enqueue(struct thread* thread)
+{
+	u32int priority = thread->priority;
+
+	thread->state = THREAD_READY;
+	thread->next = 0;
+	if (thread_queue_tails[priority]) {
+		thread_queue_tails[priority]->next = thread;
+	} else {
+		thread_queue_heads[priority] = thread;
+	}
+	thread_queue_tails[priority] = thread;
+	thread_ready_mask |= 1 << priority;
+}
+
+static struct thread* thread_dequeue(void)
+{
+	struct thread* thread;
+	u32int priority;
+
+	if (!thread_ready_mask) {
+		return 0;
+	}
+	asm("bsf %1, %0" : "=r" (priority) : "rm" (thread_ready_mask));
+
+	thread = thread_queue_heads[priority];
+	thread_queue_heads[priority] = thread->next;
+	if (!thread_queue_heads[priority]) {
+		thread_queue_tails[priority] = 0;
+		thread_ready_mask &= ~(1 << priority);
+	}
+	thread->next = 0;
+	return thread;
+}
+
+/* Queues a thread and asks for a switch if it should run before the current one */
+static void thread_make_ready(struct thread* thread)
+{
+	thread_enqueue(thread);
+	if (thread->priority < thread_running->priority) {
+		thread_need_resched = 1;
+	}
+}
+
+/* Frees the stack of a thread that exited, once it is no longer in use */
+static void thread_reap(void)
+{
+	struct thread* thread = thread_dead;
+
+	if (!thread || thread == thread_running) {
+		return;
+	}
+	thread_dead = 0;
+	if (thread->stack != kernel_stack) {
+		pmm_free_pages(PMM_VIRT_TO_PHYS(thread->stack), THREAD_STACK_ORDER);
+	}
+	thread->state = THREAD_UNUSED;
+}
+
+/**
+  *  Switches to the highest priority ready thread. The current thread goes
+  *  to the back of its queue if it is still runnable; otherwise its state
+  *  says what it is waiting for. Interrupts must be disabled.
+  */
+static void thread_schedule(void)
+{
+	struct thread* previous = thread_running;
+	struct thread* next;
+
+	thread_need_resched = 0;
+	if (previous->state == THREAD_RUNNING) {
+		thread_enqueue(previous);
+	}
+	next = thread_dequeue();
+
+	next->state = THREAD_RUNNING;
+	next->slice = THREAD_TIMESLICE;
+	if (next == previous) {
+		return;
+	}
+
+	if (previous->stack[STACK_GUARD_SIZE / 4 - 1] != STACK_CANARY) {
+		stack_overflow(previous->name);
+	}
+	next->switches++;
+	thread_running = next;
+	thread_switch(&previous->esp, next->esp);
+
+	// Running again: previous is whoever switched back to us
+	thread_reap();
+}
+
+/* Threads ******************************************************************/
+
+static void thread_start(void)
+{
+	struct thread* thread = thread_running;
+
+	thread_reap();
+	enable_hardware_interrupts();
+	thread->entry(thread->arg);
+	thread_exit();
+}
+
+static void thread_wake(struct thread* thread)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	if (thread->state == THREAD_SLEEPING) {
+		thread_make_ready(thread);
+	}
+	restore_hardware_interrupts(flags);
+}
+
+static void thread_timer_expired(void* data)
+{
+	thread_wake(data);
+}
+
+static void thread_set_name(struct thread* thread, const char* name)
+{
+	u32int i;
+
+	for (i = 0; i < THREAD_NAME_LENGTH - 1 && name[i]; i++) {
+		thread->name[i] = name[i];
+	}
+	thread->name[i] = '\0';
+}
+
+/* Runs when nothing else can: spare time goes to zeroing pages */
+static void thread_idle_loop(void* arg)
+{
+	(void) arg;
+
+	for (;;) {
+		if (zeropool_refill_one()) {
+			continue;
+		}
+		disable_hardware_interrupts();
+		if (thread_ready_mask) {
+			enable_hardware_interrupts();
+			thread_yield();
+		} else {
+			timer_idle();
+		}
+	}
+}
+
+void __init thread_init(void)
+{
+	struct thread* boot = &thread_table[0];
+
+	boot->id = thread_next_id++;
+	boot->state = THREAD_RUNNING;
+	boot->priority = THREAD_PRIORITY_HIGH;
+	boot->slice = THREAD_TIMESLICE;
+	boot->stack = kernel_stack;
+	boot->stack_size = KERNEL_STACK_SIZE;
+	thread_set_name(boot, "shell");
+	timer_setup(&boot->timer, thread_timer_expired, boot);
+	thread_running = boot;
+
+	if (!thread_spawn("idle", thread_idle_loop, 0, THREAD_PRIORITY_IDLE)) {
+		// No memory for stacks: stay single threaded
+		boot->state = THREAD_UNUSED;
+		thread_running = 0;
+	}
+}
+
+struct thread* thread_spawn(const char* name, void (*entry)(void* arg), void* arg, u32int priority)
+{
+	struct thread* thread = 0;
+	u32int* top;
+	u32int physical;
+	u32int flags;
+	u32int i;
+
+	if (!thread_running) {
+		return 0;
+	}
+	if (priority > THREAD_PRIORITY_IDLE) {
+		priority = THREAD_PRIORITY_IDLE;
+	}
+	physical = pmm_alloc_pages(THREAD_STACK_ORDER);
+	if (!physical) {
+		return 0;
+	}
+
+	flags = save_and_disable_hardware_interrupts();
+	for (i = 0; i < THREAD_MAX; i++) {
+		if (thread_table[i].state == THREAD_UNUSED) {
+			thread = &thread_table[i];
+			break;
+		}
+	}
+	if (!thread) {
+		restore_hardware_interrupts(flags);
+		pmm_free_pages(physical, THREAD_STACK_ORDER);
+		return 0;
+	}
+
+	thread->id = thread_next_id++;
+	thread->priority = priority;
+	thread->stack = PMM_PHYS_TO_VIRT(physical);
+	thread->stack_size = THREAD_STACK_BYTES - STACK_GUARD_SIZE;
+	thread->ticks = 0;
+	thread->switches = 0;
+	thread->entry = entry;
+	thread->arg = arg;
+	thread_set_name(thread, name);
+	timer_setup(&thread->timer, thread_timer_expired, thread);
+	stack_paint(thread->stack, thread->stack_size);
+
+	// What thread_switch() expects to pop, returning into thread_start()
+	top = thread->stack + THREAD_STACK_BYTES / 4;
+	*--top = 0;			/* thread_start() never returns */
+	*--top = (u32int) thread_start;
+	*--top = 0;			/* ebp */
+	*--top = 0;			/* ebx */
+	*--top = 0;			/* esi */
+	*--top = 0;			/* edi */
+	*--top = THREAD_EFLAGS;
+	thread->esp = (u32int) top;
+
+	thread_make_ready(thread);
+	if (thread_need_resched && (flags & THREAD_EFLAGS_IF)) {
+		thread_schedule();
+	}
+	restore_hardware_interrupts(flags);
+	return thread;
+}
+
+struct thread* thread_current(void)
+{
+	return thread_running;
+}
+
+void thread_yield(void)
+{
+	u32int flags;
+
+	if (!thread_running) {
+		return;
+	}
+	flags = save_and_disable_hardware_interrupts();
+	thread_schedule();
+	restore_hardware_interrupts(flags);
+}
+
+void thread_sleep(u32int ms)
+{
+	u32int flags;
+
+	if (!thread_running) {
+		ksleep(ms);
+		return;
+	}
+	flags = save_and_disable_hardware_interrupts();
+	thread_running->state = THREAD_SLEEPING;
+	timer_add_ms(&thread_running->timer, ms);
+	thread_schedule();
+	restore_hardware_interrupts(flags);
+}
+
+void thread_exit(void)
+{
+	disable_hardware_interrupts();
+	thread_running->state = THREAD_DEAD;
+	thread_dead = thread_running;
+	thread_schedule();
+
+	// The stack is gone by now; nothing switches back here
+	for (;;) {
+		asm volatile("hlt");
+	}
+}
+
+void thread_wait_interrupt(void)
+{
+	if (!thread_running) {
+		timer_idle();
+		return;
+	}
+	thread_running->state = THREAD_WAITING;
+	thread_running->next = thread_waiters;
+	thread_waiters = thread_running;
+	thread_schedule();
+	enable_hardware_interrupts();
+}
+
+void thread_tick(void)
+{
+	struct thread* thread = thread_running;
+
+	if (!thread) {
+		return;
+	}
+	thread->ticks++;
+	if (thread->slice > 0) {
+		thread->slice--;
+	}
+	// Round-robin: only threads of the same or higher priority take over
+	if (thread->slice == 0 && (thread_ready_mask & ((2 << thread->priority) - 1))) {
+		thread_need_resched = 1;
+	}
+}
+
+void thread_interrupted(void)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+	struct thread* thread;
+
+	while ((thread = thread_waiters) != 0) {
+		thread_waiters = thread->next;
+		thread_make_ready(thread);
+	}
+	restore_hardware_interrupts(flags);
+}
+
+void thread_preempt(void)
+{
+	if (thread_running) {
+		thread_schedule();
+	}
+}
+
+/* Output ********************************************************************/
+
+/* Writes a number right aligned in a field of width characters */
+static void thread_write_column(u32int value, u32int width)
+{
+	u32int digits = 1;
+	u32int rest;
+
+	for (rest = value; rest >= 10; rest /= 10) {
+		digits++;
+	}
+	for (; digits < width; digits++) {
+		fb_write_char(' ', FB_WHITE, FB_BLACK);
+	}
+	fb_write_number(value, FB_WHITE, FB_BLACK);
+}
+
+void thread_print_info(void)
+{
+	struct thread snapshot;
+	const char* state;
+	u32int flags;
+	u32int used;
+	u32int i;
+
+	fb_write_string(" ID STATE    PRI   TICKS SWITCHES  STACK NAME\n", FB_LIGHT_CYAN, FB_BLACK);
+	for (i = 0; i < THREAD_MAX; i++) {
+		flags = save_and_disable_hardware_interrupts();
+		snapshot = thread_table[i];
+		restore_hardware_interrupts(flags);
+		if (snapshot.state == THREAD_UNUSED) {
+			continue;
+		}
+
+		thread_write_column(snapshot.id, 3);
+		fb_write_char(' ', FB_WHITE, FB_BLACK);
+		state = thread_state_names[snapshot.state];
+		fb_write_string((char*) state, FB_WHITE, FB_BLACK);
+		used = 0;
+		while (state[used]) {
+			used++;
+		}
+		for (; used < 8; used++) {
+			fb_write_char(' ', FB_WHITE, FB_BLACK);
+		}
+		thread_write_column(snapshot.priority, 4);
+		thread_write_column((u32int) snapshot.ticks, 8);
+		thread_write_column(snapshot.switches, 9);
+		used = snapshot.state == THREAD_DEAD ? 0 : stack_used(snapshot.stack, snapshot.stack_size);
+		thread_write_column(used, 7);
+		fb_write_char(' ', FB_WHITE, FB_BLACK);
+		fb_write_string(snapshot.name, FB_WHITE, FB_BLACK);
+		fb_newline();
+	}
+}
@@ -0,0 +1,128 @@
+#ifndef INCLUDE_THREAD_H
+#define INCLUDE_THREAD_H
+
+#include "type.h"
+#include "timer.h"
+
+/*
+    Kernel threads with a preemptive priority scheduler.
+
+    Each priority level has a FIFO run queue, and a bitmap records which
+    queues are non-empty, so picking the next thread is one bit scan. The
+    highest priority runnable thread always runs; threads of equal priority
+    share the CPU round-robin, THREAD_TIMESLICE ticks at a time. Priority 0
+    is the highest; THREAD_PRIORITY_IDLE belongs to the idle thread, which
+    tops up the zeroed page pool and halts.
+
+    Preemption happens on the way out of the outermost interrupt, back on
+    the interrupted thread's own stack (see interrupt_asm.s), when the
+    timer tick used up the timeslice or a wakeup made a higher priority
+    thread runnable. Code running with interrupts disabled is never
+    preempted.
+
+    Only the integer registers are switched: threads other than the shell
+    must not use the FPU or SSE.
+*/
+#define THREAD_MAX		16
+#define THREAD_PRIORITIES	8
+#define THREAD_PRIORITY_HIGH	1	/* the shell */
+#define THREAD_PRIORITY_NORMAL	4	/* thread_spawn() default */
+#define THREAD_PRIORITY_LOW	6
+#define THREAD_PRIORITY_IDLE	(THREAD_PRIORITIES - 1)
+#define THREAD_TIMESLICE	5	/* ticks */
+#define THREAD_STACK_ORDER	1	/* 8 KiB stacks, guard included */
+#define THREAD_NAME_LENGTH	12
+
+#define THREAD_UNUSED		0
+#define THREAD_RUNNING		1
+#define THREAD_READY		2
+#define THREAD_SLEEPING		3	/* on its timer */
+#define THREAD_WAITING		4	/* for the next interrupt */
+#define THREAD_DEAD		5	/* stack not freed yet */
+
+struct thread {
+	u32int esp;		/* saved by thread_switch */
+	u32int id;
+	u32int state;
+	u32int priority;
+	u32int slice;		/* ticks left of the timeslice */
+	struct thread* next;	/* run queue or wait list */
+	u32int* stack;		/* guard, then the stack proper */
+	u32int stack_size;
+	u64int ticks;		/* timer ticks spent running */
+	u32int switches;	/* times switched in */
+	void (*entry)(void* arg);
+	void* arg;
+	struct timer timer;	/* for thread_sleep() */
+	char name[THREAD_NAME_LENGTH];
+};
+
+/** thread_init:
+ *  Turns the boot flow (kmain and then the shell) into the first thread
+ *  and starts the idle thread. Needs the timer wheel; call before
+ *  interrupts are enabled.
+ */
+void thread_init(void);
+
+/** thread_spawn:
+ *  Starts a thread running entry(arg) at a priority; it exits when entry
+ *  returns. The new thread runs at once if its priority is higher than
+ *  the caller's.
+ *
+ *  @return the thread, or 0 if there is no free slot or memory for a stack
+ */
+struct thread* thread_spawn(const char* name, void (*entry)(void* arg), void* arg, u32int priority);
+
+struct thread* thread_current(void);
+
+/** thread_yield:
+ *  Lets other threads of the same or higher priority run first.
+ */
+void thread_yield(void);
+
+/** thread_sleep:
+ *  Blocks the calling thread for ms milliseconds.
+ */
+void thread_sleep(u32int ms);
+
+/** thread_exit:
+ *  Ends the calling thread. Its stack is freed by the next one to run.
+ */
+void thread_exit(void);
+
+/** thread_wait_interrupt:
+ *  Blocks until the next interrupt has been handled, letting other threads
+ *  run meanwhile; the thread version of timer_idle(). Call with interrupts
+ *  disabled after checking there is nothing to do; returns with them
+ *  enabled.
+ */
+void thread_wait_interrupt(void);
+
+/** thread_tick:
+ *  Called by the timer interrupt: charges the tick to the running thread
+ *  and asks for a switch when its timeslice is used up.
+ */
+void thread_tick(void);
+
+/** thread_interrupted:
+ *  Called on the way out of the outermost interrupt: wakes the threads in
+ *  thread_wait_interrupt().
+ */
+void thread_interrupted(void);
+
+/** thread_preempt:
+ *  Called by common_interrupt_handler, with interrupts disabled and on the
+ *  interrupted thread's stack, when thread_need_resched is set.
+ */
+void thread_preempt(void);
+
+void thread_print_info(void);
+
+/* Set when a higher priority thread is ready or the timeslice is over */
+extern volatile u32int thread_need_resched;
+
+/* In thread_asm.s: saves the callee-saved registers and EFLAGS on the
+ * current stack, stores ESP in *save_esp and resumes the stack at load_esp */
+void thread_switch(u32int* save_esp, u32int load_esp);
+
+#endif /* INCLUDE_THREAD_H */
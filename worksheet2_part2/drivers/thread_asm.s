@@ -0,0 +1,22 @@
+global thread_switch
+
+; thread_switch - saves the current context and resumes another thread
+; stack: [esp + 8] the saved ESP of the thread to resume
+;        [esp + 4] where to save ESP for the current thread
+; Only callee-saved registers need keeping; EFLAGS carries the IF state.
+thread_switch:
+  mov eax, [esp + 4]
+  mov edx, [esp + 8]
+  push ebp
+  push ebx
+  push esi
+  push edi
+  pushfd
+  mov [eax], esp
+  mov esp, edx
+  popfd
+  pop edi
+  pop esi
+  pop ebx
+  pop ebp
+  ret
@@ -0,0 +1,277 @@
+#include "timer.h"
+#include "pit.h"
+#include "cpu.h"
+#include "deferred.h"
+#include "hardware_interrupt_enabler.h"
+#include "zeropool.h"
+#include "thread.h"
+#include "init.h"
+
+/*
+    Timing wheel
+	Timers with expiry in [clk, clk + 64) sit in level 0 at expires & 63.
+	Level n holds timers due within 64^(n+1) ticks, indexed by bits
+	6n..6n+5 of their expiry. Whenever level n-1 wraps, the current slot of
+	level n is emptied and its timers are re-added ("cascaded"), which puts
+	them one level lower. Timers further out than the top level can reach
+	are parked in its last slot and simply re-added when it comes round.
+
+	Everything here runs with interrupts disabled except the callbacks.
+*/
+
+static struct timer* timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+static u64int timer_clk = 0;	/* next tick to process */
+static u32int timer_count = 0;
+
+static void timer_detach(struct timer* timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next) {
+		timer->next->pprev = timer->pprev;
+	}
+	timer->next = 0;
+	timer->pprev = 0;
+	timer_count--;
+}
+
+static void timer_enqueue(struct timer* timer)
+{
+	u64int expires = timer->expires;
+	u64int delta;
+	u32int level;
+	struct timer** slot;
+
+	if (expires < timer_clk) {
+		expires = timer_clk;	// overdue: runs on the next processed tick
+	}
+	delta = expires - timer_clk;
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+		if (delta < ((u64int) 1 << ((level + 1) * TIMER_WHEEL_BITS))) {
+			break;
+		}
+	}
+	if (delta >= ((u64int) 1 << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS))) {
+		expires = timer_clk + ((u64int) 1 << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1;
+	}
+
+	slot = &timer_wheel[level][(expires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK];
+	timer->next = *slot;
+	if (timer->next) {
+		timer->next->pprev = &timer->next;
+	}
+	*slot = timer;
+	timer->pprev = slot;
+	timer_count++;
+}
+
+/**
+  *  Re-adds every timer of one slot; they land at least one level lower.
+  *
+  *  @return The slot index, so the caller knows whether this level wrapped
+  */
+static u32int timer_cascade(u32int level)
+{
+	u32int index = (timer_clk >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+	struct timer* timer;
+
+	while ((timer = timer_wheel[level][index]) != 0) {
+		timer_detach(timer);
+		timer_enqueue(timer);
+	}
+	return index;
+}
+
+/**
+  *  Deferred handler: runs every timer that is due, catching up on any ticks
+  *  that passed since the last run.
+  */
+static void timer_run(void)
+{
+	u64int now = pit_ticks();
+	u32int flags = save_and_disable_hardware_interrupts();
+	u32int index;
+	u32int level;
+	struct timer* timer;
+	void (*function)(void* data);
+	void* data;
+
+	while (timer_clk <= now) {
+		if (timer_count == 0) {
+			timer_clk = now + 1;	// nothing queued, nothing to cascade
+			break;
+		}
+
+		index = timer_clk & TIMER_WHEEL_MASK;
+		if (index == 0) {
+			for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+				if (timer_cascade(level) != 0) {
+					break;
+				}
+			}
+		}
+
+		while ((timer = timer_wheel[0][index]) != 0) {
+			timer_detach(timer);
+			function = timer->function;
+			data = timer->data;
+
+			restore_hardware_interrupts(flags);
+			function(data);
+			flags = save_and_disable_hardware_interrupts();
+		}
+		timer_clk++;
+	}
+
+	restore_hardware_interrupts(flags);
+}
+
+void __init timer_init(void)
+{
+	timer_clk = pit_ticks();
+	deferred_register(DEFERRED_TIMERS, timer_run);
+}
+
+void timer_setup(struct timer* timer, void (*function)(void* data), void* data)
+{
+	timer->next = 0;
+	timer->pprev = 0;
+	timer->function = function;
+	timer->data = data;
+}
+
+void timer_add(struct timer* timer, u64int expires)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+
+	if (timer->pprev) {
+		timer_detach(timer);
+	}
+	timer->expires = expires;
+	timer_enqueue(timer);
+	restore_hardware_interrupts(flags);
+}
+
+u64int timer_ms_to_ticks(u32int ms)
+{
+	u64int ticks = cpu_div_u64((u64int) ms * pit_hz() + 999, 1000, 0);
+
+	return ticks ? ticks : 1;
+}
+
+void timer_add_ms(struct timer* timer, u32int ms)
+{
+	timer_add(timer, pit_ticks() + timer_ms_to_ticks(ms));
+}
+
+u32int timer_cancel(struct timer* timer)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+	u32int was_pending = timer->pprev != 0;
+
+	if (was_pending) {
+		timer_detach(timer);
+	}
+	restore_hardware_interrupts(flags);
+	return was_pending;
+}
+
+u32int timer_pending(struct timer* timer)
+{
+	return timer->pprev != 0;
+}
+
+u64int timer_next_expiry(void)
+{
+	u32int flags = save_and_disable_hardware_interrupts();
+	u64int next = TIMER_NEVER;
+	u64int block;
+	u64int due;
+	u32int level;
+	u32int k;
+
+	if (timer_count == 0) {
+		restore_hardware_interrupts(flags);
+		return TIMER_NEVER;
+	}
+
+	// Level 0 slots are exact
+	for (k = 0; k < TIMER_WHEEL_SIZE; k++) {
+		if (timer_wheel[0][(timer_clk + k) & TIMER_WHEEL_MASK]) {
+			next = timer_clk + k;
+			break;
+		}
+	}
+
+	// Higher levels: the time a slot is cascaded is a lower bound for its
+	// timers, and may come before the first level 0 hit
+	for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+		block = timer_clk >> (level * TIMER_WHEEL_BITS);
+		for (k = 1; k <= TIMER_WHEEL_SIZE; k++) {
+			if (timer_wheel[level][(block + k) & TIMER_WHEEL_MASK]) {
+				due = (block + k) << (level * TIMER_WHEEL_BITS);
+				if (due < next) {
+					next = due;
+				}
+				break;
+			}
+		}
+	}
+
+	restore_hardware_interrupts(flags);
+	return next;
+}
+
+static void ksleep_wake(void* data)
+{
+	*(volatile u32int*) data = 1;
+}
+
+void ksleep(u32int ms)
+{
+	struct timer timer;
+	volatile u32int done = 0;
+
+	// Other threads get the CPU meanwhile once there are any
+	if (thread_current()) {
+		thread_sleep(ms);
+		return;
+	}
+
+	timer_setup(&timer, ksleep_wake, (void*) &done);
+	timer_add_ms(&timer, ms);
+	while (!done) {
+		if (zeropool_refill_one()) {
+			continue;
+		}
+		disable_hardware_interrupts();
+		if (!done) {
+			timer_idle();
+		}
+		enable_hardware_interrupts();
+	}
+}
+
+void timer_idle(void)
+{
+	u64int next = timer_next_expiry();
+	u64int now = pit_ticks();
+
+	// Nothing due for a while: skip the ticks in between
+	if (next > now + 1) {
+		pit_oneshot(next - now > 0xFFFF ? 0xFFFF : (u32int) (next - now));
+	}
+
+	// sti takes effect after hlt starts, so a wakeup cannot slip in between
+	asm volatile("sti; hlt");
+}
+
+void timeout_start(struct timeout* timeout, u32int ms)
+{
+	timeout->deadline = pit_ticks() + timer_ms_to_ticks(ms);
+}
+
+u32int timeout_expired(struct timeout* timeout)
+{
+	return pit_ticks() >= timeout->deadline;
+}
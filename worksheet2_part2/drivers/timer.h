@@ -0,0 +1,81 @@
+#ifndef INCLUDE_TIMER_H
+#define INCLUDE_TIMER_H
+
+#include "type.h"
+
+/*
+    Hierarchical timing wheel driven by the PIT tick. Level 0 has one slot
+    per tick; each higher level has one slot per full turn of the level
+    below. Adding and cancelling a timer is O(1); a timer is moved down at
+    most TIMER_WHEEL_LEVELS - 1 times before it expires.
+*/
+#define TIMER_WHEEL_BITS	6
+#define TIMER_WHEEL_SIZE	(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS	4
+
+#define TIMER_NEVER		0xFFFFFFFFFFFFFFFFULL
+
+struct timer {
+	struct timer* next;
+	struct timer** pprev;	/* null while the timer is not queued */
+	u64int expires;		/* absolute tick */
+	void (*function)(void* data);
+	void* data;
+};
+
+void timer_init(void);
+
+void timer_setup(struct timer* timer, void (*function)(void* data), void* data);
+
+/** timer_add:
+ *  Queues (or re-queues) a timer to run at an absolute tick. The callback
+ *  runs in deferred context with interrupts enabled.
+ */
+void timer_add(struct timer* timer, u64int expires);
+
+/** timer_add_ms:
+ *  Queues a timer to run ms milliseconds from now (at least one tick).
+ */
+void timer_add_ms(struct timer* timer, u32int ms);
+
+/** timer_cancel:
+ *  Removes a queued timer.
+ *
+ *  @return 1 if it was still pending
+ */
+u32int timer_cancel(struct timer* timer);
+
+u32int timer_pending(struct timer* timer);
+
+/** timer_next_expiry:
+ *  Returns a lower bound on the next tick with work due, or TIMER_NEVER.
+ */
+u64int timer_next_expiry(void);
+
+u64int timer_ms_to_ticks(u32int ms);
+
+/** ksleep:
+ *  Waits until ms milliseconds have passed: blocks the calling thread once
+ *  threads are running, halts the CPU before that. Interrupts must be
+ *  enabled.
+ */
+void ksleep(u32int ms);
+
+/** timer_idle:
+ *  Halts until the next interrupt. Call with interrupts disabled after
+ *  checking there is nothing to do; returns with interrupts enabled. If no
+ *  timer is due within the next tick, the periodic tick is stopped until
+ *  the earliest one (tickless idle).
+ */
+void timer_idle(void);
+
+/* A deadline for polling loops */
+struct timeout {
+	u64int deadline;
+};
+
+void timeout_start(struct timeout* timeout, u32int ms);
+u32int timeout_expired(struct timeout* timeout);
+
+#endif /* INCLUDE_TIMER_H */
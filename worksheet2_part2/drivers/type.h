@@ -4,6 +4,8 @@
 /* Typedefs, to standardise sizes across platforms.
  * These typedefs are written for 32-bit X86.
  */
+typedef unsigned long long u64int;
+typedef long long s64int;
 typedef unsigned int u32int;
 typedef int s32int;
 typedef unsigned short u16int;
@@ -0,0 +1,96 @@
+#include "zeropool.h"
+#include "pmm.h"
+#include "cpu.h"
+#include "framebuffer.h"
+#include "spinlock.h"
+#include "init.h"
+
+static struct spinlock zeropool_lock = SPINLOCK_INIT("zeropool");
+static u32int zeropool_pages[ZEROPOOL_SIZE];
+static u32int zeropool_count = 0;
+static u32int zeropool_ready = 0;
+static u32int zeropool_nocache = 0;
+static struct zeropool_stats zeropool_counts;
+
+void __init zeropool_init(void)
+{
+	zeropool_nocache = cpu_has_feature(CPU_FEATURE_SSE2);
+	zeropool_ready = 1;
+}
+
+u32int zeropool_alloc(void)
+{
+	u32int flags = spin_lock_irqsave(&zeropool_lock);
+	u32int page;
+
+	if (zeropool_count) {
+		page = zeropool_pages[--zeropool_count];
+		zeropool_counts.hits++;
+		spin_unlock_irqrestore(&zeropool_lock, flags);
+		return page;
+	}
+	spin_unlock_irqrestore(&zeropool_lock, flags);
+
+	// Empty: clear one now, through the cache since it is about to be used
+	page = pmm_alloc_page();
+	if (page) {
+		cpu_zero_page(PMM_PHYS_TO_VIRT(page));
+		zeropool_counts.misses++;
+	}
+	return page;
+}
+
+u32int zeropool_refill_one(void)
+{
+	u32int flags;
+	u32int page;
+
+	if (!zeropool_ready || zeropool_count >= ZEROPOOL_SIZE || pmm_free_page_count() < ZEROPOOL_MIN_FREE) {
+		return 0;
+	}
+	page = pmm_alloc_page();
+	if (!page) {
+		return 0;
+	}
+
+	// Zeroed with interrupts on: the page is nobody's until it is pooled
+	if (zeropool_nocache) {
+		cpu_zero_page_nocache(PMM_PHYS_TO_VIRT(page));
+	} else {
+		cpu_zero_page(PMM_PHYS_TO_VIRT(page));
+	}
+
+	flags = spin_lock_irqsave(&zeropool_lock);
+	if (zeropool_count < ZEROPOOL_SIZE) {
+		zeropool_pages[zeropool_count++] = page;
+		zeropool_counts.idle_zeroed++;
+		page = 0;
+	}
+	spin_unlock_irqrestore(&zeropool_lock, flags);
+
+	if (page) {
+		pmm_free_page(page);
+	}
+	return 1;
+}
+
+void zeropool_get_stats(struct zeropool_stats* stats)
+{
+	*stats = zeropool_counts;
+	stats->pooled = zeropool_count;
+}
+
+void zeropool_print_info(void)
+{
+	fb_write_string("Zeroed page pool: ", FB_WHITE, FB_BLACK);
+	fb_write_number(zeropool_count, FB_WHITE, FB_BLACK);
+	fb_write_string("/", FB_WHITE, FB_BLACK);
+	fb_write_number(ZEROPOOL_SIZE, FB_WHITE, FB_BLACK);
+	fb_write_string(" pages, ", FB_WHITE, FB_BLACK);
+	fb_write_number(zeropool_counts.hits, FB_WHITE, FB_BLACK);
+	fb_write_string(" hits, ", FB_WHITE, FB_BLACK);
+	fb_write_number(zeropool_counts.misses, FB_WHITE, FB_BLACK);
+	fb_write_string(" misses, ", FB_WHITE, FB_BLACK);
+	fb_write_number(zeropool_counts.idle_zeroed, FB_WHITE, FB_BLACK);
+	fb_write_string(zeropool_nocache ? " zeroed idle (movnti)\n" : " zeroed idle\n", FB_WHITE, FB_BLACK);
+}
@@ -0,0 +1,42 @@
+#ifndef INCLUDE_ZEROPOOL_H
+#define INCLUDE_ZEROPOOL_H
+
+#include "type.h"
+
+/*
+    Pool of pre-zeroed pages. The idle loops top it up one page at a time
+    (with non-temporal stores when the CPU has SSE2, so the caches keep
+    what is actually in use) and zeropool_alloc() hands pages out without
+    clearing anything. Only when the pool is empty does a caller pay for
+    zeroing a page itself.
+*/
+#define ZEROPOOL_SIZE		64	/* pages held at most: 256 KiB */
+#define ZEROPOOL_MIN_FREE	256	/* never refill below this many free pages */
+
+struct zeropool_stats {
+	u32int hits;		/* served from the pool */
+	u32int misses;		/* zeroed on the spot */
+	u32int idle_zeroed;	/* pages zeroed in idle time */
+	u32int pooled;
+};
+
+/** zeropool_init:
+ *  Picks the zeroing method. Needs the physical memory manager.
+ */
+void zeropool_init(void);
+
+/** zeropool_alloc:
+ *  @return the physical address of a zeroed page, or 0 if memory is out
+ */
+u32int zeropool_alloc(void);
+
+/** zeropool_refill_one:
+ *  Zeroes one page into the pool. Called from idle loops with interrupts
+ *  enabled; returns 0 when there is nothing to do, so the caller can halt.
+ */
+u32int zeropool_refill_one(void);
+
+void zeropool_get_stats(struct zeropool_stats* stats);
+void zeropool_print_info(void);
+
+#endif /* INCLUDE_ZEROPOOL_H */
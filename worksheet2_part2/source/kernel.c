@@ -7,6 +7,24 @@
 #include "../drivers/interrupts.h"
 #include "../drivers/pic.h"
 #include "../drivers/keyboard.h"
+#include "../drivers/serial.h"
+#include "../drivers/gdt.h"
+#include "../drivers/syscall.h"
+#include "../drivers/pit.h"
+#include "../drivers/hpet.h"
+#include "../drivers/clock.h"
+#include "../drivers/timer.h"
+#include "../drivers/rtc.h"
+#include "../drivers/multiboot.h"
+#include "../drivers/pmm.h"
+#include "../drivers/paging.h"
+#include "../drivers/slab.h"
+#include "../drivers/pagefault.h"
+#include "../drivers/stack.h"
+#include "../drivers/symbols.h"
+#include "../drivers/zeropool.h"
+#include "../drivers/thread.h"
+#include "../drivers/smp.h"
 
 /* Function 1: sum_of_three as specified in the book */
 int sum_of_three(int arg1, int arg2, int arg3) {
@@ -43,8 +61,11 @@ int fibonacci(int n) {
     return result;
 }
 
-/* Main C function called from assembly */
-void kmain(void) {
+/* Main C function called from assembly, with what GRUB left in eax and ebx */
+void kmain(u32int multiboot_magic, struct multiboot_info* multiboot) {
+    /* Paint the stacks before anything else uses them */
+    stack_init();
+
     /* Clear the screen with black background */
     fb_clear(FB_BLACK);
     
@@ -54,11 +75,43 @@ void kmain(void) {
     fb_move(0, 1);
     fb_write_string("Initializing keyboard and interrupt system...", FB_LIGHT_CYAN, FB_BLACK);
     
-    /* Initialize interrupt system */
+    /* Use our own segments (with a TSS) rather than the bootloader's */
+    gdt_install();
+
+    /* Take over physical memory, as described by the bootloader, then
+       replace the boot page tables (GRUB passes physical addresses) */
+    if (multiboot_magic == MULTIBOOT_BOOTLOADER_MAGIC) {
+        pmm_init(PMM_PHYS_TO_VIRT(multiboot));
+        paging_init();
+        slab_init();
+        zeropool_init();
+        pagefault_init();
+        symbols_init(PMM_PHYS_TO_VIRT(multiboot));
+    } else {
+        fb_move(0, 2);
+        fb_write_string("Not booted by multiboot: no memory map", FB_LIGHT_RED, FB_BLACK);
+    }
+
+    /* Initialize interrupt system (APIC if present, else the PIC) */
     interrupts_install_idt();
-    
-    /* Initialize PIC */
-    pic_remap(32, 40);
+    syscall_init();
+
+    /* Calibrate the cycle counter, then start the system tick */
+    hpet_init();
+    clock_init();
+    timer_init();
+    pit_init(PIT_HZ);
+    rtc_init();
+
+    /* From here on kmain, and then the shell, is the first thread */
+    thread_init();
+
+    /* Start the other CPUs; they run the job pool */
+    smp_init();
+
+    /* Bring up the input devices */
+    keyboard_init();
+    serial_init();
     
     /* Enable interrupts */
     asm volatile("sti");
@@ -67,6 +120,9 @@ void kmain(void) {
     fb_move(0, 3);
     fb_write_string("System ready! Type 'help' for available commands.", FB_LIGHT_GREEN, FB_BLACK);
     
+    /* Boot is over: the __init code can go */
+    pmm_free_init();
+
     /* Start the terminal interface */
     terminal_main();
     
@@ -1,17 +1,49 @@
 global loader                   ; the entry symbol for ELF
+global kernel_stack             ; checked and measured by stack.c
+global boot_page_directory      ; application processors start with it (smp.c)
 extern kmain                    ; declare external C function
 
 MAGIC_NUMBER equ 0x1BADB002    ; define the magic number constant
-FLAGS        equ 0x0           ; multiboot flags
-CHECKSUM     equ -MAGIC_NUMBER ; calculate the checksum
+FLAGS        equ 0x3           ; multiboot flags: page align modules (bit 0),
+                               ; provide the memory map (bit 1)
+CHECKSUM     equ -(MAGIC_NUMBER + FLAGS) ; calculate the checksum
                                ; (magic number + checksum + flags should equal 0)
 
-KERNEL_STACK_SIZE equ 4096     ; size of stack in bytes
+; Stack size in bytes, overridable with -DKERNEL_STACK_SIZE=n (see stack.h)
+%ifndef KERNEL_STACK_SIZE
+%define KERNEL_STACK_SIZE 16384
+%endif
+; Canary bytes below the stack; passed by the Makefile to stack.h as well
+%ifndef STACK_GUARD_SIZE
+%error "STACK_GUARD_SIZE comes from the Makefile's STACK_OPTIONS"
+%endif
+
+KERNEL_VIRTUAL_BASE equ 0xC0000000             ; must match link.ld and pmm.h
+KERNEL_PAGE_NUMBER  equ KERNEL_VIRTUAL_BASE >> 22 ; its page directory index
+DIRECT_MAP_PAGES    equ 192                    ; 768 MiB of 4 MiB pages
+PAGE_PRESENT_RW_4MB equ 0x83                   ; present, writable, 4 MiB (PSE)
+CR4_PSE             equ 0x00000010
+CR0_PG_WP           equ 0x80010000             ; paging, write protect in ring 0
 
 section .bss
-align 4                        ; align stack on 4-byte boundary
+align 16                       ; align stack on 16-byte boundary
 kernel_stack:
-    resb KERNEL_STACK_SIZE     ; reserve stack space
+    resb STACK_GUARD_SIZE + KERNEL_STACK_SIZE ; guard, then the stack proper
+
+section .data
+align 4096
+; Boot page directory: the first 4 MiB identity mapped (only until the jump
+; to the higher half), and physical memory mapped again at 0xC0000000 with
+; 4 MiB pages. paging_init() replaces it with one sized to the real RAM.
+boot_page_directory:
+    dd PAGE_PRESENT_RW_4MB
+    times (KERNEL_PAGE_NUMBER - 1) dd 0
+%assign page 0
+%rep DIRECT_MAP_PAGES
+    dd (page << 22) | PAGE_PRESENT_RW_4MB
+%assign page page + 1
+%endrep
+    times (1024 - KERNEL_PAGE_NUMBER - DIRECT_MAP_PAGES) dd 0
 
 section .text:                 ; start of the text (code) section
     align 4                    ; the code must be 4 byte aligned
@@ -19,11 +51,33 @@ section .text:                 ; start of the text (code) section
     dd FLAGS                   ; the flags,
     dd CHECKSUM                ; and the checksum
 
+; GRUB jumps here with paging off, so until paging is on only physical
+; addresses (symbol - KERNEL_VIRTUAL_BASE) may be used. eax and ebx hold
+; the multiboot magic and info pointer and must survive.
 loader:                        ; the loader label (defined as entry point in linker script)
-    mov eax, 0xCAFEBABE       ; place the number 0xCAFEBABE in the register eax
-    
+    mov ecx, boot_page_directory - KERNEL_VIRTUAL_BASE
+    mov cr3, ecx
+
+    mov ecx, cr4
+    or ecx, CR4_PSE            ; allow 4 MiB pages
+    mov cr4, ecx
+
+    mov ecx, cr0
+    or ecx, CR0_PG_WP          ; enable paging
+    mov cr0, ecx
+
+    lea ecx, [higher_half]     ; absolute jump into the higher half
+    jmp ecx
+
+higher_half:
     ; Set up the stack for C function calls
-    mov esp, kernel_stack + KERNEL_STACK_SIZE   ; point stack to end of stack area
+    mov esp, kernel_stack + STACK_GUARD_SIZE + KERNEL_STACK_SIZE ; point stack to end of stack area
+
+    ; kmain(magic, multiboot info): GRUB leaves the magic in eax, the info in ebx
+    push ebx
+    push eax
+
+    mov eax, 0xCAFEBABE       ; place the number 0xCAFEBABE in the register eax
     
     ; Call the C main function
     call kmain